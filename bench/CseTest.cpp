@@ -0,0 +1,228 @@
+/**
+ *
+ * Copyright (c) 2001, Frank Bu
+ *
+ * project: Formula
+ * version: $Revision: 1.3 $ $Name:  $
+ *
+ * Test of the common subexpressions, without VCV Rack. Random expressions
+ * with repeated subexpressions are compared with the same expressions, in
+ * which every variable is read with the impure function opaque(x). A
+ * subexpression with an impure function is never merged, so the second
+ * expression is calculated without common subexpressions. The results, the
+ * error flags and the calls of the impure function tick() must be the same
+ * for eval() and evalBlock(), and the pure function square() may be called
+ * only less often. Without conditionals, & and |, tick() must be called once
+ * per sample for every tick() of the expression.
+ */
+
+#include "Formula.h"
+#include "Evaluator.h"
+#include "TestMain.h"
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+#define SAMPLES 64
+
+struct Calls {
+	int ticks;
+	int squares;
+};
+
+static const char* variableNames[] = {"x", "y", "z"};
+static const int variableCount = 3;
+
+static Calls calls;
+
+static float tick()
+{
+	calls.ticks++;
+	return 1.0f;
+}
+
+static float square(float x)
+{
+	calls.squares++;
+	return x * x;
+}
+
+static float opaque(float x)
+{
+	return x;
+}
+
+static const char* pick(const char* const* names, int count)
+{
+	return names[rand() % count];
+}
+
+// A random expression, half of its operands are subexpressions which were
+// generated before. The variables are replaced by opaque(x) in the second
+// expression.
+static void randomExpression(int depth, vector<pair<string, string> >& generated, string& expression,
+                             string& opaqueExpression)
+{
+	if (generated.size() > 0 && rand() % 2 == 0) {
+		const pair<string, string>& repeated = generated[rand() % generated.size()];
+		expression = repeated.first;
+		opaqueExpression = repeated.second;
+		return;
+	}
+	if (depth == 0 || rand() % 6 == 0) {
+		switch (rand() % 6) {
+		case 0: {
+			static const char* numbers[] = {"0", "1", "2", "0.5", "3"};
+			expression = opaqueExpression = pick(numbers, ELEMENTS(numbers));
+			break;
+		}
+		case 1:
+			expression = opaqueExpression = "tick()";
+			break;
+		default:
+			expression = pick(variableNames, variableCount);
+			opaqueExpression = "opaque(" + expression + ")";
+		}
+		return;
+	}
+	static const char* binaryOperators[] = {"+", "-", "*", "/", "^", "<", ">=", "!=", "&", "|"};
+	static const char* functions[] = {"sin", "exp", "sqrt", "abs", "square"};
+	string a, b, c, opaqueA, opaqueB, opaqueC;
+	randomExpression(depth - 1, generated, a, opaqueA);
+	switch (rand() % 6) {
+	case 0: {
+		string function = pick(functions, ELEMENTS(functions));
+		expression = function + "(" + a + ")";
+		opaqueExpression = function + "(" + opaqueA + ")";
+		break;
+	}
+	case 1:
+		randomExpression(depth - 1, generated, b, opaqueB);
+		randomExpression(depth - 1, generated, c, opaqueC);
+		expression = "(" + a + " ? " + b + " : " + c + ")";
+		opaqueExpression = "(" + opaqueA + " ? " + opaqueB + " : " + opaqueC + ")";
+		break;
+	default: {
+		string op = pick(binaryOperators, ELEMENTS(binaryOperators));
+		randomExpression(depth - 1, generated, b, opaqueB);
+		expression = "(" + a + " " + op + " " + b + ")";
+		opaqueExpression = "(" + opaqueA + " " + op + " " + opaqueB + ")";
+	}
+	}
+	generated.push_back(make_pair(expression, opaqueExpression));
+}
+
+// the calls of tick() per sample, -1 if some of them may be skipped
+static int getTicks(const string& expression)
+{
+	if (expression.find_first_of("?&|") != string::npos) return -1;
+	int ticks = 0;
+	for (size_t i = expression.find("tick()"); i != string::npos; i = expression.find("tick()", i + 1)) ticks++;
+	return ticks;
+}
+
+static bool setUp(Formula& formula, const string& expression)
+{
+	formula.setFunction("tick", tick);
+	formula.setFunction("square", square, true);
+	formula.setFunction("opaque", opaque);
+	for (int v = 0; v < variableCount; v++) formula.setVariable(variableNames[v], 0);
+	try {
+		formula.setExpression(expression);
+	} catch (ParserException& exception) {
+		return false;
+	}
+	return true;
+}
+
+// returns the number of mismatches, the calls of square() are added
+static int check(const string& expression, const string& opaqueExpression, float inputs[][SAMPLES],
+                 Calls& totalCalls, Calls& totalOpaqueCalls, const Options& options)
+{
+	Formula formula;
+	Formula opaqueFormula;
+	if (!setUp(formula, expression) || !setUp(opaqueFormula, opaqueExpression)) return 0;
+
+	int ticks = getTicks(expression);
+	int mismatches = 0;
+	for (int i = 0; i < SAMPLES; i++) {
+		for (int v = 0; v < variableCount; v++) {
+			formula.setVariable(variableNames[v], inputs[v][i]);
+			opaqueFormula.setVariable(variableNames[v], inputs[v][i]);
+		}
+		formula.clearErrors();
+		opaqueFormula.clearErrors();
+		Calls none = {0, 0};
+		calls = none;
+		float result = formula.eval();
+		Calls formulaCalls = calls;
+		calls = none;
+		float opaqueResult = opaqueFormula.eval();
+		if (!same(result, opaqueResult) || formula.getErrors() != opaqueFormula.getErrors()
+		        || formulaCalls.ticks != calls.ticks || formulaCalls.squares > calls.squares
+		        || (ticks >= 0 && formulaCalls.ticks != ticks))
+		{
+			if (mismatches == 0 && options.verbose) {
+				printf("eval at sample %d: %.9g != %.9g\n  %s\n  %s\n", i, result, opaqueResult,
+				       expression.c_str(), opaqueExpression.c_str());
+			}
+			mismatches++;
+		}
+		totalCalls.squares += formulaCalls.squares;
+		totalOpaqueCalls.squares += calls.squares;
+	}
+
+	for (int v = 0; v < variableCount; v++) {
+		formula.setVariableBuffer(variableNames[v], inputs[v]);
+		opaqueFormula.setVariableBuffer(variableNames[v], inputs[v]);
+	}
+	float output[SAMPLES];
+	float opaqueOutput[SAMPLES];
+	Calls none = {0, 0};
+	calls = none;
+	int errors = formula.evalBlock(output, SAMPLES);
+	Calls formulaCalls = calls;
+	calls = none;
+	int opaqueErrors = opaqueFormula.evalBlock(opaqueOutput, SAMPLES);
+	bool equal = errors == opaqueErrors && formulaCalls.ticks == calls.ticks && formulaCalls.squares <= calls.squares
+	             && (ticks < 0 || formulaCalls.ticks == ticks * SAMPLES);
+	for (int i = 0; i < SAMPLES; i++) {
+		if (!same(output[i], opaqueOutput[i])) equal = false;
+	}
+	if (!equal) {
+		if (mismatches == 0 && options.verbose) {
+			printf("evalBlock\n  %s\n  %s\n", expression.c_str(), opaqueExpression.c_str());
+		}
+		mismatches++;
+	}
+	return mismatches;
+}
+
+static int test(const Options& options)
+{
+	float inputs[variableCount][SAMPLES];
+	int mismatches = 0;
+	Calls totalCalls = {0, 0};
+	Calls totalOpaqueCalls = {0, 0};
+	for (int i = 0; i < options.count; i++) {
+		for (int v = 0; v < variableCount; v++) {
+			for (int j = 0; j < SAMPLES; j++) inputs[v][j] = (rand() % 2001 - 1000) / 100.0f;
+		}
+		vector<pair<string, string> > generated;
+		string expression;
+		string opaqueExpression;
+		randomExpression(1 + rand() % 5, generated, expression, opaqueExpression);
+		mismatches += check(expression, opaqueExpression, inputs, totalCalls, totalOpaqueCalls, options);
+	}
+	// the merged calls show that the common subexpressions are calculated once
+	printf("checked %d formulas, %d mismatches, square() called %d times instead of %d times\n",
+	       options.count, mismatches, totalCalls.squares, totalOpaqueCalls.squares);
+	return mismatches;
+}
+
+int main(int argc, char** argv)
+{
+	return testMain(argc, argv, "cse-test", "--formulas", 5000, false, test);
+}
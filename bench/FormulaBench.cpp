@@ -0,0 +1,280 @@
+/**
+ *
+ * Copyright (c) 2001, Frank Bu
+ *
+ * project: Formula
+ * version: $Revision: 1.3 $ $Name:  $
+ *
+ * Benchmark of the formula library, without VCV Rack. Every formula of the
+ * corpus is evaluated like in the module: eval() per sample and evalBlock()
+ * for blocks of 16 samples, with all math accuracies, with and without the
+ * JIT compiler. The results are written as JSON to stdout.
+ */
+
+#include "Formula.h"
+#include "Evaluator.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// like FrankBussFormulaModule
+#define BLOCK_SIZE 16
+#define SAMPLE_RATE 48000.0f
+
+struct Benchmark {
+	string name;
+	string expression;
+};
+
+struct Options {
+	int runs;
+	int samples;
+	string filter;
+};
+
+// the variables of the module, the inputs are different waveforms
+static const char* variableNames[] = {"p", "k", "b", "w", "x", "y", "z"};
+static const int variableCount = 7;
+
+static string join(string separator, int count, string (*term)(int))
+{
+	string result;
+	for (int i = 0; i < count; i++) {
+		if (i > 0) result += separator;
+		result += term(i);
+	}
+	return result;
+}
+
+static string wideTerm(int i)
+{
+	char term[64];
+	snprintf(term, sizeof(term), "x*%g", 0.5 + i);
+	return term;
+}
+
+static string harmonicTerm(int i)
+{
+	char term[64];
+	snprintf(term, sizeof(term), "sin(%d*pi*p)/%d", 4 * i + 2, 2 * i + 1);
+	return term;
+}
+
+// nested to the right, so that every level needs one more stack element
+static string deepExpression(int depth)
+{
+	string expression = "x";
+	for (int i = 0; i < depth; i++) {
+		expression = string(i % 2 ? "y*(" : "x+(") + expression + ")";
+	}
+	return expression;
+}
+
+static vector<Benchmark> getCorpus()
+{
+	Benchmark corpus[] = {
+		// the examples of the README
+		{"adder", "x+y"},
+		{"sine", "sin(2*pi*p/5)*5"},
+		{"additive square", "4*(\nsin(2*pi*p)+\nsin(6*pi*p)/3+\nsin(10*pi*p)/5+\nsin(14*pi*p)/7\n)"},
+		{"multiplexer", "((w<=5)*x+(w>5)*y)*b"},
+		{"conditional multiplexer", "(w<=5 ? x : y)*b"},
+		{"sequencer", "((p>=0.0&p<0.1)*1+(p>=0.1&p<0.2)*5+\n(p>=0.2&p<0.3)*8+(p>=0.3&p<0.4)*9+\n"
+		              "(p>=0.4&p<0.5)*10+(p>=0.5&p<0.6)*12+\n(p>=0.6&p<0.7)*10+(p>=0.7&p<0.8)*9+\n"
+		              "(p>=0.8&p<0.9)*8+(p>=0.9&p<1.0)*5)\n/12"},
+		{"quantizer", "floor(x)+k"},
+		{"v/hz converter", "log2(abs(x)+1)"},
+		// synthetic expressions
+		{"wide 64", join("+", 64, wideTerm)},
+		{"additive 32", join("+", 32, harmonicTerm)},
+		{"deep 12", deepExpression(12)},
+		{"deep 64", deepExpression(64)},
+		{"functions", "atan2(y,x)+sqrt(abs(w))*tanh(z)-exp(-abs(x))*cos(y)+pow(abs(z),1.5)"}
+	};
+	return vector<Benchmark>(corpus, corpus + sizeof(corpus) / sizeof(corpus[0]));
+}
+
+// one second of the inputs of the module
+static vector<vector<float> > getInputs(int samples)
+{
+	vector<vector<float> > inputs(variableCount, vector<float>(samples));
+	float phase = 0.0f;
+	for (int i = 0; i < samples; i++) {
+		float t = i / SAMPLE_RATE;
+		inputs[0][i] = phase;
+		inputs[1][i] = 0.25f;
+		inputs[2][i] = 1.0f;
+		inputs[3][i] = 5.0f + 5.0f * sinf(2.0f * M_PI * 3.0f * t);
+		inputs[4][i] = 5.0f * sinf(2.0f * M_PI * 220.0f * t);
+		inputs[5][i] = 2.0f * phase - 1.0f;
+		inputs[6][i] = (rand() % 2001 - 1000) / 200.0f;
+		phase += 440.0f / SAMPLE_RATE;
+		if (phase > 1.0f) phase -= 1.0f;
+	}
+	return inputs;
+}
+
+static double now()
+{
+	return chrono::duration<double, nano>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// returns the time per sample, the sum of the results is added to checksum
+static double runEval(Formula& formula, const vector<vector<float> >& inputs, int samples, double& checksum)
+{
+	// the variables are set at once, like in the module
+	float variables[variableCount];
+	double sum = 0;
+	double start = now();
+	for (int i = 0; i < samples; i++) {
+		for (int v = 0; v < variableCount; v++) variables[v] = inputs[v][i];
+		formula.setVariables(variables, variableCount);
+		float value = formula.eval();
+		if (isfinite(value)) sum += value;
+	}
+	double time = now() - start;
+	checksum += sum;
+	return time / samples;
+}
+
+static double runBlock(Formula& formula, const vector<vector<float> >& inputs, int samples, double& checksum)
+{
+	// the buffers are bound once and filled for every block, like in the module
+	float blocks[variableCount][BLOCK_SIZE];
+	float output[BLOCK_SIZE];
+	const float* buffers[variableCount];
+	for (int v = 0; v < variableCount; v++) buffers[v] = blocks[v];
+	formula.setVariableBuffers(buffers, variableCount);
+	double sum = 0;
+	double start = now();
+	for (int i = 0; i + BLOCK_SIZE <= samples; i += BLOCK_SIZE) {
+		for (int v = 0; v < variableCount; v++) memcpy(blocks[v], &inputs[v][i], sizeof(blocks[v]));
+		formula.evalBlock(output, BLOCK_SIZE);
+		for (int j = 0; j < BLOCK_SIZE; j++) {
+			if (isfinite(output[j])) sum += output[j];
+		}
+	}
+	double time = now() - start;
+	for (int v = 0; v < variableCount; v++) buffers[v] = NULL;
+	formula.setVariableBuffers(buffers, variableCount);
+	checksum += sum;
+	return time / (samples / BLOCK_SIZE * BLOCK_SIZE);
+}
+
+static string quote(string text)
+{
+	string result = "\"";
+	for (int i = 0; i < (int) text.size(); i++) {
+		char c = text[i];
+		if (c == '"' || c == '\\') {
+			result += '\\';
+			result += c;
+		} else if (c == '\n') {
+			result += "\\n";
+		} else {
+			result += c;
+		}
+	}
+	return result + "\"";
+}
+
+static void runBenchmark(const Benchmark& benchmark, const vector<vector<float> >& inputs, const Options& options,
+                         bool block, int mathAccuracy, bool jit, bool& first)
+{
+	Formula formula;
+	formula.setConstant("pi", M_PI);
+	formula.setConstant("e", M_E);
+	for (int v = 0; v < variableCount; v++) formula.setVariable(variableNames[v], 0);
+	formula.setMathAccuracy(mathAccuracy);
+	if (!formula.setJitEnabled(jit)) return;
+	formula.setExpression(benchmark.expression);
+
+	// the first run warms up the caches and is not counted
+	double checksum = 0;
+	vector<double> times;
+	for (int run = 0; run <= options.runs; run++) {
+		double time = block ? runBlock(formula, inputs, options.samples, checksum)
+		                    : runEval(formula, inputs, options.samples, checksum);
+		if (run > 0) times.push_back(time);
+	}
+
+	double mean = 0;
+	double min = times[0];
+	double max = times[0];
+	for (int i = 0; i < (int) times.size(); i++) {
+		mean += times[i];
+		if (times[i] < min) min = times[i];
+		if (times[i] > max) max = times[i];
+	}
+	mean /= times.size();
+	double variance = 0;
+	for (int i = 0; i < (int) times.size(); i++) variance += (times[i] - mean) * (times[i] - mean);
+	variance /= times.size();
+
+	const char* accuracies[] = {"exact", "audio", "fast"};
+	printf("%s\n    {\"name\": %s, \"expression\": %s, \"mode\": \"%s\", \"accuracy\": \"%s\", \"jit\": %s,\n",
+	       first ? "" : ",", quote(benchmark.name).c_str(), quote(benchmark.expression).c_str(),
+	       block ? "block" : "eval", accuracies[mathAccuracy], jit ? "true" : "false");
+	printf("     \"runs\": %d, \"samples\": %d, \"nsPerSample\": %.3f, \"minNsPerSample\": %.3f, \"maxNsPerSample\": %.3f,\n",
+	       options.runs, options.samples, mean, min, max);
+	printf("     \"variance\": %.6f, \"samplesPerSecond\": %.0f, \"errors\": %d, \"checksum\": %.6g}",
+	       variance, 1e9 / mean, formula.getErrors(), checksum / (options.runs + 1));
+	fflush(stdout);
+	first = false;
+}
+
+static void usage()
+{
+	fprintf(stderr, "usage: formula-bench [--runs n] [--samples n] [--filter name]\n");
+	exit(1);
+}
+
+int main(int argc, char** argv)
+{
+	Options options;
+	options.runs = 10;
+	options.samples = 48000;
+	for (int i = 1; i < argc; i++) {
+		if (i + 1 == argc) usage();
+		if (strcmp(argv[i], "--runs") == 0) {
+			options.runs = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--samples") == 0) {
+			options.samples = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--filter") == 0) {
+			options.filter = argv[++i];
+		} else {
+			usage();
+		}
+	}
+	if (options.runs < 1 || options.samples < BLOCK_SIZE) usage();
+
+	// the same inputs for every run
+	srand(1);
+	vector<vector<float> > inputs = getInputs(options.samples);
+	vector<Benchmark> corpus = getCorpus();
+
+	Formula formula;
+	const char* instructionSets[] = {"scalar", "sse2", "avx2", "avx512"};
+	printf("{\n  \"instructionSet\": \"%s\",\n  \"jitAvailable\": %s,\n  \"results\": [",
+	       instructionSets[formula.getInstructionSet()], formula.setJitEnabled(true) ? "true" : "false");
+	bool first = true;
+	for (int i = 0; i < (int) corpus.size(); i++) {
+		if (corpus[i].name.find(options.filter) == string::npos) continue;
+		for (int block = 0; block <= 1; block++) {
+			for (int mathAccuracy = ExactMathAccuracy; mathAccuracy <= FastMathAccuracy; mathAccuracy++) {
+				for (int jit = 0; jit <= 1; jit++) {
+					runBenchmark(corpus[i], inputs, options, block, mathAccuracy, jit, first);
+				}
+			}
+		}
+	}
+	printf("\n  ]\n}\n");
+	return 0;
+}
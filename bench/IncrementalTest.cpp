@@ -0,0 +1,189 @@
+/**
+ *
+ * Copyright (c) 2001, Frank Bu
+ *
+ * project: Formula
+ * version: $Revision: 1.3 $ $Name:  $
+ *
+ * Test of the incremental parser, without VCV Rack. A long multi-line
+ * formula is edited randomly, like in the text field of the module: lines
+ * are inserted, removed and replaced, numbers and operators are changed and
+ * characters are inserted and removed, which is often a syntax error. After
+ * every edit, the formula is parsed by one parser, which parses only the
+ * changed lines, and by a new parser. The postfix, the results and the errors
+ * must be the same. The formulas are sums of terms, or statements with local
+ * variables.
+ */
+
+#include "Parser.h"
+#include "TestMain.h"
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+static const char* variableNames[] = {"p", "x", "y"};
+static const int variableCount = 3;
+
+// the lines of the sums, the valid lines are a valid term after every line
+static const char* termLines[] = {
+	"+sin(3*pi*p)/3", "-(x*2.5)", "-x", "*-y", "+!x", "+1", "+(p<0.5)*3", "+ -2", "/2", "+y^2", "+min(p,x)",
+	"-(-(p))", "+atan2(x,\ny)", "+(x\n+y)*2", "-max(x,\n-y)", "+(\nx\n)", "+x>y", "&p", "|x"
+};
+static const int validTermLines = 12;
+
+// the lines of the statements, the last expression is b+a
+static const char* statementLines[] = {
+	"a = x*2;", "b = a+1;", "a = sin(p) ;", "b = b*a;", "a=a+b;", "b = -a;", "a = b*a +1;", "b = max(a, b);",
+	"a = a<b ? x : y;", "b = b - 1;", "a = 2;", "b = (b +a)/2;", "a = sin(p)\n;", "a\n= y;", "b =\n a = 1;",
+	"+a", "*b", "-(a;", "b = a?x:\ny;", "+(x\n+y)*2"
+};
+static const int validStatementLines = 12;
+
+static const char* fragments[] = {
+	";", "=", "a", "b", "+", "-", "*", "(", ")", "x", "1", ",", "\n", " ", "2.5", "sin(", "q"
+};
+
+static void setUp(Parser& parser)
+{
+	parser.setConstant("pi", 3.14159f);
+	for (int v = 0; v < variableCount; v++) parser.setVariable(variableNames[v], 0);
+}
+
+// the postfix and the results for some values of the variables, or the error
+static string parse(Parser& parser, const string& expression)
+{
+	ParserError error;
+	if (!parser.setExpression(expression, error)) {
+		char position[32];
+		snprintf(position, sizeof(position), "error at %d: ", error.position);
+		return position + error.message;
+	}
+	string result = parser.getPostfix() + " =>";
+	float values[][variableCount] = {{0.1f, 1.5f, -2.0f}, {0.7f, -0.3f, 4.0f}, {0.33f, 2.0f, 0.5f}};
+	for (int i = 0; i < ELEMENTS(values); i++) {
+		for (int v = 0; v < variableCount; v++) *parser.getVariableAddress(variableNames[v]) = values[i][v];
+		char value[32];
+		snprintf(value, sizeof(value), " %.7g", parser.eval());
+		result += value;
+	}
+	return result;
+}
+
+static vector<string> splitLines(const string& text)
+{
+	vector<string> lines;
+	size_t start = 0;
+	while (true) {
+		size_t end = text.find('\n', start);
+		lines.push_back(text.substr(start, end == string::npos ? string::npos : end - start));
+		if (end == string::npos) return lines;
+		start = end + 1;
+	}
+}
+
+static string joinLines(const vector<string>& lines)
+{
+	string text = lines[0];
+	for (int i = 1; i < (int) lines.size(); i++) text += "\n" + lines[i];
+	return text;
+}
+
+// a random edit of a line, the valid edits change only whole terms or statements
+static void edit(vector<string>& lines, const char* const* newLines, int newLineCount, bool statements, bool valid)
+{
+	int index = rand() % lines.size();
+	string& line = lines[index];
+	const char* newLine = newLines[rand() % newLineCount];
+	int kind = rand() % (valid ? 8 : 10);
+	if (kind < 3) {
+		lines.insert(lines.begin() + index + 1, newLine);
+	} else if (kind < 5 && lines.size() > 2 && index > 0) {
+		lines.erase(lines.begin() + index);
+	} else if (kind < 7 && index > 0) {
+		line = newLine;
+	} else if (kind < 8 && statements && rand() % 2) {
+		// a missing or an additional ';'
+		size_t semicolon = line.find(';');
+		if (semicolon != string::npos) {
+			line.erase(semicolon, 1);
+		} else {
+			line += ";";
+		}
+	} else if (kind < 8) {
+		size_t digit = line.find_first_of("0123456789");
+		if (digit != string::npos) line[digit] = '0' + rand() % 10;
+	} else if (rand() % 3 == 0) {
+		size_t position = line.size() > 0 ? rand() % (line.size() + 1) : 0;
+		if (rand() % 2 && line.size() > 0) {
+			line.erase(position < line.size() ? position : line.size() - 1, 1);
+		} else {
+			line.insert(position, fragments[rand() % ELEMENTS(fragments)]);
+		}
+	} else {
+		size_t sign = line.find_first_of("+-");
+		if (sign != string::npos) line[sign] = "+-*/"[rand() % 4];
+	}
+}
+
+// returns the number of mismatches
+static int run(bool statements, bool valid, const Options& options)
+{
+	const char* const* newLines = statements ? statementLines : termLines;
+	int newLineCount = statements ? (valid ? validStatementLines : ELEMENTS(statementLines))
+	                              : (valid ? validTermLines : ELEMENTS(termLines));
+	string start = statements ? "a = 0;" : "0";
+	string end = statements ? "\nb+a" : "";
+
+	Parser parser("");
+	setUp(parser);
+	string text = start;
+	for (int i = 0; i < 40; i++) text += string("\n") + newLines[rand() % newLineCount];
+	string lastValidText = text;
+	int mismatches = 0;
+	for (int i = 0; i < options.count; i++) {
+		vector<string> lines = splitLines(text);
+		edit(lines, newLines, newLineCount, statements, valid);
+		text = joinLines(lines);
+		if (text.size() > 3000) text = start;
+
+		string result = parse(parser, text + end);
+		// the new parser doesn't get the program from the cache, because it
+		// has another constant
+		Parser newParser("");
+		setUp(newParser);
+		newParser.setConstant("new", 1);
+		string newResult = parse(newParser, text + end);
+		if (result != newResult) {
+			if (mismatches == 0 && options.verbose) {
+				printf("%s\n  incremental: %s\n  new:         %s\n", (text + end).c_str(), result.c_str(),
+				       newResult.c_str());
+			}
+			mismatches++;
+		}
+
+		// an error is often fixed by the next edits
+		if (result.compare(0, 5, "error") != 0) {
+			lastValidText = text;
+		} else if (rand() % 4 == 0) {
+			text = lastValidText;
+		}
+	}
+	return mismatches;
+}
+
+static int test(const Options& options)
+{
+	int mismatches = 0;
+	for (int statements = 0; statements <= 1; statements++) {
+		for (int valid = 0; valid <= 1; valid++) mismatches += run(statements, valid, options);
+	}
+	printf("checked %d edits, %d mismatches\n", 4 * options.count, mismatches);
+	return mismatches;
+}
+
+int main(int argc, char** argv)
+{
+	return testMain(argc, argv, "incremental-test", "--edits", 5000, false, test);
+}
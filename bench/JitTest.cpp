@@ -0,0 +1,240 @@
+/**
+ *
+ * Copyright (c) 2001, Frank Bu
+ *
+ * project: Formula
+ * version: $Revision: 1.3 $ $Name:  $
+ *
+ * Test of the JIT compiler, without VCV Rack. Random expressions are evaluated
+ * with the interpreter and with the JIT compiler, with all math accuracies:
+ * eval() per sample, and evalBlock() for a count of samples which is a
+ * multiple of 4 and for the counts with the last 1 to 3 samples, which the
+ * JIT code calculates one by one. The results, the number of math errors, the
+ * error flags and the calls of the functions must be the same. The block
+ * kernel of the interpreter uses SSE2, like the JIT code.
+ */
+
+#include "Formula.h"
+#include "Evaluator.h"
+#include "TestMain.h"
+
+#include <string>
+
+using namespace std;
+
+// the samples of a block, the counts are the blocks of 4 samples and the
+// samples calculated one by one
+#define SAMPLES 67
+static const int counts[] = {SAMPLES, 64, 1, 2, 3, 4, 7};
+
+static const char* variableNames[] = {"p", "k", "b", "w", "x", "y", "z"};
+static const int variableCount = 7;
+
+static const char* oneArgumentFunctions[] = {
+	"sin", "cos", "tan", "exp", "log", "log2", "log10", "sinh", "cosh", "tanh",
+	"sqrt", "abs", "floor", "ceil", "asin", "acos", "atan", "twice"
+};
+static const char* twoArgumentsFunctions[] = {"pow", "atan2", "min", "max", "mod", "difference"};
+static const char* numbers[] = {"0", "1", "2", "0.5", "3.25", "10", "1e3", "1e30"};
+
+// The calls of the functions of the test. The order of the calls of a block
+// is not the same, so the impure function returns the same value for every
+// call, but its calls must be the same.
+static int calls = 0;
+
+static float tick()
+{
+	calls++;
+	return 1.0f;
+}
+
+static float twice(float x)
+{
+	calls++;
+	return 2.0f * x;
+}
+
+static float difference(float x, float y)
+{
+	calls++;
+	return x - y;
+}
+
+static const char* pick(const char* const* names, int count)
+{
+	return names[rand() % count];
+}
+
+// a random expression with operands nested up to depth levels, it can read
+// the local variable t
+static string randomExpression(int depth, bool local)
+{
+	if (depth == 0 || rand() % 5 == 0) {
+		switch (rand() % 8) {
+		case 0: return pick(numbers, ELEMENTS(numbers));
+		case 1: return local ? "t" : "x";
+		case 2: return "tick()";
+		default: return pick(variableNames, variableCount);
+		}
+	}
+	static const char* binaryOperators[] = {"+", "-", "*", "/", "^", "<", ">", "<=", ">=", "=", "!=", "&", "|"};
+	string a = randomExpression(depth - 1, local);
+	switch (rand() % 8) {
+	case 0:
+		return string("-(") + a + ")";
+	case 1:
+		return string("!(") + a + ")";
+	case 2:
+		return string(pick(oneArgumentFunctions, ELEMENTS(oneArgumentFunctions))) + "(" + a + ")";
+	case 3:
+		return string(pick(twoArgumentsFunctions, ELEMENTS(twoArgumentsFunctions))) + "(" + a + ", "
+		       + randomExpression(depth - 1, local) + ")";
+	case 4:
+		return "(" + a + " ? " + randomExpression(depth - 1, local) + " : " + randomExpression(depth - 1, local) + ")";
+	default:
+		return "(" + a + " " + pick(binaryOperators, ELEMENTS(binaryOperators)) + " "
+		       + randomExpression(depth - 1, local) + ")";
+	}
+}
+
+static string randomProgram()
+{
+	int depth = 1 + rand() % 6;
+	if (rand() % 4) return randomExpression(depth, false);
+	return "t = " + randomExpression(depth, false) + ";\n" + randomExpression(depth, true);
+}
+
+// the inputs have zeros and integers, for the domains of the functions, and
+// large values for overflows
+static float randomInput()
+{
+	switch (rand() % 8) {
+	case 0: return 0.0f;
+	case 1: return (float) (rand() % 11 - 5);
+	case 2: return (rand() % 2 ? 1e30f : -1e30f);
+	default: return (rand() % 2001 - 1000) / 100.0f;
+	}
+}
+
+static void setUp(Formula& formula, int mathAccuracy, bool wavetables, bool controls)
+{
+	formula.setConstant("pi", M_PI);
+	formula.setConstant("e", M_E);
+	formula.setFunction("tick", tick);
+	formula.setFunction("twice", twice);
+	formula.setFunction("difference", difference);
+	for (int v = 0; v < variableCount; v++) formula.setVariable(variableNames[v], 0);
+	formula.setMathAccuracy(mathAccuracy);
+	if (wavetables) formula.setWavetableVariable("p");
+	if (controls) formula.setControlVariable("k");
+}
+
+// returns the number of mismatches
+static int check(const string& expression, int mathAccuracy, float inputs[][SAMPLES], const Options& options)
+{
+	bool wavetables = rand() % 3 == 0;
+	bool controls = rand() % 3 == 0;
+	Formula interpreter;
+	Formula jit;
+	setUp(interpreter, mathAccuracy, wavetables, controls);
+	setUp(jit, mathAccuracy, wavetables, controls);
+	interpreter.setInstructionSet(Sse2InstructionSet);
+	jit.setJitEnabled(true);
+	try {
+		interpreter.setExpression(expression);
+		jit.setExpression(expression);
+	} catch (ParserException& exception) {
+		return 0;
+	}
+
+	int mismatches = 0;
+	const char* mode = "";
+	int sample = 0;
+	float interpreterOutput[SAMPLES];
+	float jitOutput[SAMPLES];
+
+	// eval() with the variables of the samples
+	for (int i = 0; i < SAMPLES; i++) {
+		for (int v = 0; v < variableCount; v++) {
+			interpreter.setVariable(variableNames[v], inputs[v][i]);
+			jit.setVariable(variableNames[v], inputs[v][i]);
+		}
+		interpreter.clearErrors();
+		jit.clearErrors();
+		calls = 0;
+		float interpreterResult = interpreter.eval();
+		int interpreterCalls = calls;
+		calls = 0;
+		float jitResult = jit.eval();
+		if (!same(interpreterResult, jitResult) || interpreter.getErrors() != jit.getErrors() || interpreterCalls != calls) {
+			mode = "eval";
+			sample = i;
+			interpreterOutput[0] = interpreterResult;
+			jitOutput[0] = jitResult;
+			mismatches++;
+		}
+	}
+
+	// evalBlock() with blocks of 4 samples and the samples at the end
+	for (int v = 0; v < variableCount; v++) {
+		interpreter.setVariableBuffer(variableNames[v], inputs[v]);
+		jit.setVariableBuffer(variableNames[v], inputs[v]);
+	}
+	for (int c = 0; c < ELEMENTS(counts); c++) {
+		interpreter.clearErrors();
+		jit.clearErrors();
+		calls = 0;
+		int interpreterErrors = interpreter.evalBlock(interpreterOutput, counts[c]);
+		int interpreterCalls = calls;
+		calls = 0;
+		int jitErrors = jit.evalBlock(jitOutput, counts[c]);
+		bool equal = interpreterErrors == jitErrors && interpreter.getErrors() == jit.getErrors()
+		             && interpreterCalls == calls;
+		for (int i = 0; i < counts[c]; i++) {
+			if (!same(interpreterOutput[i], jitOutput[i])) {
+				equal = false;
+				sample = i;
+			}
+		}
+		if (!equal) {
+			mode = "evalBlock";
+			mismatches++;
+		}
+	}
+
+	if (mismatches > 0 && options.verbose) {
+		const char* accuracies[] = {"exact", "audio", "fast"};
+		printf("%s, %s accuracy, %s at sample %d: %.9g != %.9g\n  %s\n", mode, accuracies[mathAccuracy],
+		       wavetables ? "wavetables" : "no wavetables", sample, interpreterOutput[sample], jitOutput[sample],
+		       expression.c_str());
+	}
+	return mismatches;
+}
+
+static int test(const Options& options)
+{
+	Formula formula;
+	if (!formula.setJitEnabled(true)) {
+		printf("the JIT compiler is not available\n");
+		return 0;
+	}
+
+	float inputs[variableCount][SAMPLES];
+	int mismatches = 0;
+	for (int i = 0; i < options.count; i++) {
+		for (int v = 0; v < variableCount; v++) {
+			for (int j = 0; j < SAMPLES; j++) inputs[v][j] = randomInput();
+		}
+		string expression = randomProgram();
+		for (int mathAccuracy = ExactMathAccuracy; mathAccuracy <= FastMathAccuracy; mathAccuracy++) {
+			mismatches += check(expression, mathAccuracy, inputs, options);
+		}
+	}
+	printf("checked %d formulas, %d mismatches\n", options.count, mismatches);
+	return mismatches;
+}
+
+int main(int argc, char** argv)
+{
+	return testMain(argc, argv, "jit-test", "--formulas", 2000, false, test);
+}
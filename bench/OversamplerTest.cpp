@@ -0,0 +1,162 @@
+/**
+ *
+ * Copyright (c) 2001, Frank Bu
+ *
+ * project: Formula
+ * version: $Revision: 1.3 $ $Name:  $
+ *
+ * Test of the oversampling filters, without VCV Rack. Random signals are
+ * upsampled and decimated with the factors 2, 4 and 8, like the inputs and
+ * the output of the module. A constant must have the gain 1 through the
+ * upsampler and the decimator, a tone below the cutoff frequency must pass
+ * both with its amplitude, and the decimator must attenuate a tone above the
+ * Nyquist frequency of the original sample rate, before it is mirrored back.
+ */
+
+#include "Oversampler.h"
+#include "TestMain.h"
+
+using namespace std;
+
+// the samples at the original sample rate, the first ones are not measured
+// because of the latency of the filters
+#define SAMPLES 2048
+#define LATENCY 64
+
+// the frequencies relative to the original sample rate: the tones up to the
+// pass frequency must keep their amplitude, the tones from the stop
+// frequency to the Nyquist frequency of the oversampled rate must be removed
+#define PASS_FREQUENCY 0.25
+#define STOP_FREQUENCY 0.6
+
+struct Signal {
+	double offset;
+	double amplitude;
+	double frequency;
+	double phase;
+};
+
+// the mean and the amplitude of a sine with the rms of the rest
+struct Level {
+	double offset;
+	double amplitude;
+};
+
+static double randomValue(double min, double max)
+{
+	return min + (max - min) * rand() / RAND_MAX;
+}
+
+// the value at the time in samples of the original sample rate
+static float getValue(const Signal& signal, double time)
+{
+	return float(signal.offset + signal.amplitude * sin(2.0 * M_PI * signal.frequency * time + signal.phase));
+}
+
+static Level measure(const float* samples, int count)
+{
+	double sum = 0;
+	for (int i = 0; i < count; i++) sum += samples[i];
+	double offset = sum / count;
+	double power = 0;
+	for (int i = 0; i < count; i++) power += (samples[i] - offset) * (samples[i] - offset);
+	Level level = {offset, sqrt(2.0 * power / count)};
+	return level;
+}
+
+// upsamples the signal and decimates it again; the outputs of the upsampler
+// and of the decimator after the latency are measured
+static void upsampleAndDecimate(const Signal& signal, int factor, Level& upsampled, Level& decimated)
+{
+	Upsampler upsampler;
+	Decimator decimator;
+	upsampler.setFactor(factor);
+	decimator.setFactor(factor);
+	static float upsampledOutput[SAMPLES * MAX_OVERSAMPLING];
+	static float decimatedOutput[SAMPLES];
+	for (int i = 0; i < SAMPLES; i++) {
+		float* block = &upsampledOutput[i * factor];
+		upsampler.process(getValue(signal, i), block);
+		decimatedOutput[i] = decimator.process(block);
+	}
+	upsampled = measure(&upsampledOutput[LATENCY * factor], (SAMPLES - LATENCY) * factor);
+	decimated = measure(&decimatedOutput[LATENCY], SAMPLES - LATENCY);
+}
+
+// decimates the signal calculated at the oversampled rate, like the output
+// formula
+static Level decimate(const Signal& signal, int factor)
+{
+	Decimator decimator;
+	decimator.setFactor(factor);
+	static float output[SAMPLES];
+	float block[MAX_OVERSAMPLING];
+	for (int i = 0; i < SAMPLES; i++) {
+		for (int j = 0; j < factor; j++) block[j] = getValue(signal, i + (double) j / factor);
+		output[i] = decimator.process(block);
+	}
+	return measure(&output[LATENCY], SAMPLES - LATENCY);
+}
+
+static bool near(double value, double expected, double tolerance)
+{
+	return fabs(value - expected) <= tolerance;
+}
+
+// returns the number of mismatches
+static int check(int factor, const Options& options)
+{
+	int mismatches = 0;
+	Level upsampled;
+	Level decimated;
+
+	Signal constant = {randomValue(-10, 10), 0, 0, 0};
+	upsampleAndDecimate(constant, factor, upsampled, decimated);
+	double tolerance = 1e-4 * fabs(constant.offset) + 1e-6;
+	if (!near(upsampled.offset, constant.offset, tolerance) || !near(decimated.offset, constant.offset, tolerance)
+	        || upsampled.amplitude > tolerance || decimated.amplitude > tolerance) {
+		if (options.verbose) {
+			printf("factor %d, constant %.6g: upsampled %.6g, decimated %.6g\n", factor, constant.offset,
+			       upsampled.offset, decimated.offset);
+		}
+		mismatches++;
+	}
+
+	Signal pass = {0, randomValue(0.1, 10), randomValue(0.02, PASS_FREQUENCY), randomValue(0, 2 * M_PI)};
+	upsampleAndDecimate(pass, factor, upsampled, decimated);
+	tolerance = 0.01 * pass.amplitude;
+	if (!near(upsampled.amplitude, pass.amplitude, tolerance) || !near(decimated.amplitude, pass.amplitude, tolerance)) {
+		if (options.verbose) {
+			printf("factor %d, tone %.4g with amplitude %.6g: upsampled %.6g, decimated %.6g\n", factor,
+			       pass.frequency, pass.amplitude, upsampled.amplitude, decimated.amplitude);
+		}
+		mismatches++;
+	}
+
+	Signal stop = {0, randomValue(0.1, 10), randomValue(STOP_FREQUENCY, 0.5 * factor - 0.02), randomValue(0, 2 * M_PI)};
+	decimated = decimate(stop, factor);
+	if (decimated.amplitude > 1e-3 * stop.amplitude) {
+		if (options.verbose) {
+			printf("factor %d, tone %.4g with amplitude %.6g: decimated %.6g\n", factor, stop.frequency,
+			       stop.amplitude, decimated.amplitude);
+		}
+		mismatches++;
+	}
+	return mismatches;
+}
+
+static int test(const Options& options)
+{
+	static const int factors[] = {2, 4, 8};
+	int mismatches = 0;
+	for (int i = 0; i < options.count; i++) {
+		for (int f = 0; f < ELEMENTS(factors); f++) mismatches += check(factors[f], options);
+	}
+	printf("checked %d signals, %d mismatches\n", options.count, mismatches);
+	return mismatches;
+}
+
+int main(int argc, char** argv)
+{
+	return testMain(argc, argv, "oversampler-test", "--signals", 100, false, test);
+}
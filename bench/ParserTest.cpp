@@ -0,0 +1,123 @@
+/**
+ *
+ * Copyright (c) 2001, Frank Bu
+ *
+ * project: Formula
+ * version: $Revision: 1.3 $ $Name:  $
+ *
+ * Test of the parser, without VCV Rack. Random expressions of tokens and
+ * invalid characters are parsed by one parser, which keeps its tokens and
+ * instructions from one expression to the next, and by a new parser for every
+ * expression. The postfix, the results and the errors must be the same, the
+ * exception of setExpression() must be the same as the error of the overload
+ * without exceptions, and the position of an error must be in the expression.
+ * The syntax checks must find the errors with a position before the stack
+ * check of the program, which has none.
+ * With --print the results are written to stdout, to compare two versions of
+ * the parser with diff.
+ */
+
+#include "Parser.h"
+#include "TestMain.h"
+
+#include <string>
+
+using namespace std;
+
+static const char* variableNames[] = {"x", "y"};
+static const int variableCount = 2;
+
+static const char* fragments[] = {
+	"x", "y", "1", "2.5", ".5", "1e3", "1.", "sin", "atan2", "time", "pi", "(", ")", ",", "+", "-", "*", "/",
+	"^", "<", "<=", ">", ">=", "=", "!=", "!", "&", "|", "?", ":", ";", "[", "]", " ", "\n", "foo", "#",
+	"0x1", "e"
+};
+
+static float getTime()
+{
+	return 2.0f;
+}
+
+static void setUp(Parser& parser)
+{
+	parser.setConstant("pi", 3.14159f);
+	parser.setFunction("time", getTime);
+	for (int v = 0; v < variableCount; v++) parser.setVariable(variableNames[v], 0);
+}
+
+// the postfix and the results for some values of the variables, or the error
+static string parse(Parser& parser, const string& expression, ParserError& error)
+{
+	if (!parser.setExpression(expression, error)) {
+		char position[32];
+		snprintf(position, sizeof(position), "error at %d: ", error.position);
+		return position + error.message;
+	}
+	string result = parser.getPostfix() + " =>";
+	float values[][variableCount] = {{1.5f, -2.0f}, {0.0f, 0.25f}};
+	for (int i = 0; i < ELEMENTS(values); i++) {
+		for (int v = 0; v < variableCount; v++) *parser.getVariableAddress(variableNames[v]) = values[i][v];
+		char value[32];
+		snprintf(value, sizeof(value), " %.7g", parser.eval());
+		result += value;
+	}
+	return result;
+}
+
+// returns the number of mismatches
+static int check(Parser& parser, const string& expression, const Options& options)
+{
+	ParserError error;
+	string result = parse(parser, expression, error);
+	if (options.print) printf("%s => %s\n", expression.c_str(), result.c_str());
+
+	// the new parser doesn't get the program from the cache, because it
+	// has another constant
+	Parser newParser("");
+	setUp(newParser);
+	newParser.setConstant("new", 1);
+	ParserError newError;
+	string newResult = parse(newParser, expression, newError);
+
+	string exceptionResult = "";
+	try {
+		Parser exceptionParser("");
+		setUp(exceptionParser);
+		exceptionParser.setExpression(expression);
+	} catch (ParserException& exception) {
+		char position[32];
+		snprintf(position, sizeof(position), "error at %d: ", exception.getPosition());
+		exceptionResult = position + exception.getMessage();
+	}
+
+	// some errors, like a stack underflow, have no position
+	bool valid = error.type == NoParserError;
+	bool equal = result == newResult && exceptionResult == (valid ? "" : result)
+	             && error.position >= (error.type == SyntaxParserError ? 0 : -1)
+	             && error.position <= (int) expression.size() && error.type != StackUnderflowParserError;
+	if (!equal && options.verbose) {
+		printf("%s\n  parser:    %s\n  new:       %s\n  exception: %s\n", expression.c_str(), result.c_str(),
+		       newResult.c_str(), exceptionResult.c_str());
+	}
+	return equal ? 0 : 1;
+}
+
+static int test(const Options& options)
+{
+	Parser parser("");
+	setUp(parser);
+	int mismatches = 0;
+	for (int i = 0; i < options.count; i++) {
+		string expression;
+		int length = 1 + rand() % 8;
+		for (int j = 0; j < length; j++) expression += fragments[rand() % ELEMENTS(fragments)];
+		mismatches += check(parser, expression, options);
+	}
+	if (!options.print) printf("checked %d expressions, %d mismatches\n", options.count, mismatches);
+	return mismatches;
+}
+
+int main(int argc, char** argv)
+{
+	return testMain(argc, argv, "parser-test", "--expressions", 50000, true, test);
+}
@@ -0,0 +1,319 @@
+/**
+ *
+ * Copyright (c) 2001, Frank Bu
+ *
+ * project: Formula
+ * version: $Revision: 1.3 $ $Name:  $
+ *
+ * Test of the delays, out[n] and the stateful functions, without VCV Rack.
+ * Random formulas with them, also in conditionals and after '&' and '|', are
+ * evaluated with eval() per sample and with evalBlock() for blocks of
+ * different counts, which must give the same results and error flags. The
+ * values of x[n], delay(x, n) and out[n] are compared with a ring buffer of
+ * the inputs and the outputs, also in a branch which is not taken for every
+ * sample.
+ */
+
+#include "Formula.h"
+#include "Evaluator.h"
+#include "TestMain.h"
+
+#include <string>
+
+using namespace std;
+
+// the samples of a formula, evalBlock() calculates them in blocks with the
+// counts one after the other
+#define SAMPLES 256
+static const int counts[] = {67, 64, 1, 2, 3, 4, 7, 13};
+
+// the longest delay of the test, the reference ring buffer has one more sample
+#define DELAY 40
+
+// x is the signal, y the condition, d a delay and f a frequency
+static const char* variableNames[] = {"x", "y", "z", "d", "f"};
+static const int variableCount = 5;
+
+static const char* numbers[] = {"0", "1", "2", "0.5", "0.25", "3"};
+static const char* binaryOperators[] = {"+", "-", "*", "<", ">", "="};
+
+// the samples before, 0 at the start
+struct Ring {
+	float values[DELAY + 1];
+	int position;
+};
+
+static void clear(Ring& ring)
+{
+	for (int i = 0; i <= DELAY; i++) ring.values[i] = 0;
+	ring.position = 0;
+}
+
+static void write(Ring& ring, float value)
+{
+	ring.values[ring.position] = value;
+	ring.position = ring.position < DELAY ? ring.position + 1 : 0;
+}
+
+// the value delay samples before the last written one
+static float read(const Ring& ring, int delay)
+{
+	int index = ring.position - 1 - delay;
+	if (index < 0) index += DELAY + 1;
+	return ring.values[index];
+}
+
+static const char* pick(const char* const* names, int count)
+{
+	return names[rand() % count];
+}
+
+static string randomDelay(int min)
+{
+	char text[16];
+	sprintf(text, "%d", min + rand() % (DELAY + 1 - min));
+	return text;
+}
+
+// an argument of a stateful function without a conditional, it can be
+// another delay or stateful function
+static string randomArgument(int depth, bool local)
+{
+	if (depth == 0 || rand() % 3 == 0) {
+		switch (rand() % 6) {
+		case 0: return pick(numbers, ELEMENTS(numbers));
+		case 1: return (local ? "t[" : "x[") + randomDelay(0) + "]";
+		case 2: return "out[" + randomDelay(1) + "]";
+		case 3: return local ? "t" : "x";
+		default: return pick(variableNames, variableCount);
+		}
+	}
+	string a = randomArgument(depth - 1, local);
+	switch (rand() % 6) {
+	case 0: return "lowpass(" + a + ", f)";
+	case 1: return "integrate(" + a + ")";
+	case 2: return "delay(" + a + ", d)";
+	default:
+		return "(" + a + " " + pick(binaryOperators, ELEMENTS(binaryOperators)) + " " + randomArgument(depth - 1, local)
+		       + ")";
+	}
+}
+
+static string randomState(int depth, bool local)
+{
+	string a = randomArgument(depth, local);
+	switch (rand() % 10) {
+	case 0: return "lowpass(" + a + ", f)";
+	case 1: return "highpass(" + a + ", " + randomArgument(depth, local) + ")";
+	case 2: return "lowpass2(" + a + ", f, 0.707)";
+	case 3: return "highpass2(" + a + ", f, " + randomArgument(depth, local) + ")";
+	case 4: return "bandpass2(" + a + ", 0.1, 2)";
+	case 5: return "slew(" + a + ", 0.5)";
+	case 6: return "integrate(" + a + ")";
+	case 7: return "rise(" + a + ")";
+	case 8: return "delay(" + a + ", " + randomArgument(depth, local) + ")";
+	default: return "x[" + randomDelay(0) + "]";
+	}
+}
+
+// an expression with the stateful functions in conditionals, it can read the
+// local variable t
+static string randomExpression(int depth, bool local)
+{
+	if (depth == 0 || rand() % 4 == 0) {
+		switch (rand() % 4) {
+		case 0: return randomArgument(1, local);
+		default: return randomState(depth, local);
+		}
+	}
+	string a = randomExpression(depth - 1, local);
+	switch (rand() % 6) {
+	case 0:
+		return "(" + a + " ? " + randomExpression(depth - 1, local) + " : " + randomExpression(depth - 1, local) + ")";
+	case 1:
+		return "if(" + a + ", " + randomExpression(depth - 1, local) + ", " + randomExpression(depth - 1, local) + ")";
+	case 2:
+		return "(" + a + " & " + randomExpression(depth - 1, local) + ")";
+	case 3:
+		return "(" + a + " | " + randomExpression(depth - 1, local) + ")";
+	default:
+		return "(" + a + " " + pick(binaryOperators, ELEMENTS(binaryOperators)) + " "
+		       + randomExpression(depth - 1, local) + ")";
+	}
+}
+
+static string randomProgram()
+{
+	int depth = 1 + rand() % 4;
+	if (rand() % 3) return randomExpression(depth, false);
+	return "t = " + randomExpression(depth, false) + ";\n" + randomExpression(depth, true);
+}
+
+static void randomInputs(float inputs[][SAMPLES])
+{
+	for (int i = 0; i < SAMPLES; i++) {
+		inputs[0][i] = (rand() % 2001 - 1000) / 100.0f;
+		inputs[1][i] = rand() % 3 == 0 ? 1.0f : 0.0f;
+		inputs[2][i] = (rand() % 21 - 10) / 4.0f;
+		inputs[3][i] = (float) (rand() % (DELAY + 1));
+		inputs[4][i] = (rand() % 101) / 200.0f;
+	}
+}
+
+// calculates the samples with eval() and with evalBlock(), returns false if
+// the expression is not valid
+static bool evaluate(const string& expression, float inputs[][SAMPLES], float* evalOutput, float* blockOutput,
+                     int& evalErrors, int& blockErrors)
+{
+	Formula formula;
+	Formula block;
+	for (int v = 0; v < variableCount; v++) {
+		formula.setVariable(variableNames[v], 0);
+		block.setVariable(variableNames[v], 0);
+	}
+	try {
+		formula.setExpression(expression);
+		block.setExpression(expression);
+	} catch (ParserException& exception) {
+		return false;
+	}
+
+	for (int i = 0; i < SAMPLES; i++) {
+		for (int v = 0; v < variableCount; v++) formula.setVariable(variableNames[v], inputs[v][i]);
+		evalOutput[i] = formula.eval();
+	}
+	evalErrors = formula.getErrors();
+
+	for (int i = 0, c = 0; i < SAMPLES; c++) {
+		int count = counts[c % ELEMENTS(counts)];
+		if (count > SAMPLES - i) count = SAMPLES - i;
+		for (int v = 0; v < variableCount; v++) block.setVariableBuffer(variableNames[v], &inputs[v][i]);
+		block.evalBlock(&blockOutput[i], count);
+		i += count;
+	}
+	blockErrors = block.getErrors();
+	return true;
+}
+
+// returns the number of mismatches
+static int checkBlocks(const string& expression, float inputs[][SAMPLES], const Options& options)
+{
+	float evalOutput[SAMPLES];
+	float blockOutput[SAMPLES];
+	int evalErrors;
+	int blockErrors;
+	if (!evaluate(expression, inputs, evalOutput, blockOutput, evalErrors, blockErrors)) {
+		if (options.verbose) printf("not valid:\n  %s\n", expression.c_str());
+		return 1;
+	}
+	int sample = -1;
+	for (int i = 0; i < SAMPLES && sample < 0; i++) {
+		if (!same(evalOutput[i], blockOutput[i])) sample = i;
+	}
+	if (sample < 0 && evalErrors == blockErrors) return 0;
+	if (options.verbose) {
+		if (sample < 0) {
+			printf("errors %d != %d\n  %s\n", evalErrors, blockErrors, expression.c_str());
+		} else {
+			printf("sample %d: %.9g != %.9g\n  %s\n", sample, evalOutput[sample], blockOutput[sample],
+			       expression.c_str());
+		}
+	}
+	return 1;
+}
+
+// the formulas with the reference values of x[n], delay(x, d) and out[n]
+static const char* references[] = {
+	"x[N]",
+	"delay(x, d)",
+	"y ? x[N] : 0",
+	"if(y, delay(x, d), 0)",
+	"y ? 0 : x[N] + delay(x, d)",
+	"y & x[N]",
+	"y | delay(x, d)",
+	"t = x*2;\ny ? t[N] : 0",
+	"y ? out[M] : x",
+	"y ? (z ? x[N] : 0) : out[M]*0.5"
+};
+
+static float reference(int formula, int i, float inputs[][SAMPLES], const Ring& x, const Ring& doubled,
+                       const Ring& out, int delay, int outputDelay)
+{
+	float y = inputs[1][i];
+	float z = inputs[2][i];
+	int d = (int) inputs[3][i];
+	switch (formula) {
+	case 0: return read(x, delay);
+	case 1: return read(x, d);
+	case 2: return y ? read(x, delay) : 0;
+	case 3: return y ? read(x, d) : 0;
+	case 4: return y ? 0 : read(x, delay) + read(x, d);
+	case 5: return y && read(x, delay) ? 1 : 0;
+	case 6: return y || read(x, d) ? 1 : 0;
+	case 7: return y ? read(doubled, delay) : 0;
+	case 8: return y ? read(out, outputDelay - 1) : inputs[0][i];
+	default: return y ? (z ? read(x, delay) : 0) : read(out, outputDelay - 1) * 0.5f;
+	}
+}
+
+static string replace(string text, char name, const string& value)
+{
+	size_t position = text.find(name);
+	if (position != string::npos) text.replace(position, 1, value);
+	return text;
+}
+
+// returns the number of mismatches
+static int checkReference(int formula, float inputs[][SAMPLES], const Options& options)
+{
+	string n = randomDelay(0);
+	string m = randomDelay(1);
+	string expression = replace(replace(references[formula], 'N', n), 'M', m);
+	float evalOutput[SAMPLES];
+	float blockOutput[SAMPLES];
+	int evalErrors;
+	int blockErrors;
+	if (!evaluate(expression, inputs, evalOutput, blockOutput, evalErrors, blockErrors)) {
+		if (options.verbose) printf("not valid:\n  %s\n", expression.c_str());
+		return 1;
+	}
+
+	Ring x;
+	Ring doubled;
+	Ring out;
+	clear(x);
+	clear(doubled);
+	clear(out);
+	for (int i = 0; i < SAMPLES; i++) {
+		write(x, inputs[0][i]);
+		write(doubled, inputs[0][i] * 2);
+		float expected = reference(formula, i, inputs, x, doubled, out, atoi(n.c_str()), atoi(m.c_str()));
+		write(out, expected);
+		if (!same(evalOutput[i], expected) || !same(blockOutput[i], expected)) {
+			if (options.verbose) {
+				printf("sample %d: eval %.9g, evalBlock %.9g, expected %.9g\n  %s\n", i, evalOutput[i],
+				       blockOutput[i], expected, expression.c_str());
+			}
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static int test(const Options& options)
+{
+	float inputs[variableCount][SAMPLES];
+	int mismatches = 0;
+	for (int i = 0; i < options.count; i++) {
+		randomInputs(inputs);
+		mismatches += checkBlocks(randomProgram(), inputs, options);
+		mismatches += checkReference(i % ELEMENTS(references), inputs, options);
+	}
+	printf("checked %d formulas, %d mismatches\n", options.count, mismatches);
+	return mismatches;
+}
+
+int main(int argc, char** argv)
+{
+	return testMain(argc, argv, "state-test", "--formulas", 1000, false, test);
+}
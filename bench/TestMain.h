@@ -0,0 +1,75 @@
+/**
+ *
+ * Copyright (c) 2001, Frank Bu
+ *
+ * project: Formula
+ * version: $Revision: 1.3 $ $Name:  $
+ *
+ * The options and the main function of the tests, without VCV Rack. A test
+ * checks a count of random cases, like formulas or edits, and returns the
+ * number of mismatches. The program exits with 1 if there is a mismatch.
+ */
+
+#ifndef TEST_MAIN_H
+#define TEST_MAIN_H
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ELEMENTS(array) ((int) (sizeof(array) / sizeof(array[0])))
+
+struct Options {
+	// the count of random cases
+	int count;
+	int seed;
+	bool verbose;
+	// writes the results to stdout, for the tests with --print
+	bool print;
+};
+
+// the same bits, or both not a number
+static bool same(float a, float b)
+{
+	return memcmp(&a, &b, sizeof(a)) == 0 || (isnan(a) && isnan(b));
+}
+
+// The options of a test are "--quiet", "--seed n" and the count, like
+// "--formulas n"; "--print" only if print is set. The test runs after
+// srand() with the seed and returns the number of mismatches.
+static int testMain(int argc, char** argv, const char* name, const char* countOption, int count, bool print,
+                    int (*test)(const Options& options))
+{
+	Options options;
+	options.count = count;
+	options.seed = 1;
+	options.verbose = true;
+	options.print = false;
+	bool valid = true;
+	for (int i = 1; i < argc && valid; i++) {
+		if (strcmp(argv[i], "--quiet") == 0) {
+			options.verbose = false;
+		} else if (print && strcmp(argv[i], "--print") == 0) {
+			options.print = true;
+		} else if (i + 1 == argc) {
+			valid = false;
+		} else if (strcmp(argv[i], countOption) == 0) {
+			options.count = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--seed") == 0) {
+			options.seed = atoi(argv[++i]);
+		} else {
+			valid = false;
+		}
+	}
+	if (!valid) {
+		fprintf(stderr, "usage: %s [%s n] [--seed n] [--quiet]%s\n", name, countOption, print ? " [--print]" : "");
+		return 1;
+	}
+
+	srand(options.seed);
+	return test(options) > 0;
+}
+
+
+#endif
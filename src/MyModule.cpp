@@ -1,9 +1,42 @@
 #include "Template.hpp"
 #include "dsp/digital.hpp"
 #include "formula/Formula.h"
+#include "formula/Oversampler.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 struct FrankBussFormulaModule;
 
+// the variables of the formulas, in the order of their indices
+enum FormulaVariables {
+	P_VARIABLE,
+	K_VARIABLE,
+	B_VARIABLE,
+	W_VARIABLE,
+	X_VARIABLE,
+	Y_VARIABLE,
+	Z_VARIABLE,
+	NUM_VARIABLES
+};
+
+static const char* formulaVariableNames[NUM_VARIABLES] = {"p", "k", "b", "w", "x", "y", "z"};
+
+// The compiled formulas of a module. A program is built by the compiler thread
+// and not changed after it is handed to the engine thread, except for the
+// variables, which are only written by the engine thread.
+struct FormulaProgram {
+	Formula formula;
+	Formula freqFormula;
+	bool compiled = false;
+	bool freqFormulaEnabled = false;
+	// the output formula is evaluated at this multiple of the sample rate
+	int oversampling = 1;
+};
+
 class MyTextField : public LedDisplayTextField {
 public:
 	MyTextField() : LedDisplayTextField() {}
@@ -52,36 +85,94 @@ struct FrankBussFormulaModule : Module {
 	MyTextField* freqField;
 	float blinkPhase = 0.0f;
 
-	Formula formula;
-	Formula freqFormula;
-	bool compiled = false;
 	bool doclamp = true;
-	bool freqFormulaEnabled = false;
 	float radiobutton = 0.0f;
 	float phase = 0.0f;
+	int mathAccuracy = ExactMathAccuracy;
+	bool jitEnabled = false;
+	bool wavetablesEnabled = false;
+	int oversampling = 1;
+	// the frequency formula is evaluated every freqRate samples, the
+	// frequency is held in between
+	int freqRate = 1;
+	int freqIndex = 0;
+	float freq = 0.0f;
+	// the part of the samples of the current program which were not
+	// calculated again, because the inputs they read were not changed
+	float skipRatio = 0.0f;
+	// the profile of the formulas is collected for the next program, it is
+	// saved by saveProfile()
+	bool profilingEnabled = false;
+	int instance;
 
 	SchmittTrigger clampTrigger;
 	SchmittTrigger bMinus1Trigger;
 	SchmittTrigger b0Trigger;
 	SchmittTrigger b1Trigger;
 
-	float* formulaP = NULL;
-	float* formulaK = NULL;
-	float* formulaB = NULL;
-	float* formulaW = NULL;
-	float* formulaX = NULL;
-	float* formulaY = NULL;
-	float* formulaZ = NULL;
-
-	float* freqFormulaP = NULL;
-	float* freqFormulaK = NULL;
-	float* freqFormulaB = NULL;
-	float* freqFormulaW = NULL;
-	float* freqFormulaX = NULL;
-	float* freqFormulaY = NULL;
-	float* freqFormulaZ = NULL;
-
-	FrankBussFormulaModule() : Module(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS) {
+	// inputs and output of the output formula, evaluated in blocks
+	static const int BLOCK_SIZE = 16;
+	float variableBlocks[NUM_VARIABLES][BLOCK_SIZE * MAX_OVERSAMPLING] = {};
+	float outputBlock[BLOCK_SIZE] = {};
+	int blockIndex = 0;
+
+	// With oversampling the inputs w, x, y and z are upsampled, the output
+	// formula is evaluated at the higher rate and the output is decimated.
+	// The filters are only changed by the engine thread, with the program.
+	static const int NUM_UPSAMPLED_VARIABLES = Z_VARIABLE - W_VARIABLE + 1;
+	Upsampler upsamplers[NUM_UPSAMPLED_VARIABLES];
+	Decimator decimator;
+	float oversampledBlock[BLOCK_SIZE * MAX_OVERSAMPLING] = {};
+
+	// The program used by the engine thread. A new program is passed in
+	// pendingProgram and the old one is passed back in retiredProgram, so that
+	// the engine thread doesn't wait, allocate or free memory. The compiler
+	// thread deletes the programs with programMutex locked, so that the UI
+	// thread can read the current program.
+	std::atomic<FormulaProgram*> program;
+	std::atomic<FormulaProgram*> pendingProgram;
+	std::atomic<FormulaProgram*> retiredProgram;
+	std::mutex programMutex;
+
+	// the source of the next program, for the compiler thread
+	std::thread compilerThread;
+	std::mutex compilerMutex;
+	std::condition_variable compilerCondition;
+	bool compileRequested = false;
+	bool compilerStopped = false;
+	// a text change is compiled when the text wasn't changed for the delay
+	static const int TYPING_DELAY_MS = 250;
+	std::chrono::steady_clock::time_point compileTime;
+	std::string compileText;
+	std::string compileFreqText;
+	int compileMathAccuracy = ExactMathAccuracy;
+	bool compileJitEnabled = false;
+	bool compileWavetablesEnabled = false;
+	int compileOversampling = 1;
+	bool compileProfilingEnabled = false;
+	// Only used by the compiler thread. They parse only the lines which were
+	// changed since the last compile, the formulas of the next program get
+	// the same programs from the program cache.
+	Formula textFormula;
+	Formula freqTextFormula;
+
+	FrankBussFormulaModule() : Module(NUM_PARAMS, NUM_INPUTS, NUM_OUTPUTS, NUM_LIGHTS),
+	                           program(NULL), pendingProgram(NULL), retiredProgram(NULL) {
+		static std::atomic<int> instanceCount(0);
+		instance = ++instanceCount;
+		compilerThread = std::thread(&FrankBussFormulaModule::runCompiler, this);
+	}
+
+	~FrankBussFormulaModule() {
+		{
+			std::lock_guard<std::mutex> lock(compilerMutex);
+			compilerStopped = true;
+		}
+		compilerCondition.notify_one();
+		compilerThread.join();
+		delete program.load();
+		delete pendingProgram.exchange(NULL);
+		delete retiredProgram.exchange(NULL);
 	}
 
 	void step() override {
@@ -100,48 +191,65 @@ struct FrankBussFormulaModule : Module {
 		
 		float deltaTime = engineGetSampleTime();
 
-		// evaluate frequency and output formula
-		float val = 0;
+		// a new program is used from the start of a block
+		if (blockIndex == 0) swapProgram();
+		FormulaProgram* current = program.load();
+		bool compiled = current && current->compiled;
+
+		// evaluate frequency formula and collect the inputs of the output formula
 		if (compiled) {
-			try {
-				// get inputs
-				float w = inputs[W_INPUT].value;
-				float x = inputs[X_INPUT].value;
-				float y = inputs[Y_INPUT].value;
-				float z = inputs[Z_INPUT].value;
-				
-				// knob
-				float k = params[KNOB_PARAM].value;
-
-				// set all variables
-				*formulaP = phase;
-				*formulaK = k;
-				*formulaB = radiobutton;
-				*formulaW = w;
-				*formulaX = x;
-				*formulaY = y;
-				*formulaZ = z;
-
-				if (freqFormulaEnabled) {
-					*freqFormulaP = phase;
-					*freqFormulaK = k;
-					*freqFormulaB = radiobutton;
-					*freqFormulaW = w;
-					*freqFormulaX = x;
-					*freqFormulaY = y;
-					*freqFormulaZ = z;
-					float freq = evalFormula(freqFormula);
-					phase += freq * engineGetSampleTime();
-					if (phase > 1.0f) phase -= 1.0f;
+			// get inputs and the knob
+			float variables[NUM_VARIABLES];
+			variables[P_VARIABLE] = phase;
+			variables[K_VARIABLE] = params[KNOB_PARAM].value;
+			variables[B_VARIABLE] = radiobutton;
+			variables[W_VARIABLE] = inputs[W_INPUT].value;
+			variables[X_VARIABLE] = inputs[X_INPUT].value;
+			variables[Y_VARIABLE] = inputs[Y_INPUT].value;
+			variables[Z_VARIABLE] = inputs[Z_INPUT].value;
+
+			if (!current->freqFormulaEnabled) {
+				freq = 0.0f;
+			} else if (freqIndex == 0) {
+				current->freqFormula.setVariables(variables, NUM_VARIABLES);
+				// a math error, e.g. division by zero, gives 0 and doesn't change the phase
+				freq = evalFormula(current->freqFormula);
+			}
+			if (++freqIndex >= freqRate) freqIndex = 0;
+
+			// the output formula gets the phase before it is advanced
+			int factor = decimator.getFactor();
+			int index = blockIndex * factor;
+			for (int i = 0; i < NUM_VARIABLES; i++) {
+				for (int j = 0; j < factor; j++) variableBlocks[i][index + j] = variables[i];
+			}
+			if (factor > 1) {
+				// the phase is advanced for every oversampled sample, the knob
+				// and the buttons are the same for all of them
+				for (int j = 1; j < factor; j++) {
+					float p = phase + freq * deltaTime * j / factor;
+					if (p > 1.0f) p -= 1.0f;
+					variableBlocks[P_VARIABLE][index + j] = p;
+				}
+				// an unconnected input is constant, without the transient of the filter
+				for (int i = 0; i < NUM_UPSAMPLED_VARIABLES; i++) {
+					if (inputs[W_INPUT + i].active) {
+						upsamplers[i].process(variables[W_VARIABLE + i], &variableBlocks[W_VARIABLE + i][index]);
+					} else {
+						upsamplers[i].reset();
+					}
 				}
-				val = evalFormula(formula);
-				if (doclamp) val = clamp(val, -5.0f, 5.0f);
-			} catch (MathError&) {
-				// ignore math errors, e.g. division by zero
-			} catch (exception&) {
-				// for all other exceptions, set compiled to false, e.g. VariableNotFound
-				compiled = false;
 			}
+
+			phase += freq * deltaTime;
+			if (phase > 1.0f) phase -= 1.0f;
+		}
+
+		// the output formula is evaluated once per block, the output is delayed by one block
+		float val = outputBlock[blockIndex];
+		if (++blockIndex == BLOCK_SIZE) {
+			blockIndex = 0;
+			evalOutputBlock();
 		}
 
 		// set output
@@ -163,19 +271,76 @@ struct FrankBussFormulaModule : Module {
 		lights[B_1_LIGHT].value = (radiobutton == 1.0f);
 	}
 
-	void parseFormula(Formula& formula, string expr) {
-		formula.setVariable("pi", M_PI);
-		formula.setVariable("e", M_E);
+	// Called by the engine thread. The old program is only passed back when the
+	// compiler thread has deleted the last one.
+	void swapProgram() {
+		if (retiredProgram.load() != NULL) return;
+		FormulaProgram* next = pendingProgram.exchange(NULL);
+		if (!next) return;
+		retiredProgram.store(program.load());
+		program.store(next);
+		phase = 0;
+		freqIndex = 0;
+		for (int i = 0; i < BLOCK_SIZE; i++) outputBlock[i] = 0.0f;
+		if (next->oversampling != decimator.getFactor()) {
+			for (int i = 0; i < NUM_UPSAMPLED_VARIABLES; i++) upsamplers[i].setFactor(next->oversampling);
+			decimator.setFactor(next->oversampling);
+		}
+	}
+
+	bool parseFormula(Formula& formula, string expr, int mathAccuracy, bool jitEnabled, bool wavetablesEnabled, ParserError& error) {
+		formula.setConstant("pi", M_PI);
+		formula.setConstant("e", M_E);
 		
-		formula.setVariable("p", 0);
-		formula.setVariable("k", 0);
-		formula.setVariable("b", 0);
-		formula.setVariable("w", 0);
-		formula.setVariable("x", 0);
-		formula.setVariable("y", 0);
-		formula.setVariable("z", 0);
-
-		formula.setExpression(expr);
+		// the variables get the indices of FormulaVariables
+		for (int i = 0; i < NUM_VARIABLES; i++) formula.setVariable(formulaVariableNames[i], 0);
+
+		formula.setMathAccuracy(mathAccuracy);
+		formula.setJitEnabled(jitEnabled);
+		// the subexpressions of the phase are read from wavetables
+		formula.setWavetableVariable(wavetablesEnabled ? "p" : "");
+		// the subexpressions of the knob and the buttons are calculated only
+		// when they were changed
+		formula.setControlVariable("k");
+		formula.setControlVariable("b");
+		// the last value is used again while the inputs it reads are not changed
+		formula.setSkipUnchanged(true);
+		return formula.setExpression(expr, error);
+	}
+
+	bool compileFormula(Formula& compiler, Formula& formula, string expr, int mathAccuracy, bool jitEnabled,
+	                    bool wavetablesEnabled, ParserError& error) {
+		return parseFormula(compiler, expr, mathAccuracy, false, wavetablesEnabled, error)
+		       && parseFormula(formula, expr, mathAccuracy, jitEnabled, wavetablesEnabled, error);
+	}
+
+	void evalOutputBlock() {
+		FormulaProgram* current = program.load();
+		if (current && current->compiled) {
+			// samples with math errors are NaN, they are set to 0
+			int factor = decimator.getFactor();
+			if (factor == 1) {
+				current->formula.evalBlock(outputBlock, BLOCK_SIZE);
+			} else {
+				// before decimating, so that a NaN doesn't stay in the filter
+				current->formula.evalBlock(oversampledBlock, BLOCK_SIZE * factor);
+				for (int i = 0; i < BLOCK_SIZE * factor; i++) {
+					if (!isfinite(oversampledBlock[i])) oversampledBlock[i] = 0.0f;
+				}
+				for (int i = 0; i < BLOCK_SIZE; i++) outputBlock[i] = decimator.process(&oversampledBlock[i * factor]);
+			}
+			for (int i = 0; i < BLOCK_SIZE; i++) {
+				float val = outputBlock[i];
+				if (!isfinite(val)) val = 0.0f;
+				if (doclamp) val = clamp(val, -5.0f, 5.0f);
+				outputBlock[i] = val;
+			}
+			int64_t samples = current->formula.getSampleCount() + current->freqFormula.getSampleCount();
+			int64_t skipped = current->formula.getSkippedSampleCount() + current->freqFormula.getSkippedSampleCount();
+			skipRatio = samples > 0 ? (float) skipped / samples : 0.0f;
+		} else {
+			for (int i = 0; i < BLOCK_SIZE; i++) outputBlock[i] = 0.0f;
+		}
 	}
 
 	float evalFormula(Formula& formula) {
@@ -187,40 +352,117 @@ struct FrankBussFormulaModule : Module {
 
 	void onCreate () override
 	{
-		compiled = false;
-		phase = 0;
-		if (textField->text.size() > 0) {
-			try {
-				parseFormula(formula, textField->text);
-				freqFormulaEnabled = false;
-				if (freqField->text.size() > 0) {
-					parseFormula(freqFormula, freqField->text);
-					freqFormulaEnabled = true;
-				}
-				
-				formulaP = formula.getVariableAddress("p");
-				formulaK = formula.getVariableAddress("k");
-				formulaB = formula.getVariableAddress("b");
-				formulaW = formula.getVariableAddress("w");
-				formulaX = formula.getVariableAddress("x");
-				formulaY = formula.getVariableAddress("y");
-				formulaZ = formula.getVariableAddress("z");
-
-				if (freqFormulaEnabled) {
-					freqFormulaP = freqFormula.getVariableAddress("p");
-					freqFormulaK = freqFormula.getVariableAddress("k");
-					freqFormulaB = freqFormula.getVariableAddress("b");
-					freqFormulaW = freqFormula.getVariableAddress("w");
-					freqFormulaX = freqFormula.getVariableAddress("x");
-					freqFormulaY = freqFormula.getVariableAddress("y");
-					freqFormulaZ = freqFormula.getVariableAddress("z");
-				}
-				
-				compiled = true;
-			} catch (exception& e) {
-				printf("formula exception: %s\n", e.what());
+		requestCompile(0);
+	}
+
+	// compiles the formulas in the compiler thread, the engine thread uses
+	// the old program until the new one is ready; the delay in milliseconds
+	// is restarted by the next request
+	void requestCompile(int delay) {
+		{
+			std::lock_guard<std::mutex> lock(compilerMutex);
+			compileText = textField->text;
+			compileFreqText = freqField->text;
+			compileMathAccuracy = mathAccuracy;
+			compileJitEnabled = jitEnabled;
+			compileWavetablesEnabled = wavetablesEnabled;
+			compileOversampling = oversampling;
+			compileProfilingEnabled = profilingEnabled;
+			compileTime = std::chrono::steady_clock::now() + std::chrono::milliseconds(delay);
+			compileRequested = true;
+		}
+		compilerCondition.notify_one();
+	}
+
+	void runCompiler() {
+		std::unique_lock<std::mutex> lock(compilerMutex);
+		while (true) {
+			compilerCondition.wait(lock, [this] { return compileRequested || compilerStopped; });
+			while (!compilerStopped && std::chrono::steady_clock::now() < compileTime) {
+				compilerCondition.wait_until(lock, compileTime);
+			}
+			if (compilerStopped) break;
+			compileRequested = false;
+			string text = compileText;
+			string freqText = compileFreqText;
+			int mathAccuracy = compileMathAccuracy;
+			bool jitEnabled = compileJitEnabled;
+			bool wavetablesEnabled = compileWavetablesEnabled;
+			int oversampling = compileOversampling;
+			bool profilingEnabled = compileProfilingEnabled;
+			lock.unlock();
+
+			FormulaProgram* next = compileProgram(text, freqText, mathAccuracy, jitEnabled, wavetablesEnabled, oversampling);
+			next->formula.setProfilingEnabled(profilingEnabled);
+			next->freqFormula.setProfilingEnabled(profilingEnabled);
+			// the program passed back by the engine thread isn't used anymore,
+			// a pending program which wasn't used yet is replaced
+			{
+				std::lock_guard<std::mutex> programLock(programMutex);
+				delete retiredProgram.exchange(NULL);
+				delete pendingProgram.exchange(next);
+			}
+			lock.lock();
+		}
+	}
+
+	FormulaProgram* compileProgram(string text, string freqText, int mathAccuracy, bool jitEnabled, bool wavetablesEnabled,
+	                               int oversampling) {
+		FormulaProgram* next = new FormulaProgram();
+		next->oversampling = oversampling;
+		if (text.size() > 0) {
+			ParserError error;
+			if (!compileFormula(textFormula, next->formula, text, mathAccuracy, jitEnabled, wavetablesEnabled, error)
+			        || (freqText.size() > 0
+			            && !compileFormula(freqTextFormula, next->freqFormula, freqText, mathAccuracy, jitEnabled,
+			                               wavetablesEnabled, error))) {
+				printf("formula error at position %d: %s\n", error.position, error.message.c_str());
+				return next;
 			}
+			next->freqFormulaEnabled = freqText.size() > 0;
+
+			const float* buffers[NUM_VARIABLES];
+			for (int i = 0; i < NUM_VARIABLES; i++) buffers[i] = variableBlocks[i];
+			next->formula.setVariableBuffers(buffers, NUM_VARIABLES);
+
+			next->compiled = true;
+		}
+		return next;
+	}
+
+	// Called by the UI thread. The program used by the engine thread is not
+	// deleted while programMutex is locked, the counters of the profile may be
+	// updated while they are read. The file is written without a lock.
+	void saveProfile() {
+		string json;
+		{
+			std::lock_guard<std::mutex> lock(programMutex);
+			FormulaProgram* current = program.load();
+			if (!current || !current->compiled) return;
+			json = "{\n\t\"instance\": " + std::to_string(instance) + ",\n\t\"formula\": ";
+			json += indentJson(current->formula.getProfileJson());
+			if (current->freqFormulaEnabled) json += ",\n\t\"freqFormula\": " + indentJson(current->freqFormula.getProfileJson());
+			json += "\n}\n";
 		}
+
+		string filename = assetLocal("FormulaProfile-" + std::to_string(instance) + ".json");
+		FILE* file = fopen(filename.c_str(), "w");
+		if (!file) {
+			printf("can't write the profile to %s\n", filename.c_str());
+			return;
+		}
+		fputs(json.c_str(), file);
+		fclose(file);
+		printf("profile written to %s\n", filename.c_str());
+	}
+
+	static string indentJson(string json) {
+		string indented;
+		for (int i = 0; i < (int) json.size(); i++) {
+			indented += json[i];
+			if (json[i] == '\n') indented += '\t';
+		}
+		return indented;
 	}
 
 	void onReset () override
@@ -235,6 +477,11 @@ struct FrankBussFormulaModule : Module {
 		json_object_set_new(rootJ, "freq", json_string(freqField->text.c_str()));
 		json_object_set_new(rootJ, "clamp", json_boolean(doclamp));
 		json_object_set_new(rootJ, "button", json_real(radiobutton));
+		json_object_set_new(rootJ, "mathAccuracy", json_integer(mathAccuracy));
+		json_object_set_new(rootJ, "jit", json_boolean(jitEnabled));
+		json_object_set_new(rootJ, "wavetables", json_boolean(wavetablesEnabled));
+		json_object_set_new(rootJ, "oversampling", json_integer(oversampling));
+		json_object_set_new(rootJ, "freqRate", json_integer(freqRate));
 
 		return rootJ;
 	}
@@ -252,15 +499,87 @@ struct FrankBussFormulaModule : Module {
 		json_t *buttonJ = json_object_get(rootJ, "button");
 		if (buttonJ) radiobutton = json_real_value(buttonJ);
 
+		json_t *mathAccuracyJ = json_object_get(rootJ, "mathAccuracy");
+		if (mathAccuracyJ) mathAccuracy = json_integer_value(mathAccuracyJ);
+
+		json_t *jitJ = json_object_get(rootJ, "jit");
+		if (jitJ) jitEnabled = json_is_true(jitJ);
+
+		json_t *wavetablesJ = json_object_get(rootJ, "wavetables");
+		if (wavetablesJ) wavetablesEnabled = json_is_true(wavetablesJ);
+
+		json_t *oversamplingJ = json_object_get(rootJ, "oversampling");
+		if (oversamplingJ) oversampling = json_integer_value(oversamplingJ);
+
+		json_t *freqRateJ = json_object_get(rootJ, "freqRate");
+		if (freqRateJ) freqRate = json_integer_value(freqRateJ);
+
 		onCreate();
 	}
 
 };
 
 void MyTextField::onTextChange() {
-	module->onCreate();
+	module->requestCompile(FrankBussFormulaModule::TYPING_DELAY_MS);
 }
 
+struct MathAccuracyItem : MenuItem {
+	FrankBussFormulaModule* module;
+	int mathAccuracy;
+	void onAction(EventAction &e) override {
+		module->mathAccuracy = mathAccuracy;
+		module->onCreate();
+	}
+};
+
+struct JitItem : MenuItem {
+	FrankBussFormulaModule* module;
+	void onAction(EventAction &e) override {
+		module->jitEnabled = !module->jitEnabled;
+		module->onCreate();
+	}
+};
+
+struct WavetablesItem : MenuItem {
+	FrankBussFormulaModule* module;
+	void onAction(EventAction &e) override {
+		module->wavetablesEnabled = !module->wavetablesEnabled;
+		module->onCreate();
+	}
+};
+
+struct OversamplingItem : MenuItem {
+	FrankBussFormulaModule* module;
+	int oversampling;
+	void onAction(EventAction &e) override {
+		module->oversampling = oversampling;
+		module->onCreate();
+	}
+};
+
+struct ProfilingItem : MenuItem {
+	FrankBussFormulaModule* module;
+	void onAction(EventAction &e) override {
+		module->profilingEnabled = !module->profilingEnabled;
+		module->onCreate();
+	}
+};
+
+struct SaveProfileItem : MenuItem {
+	FrankBussFormulaModule* module;
+	void onAction(EventAction &e) override {
+		module->saveProfile();
+	}
+};
+
+struct FreqRateItem : MenuItem {
+	FrankBussFormulaModule* module;
+	int freqRate;
+	void onAction(EventAction &e) override {
+		module->freqRate = freqRate;
+	}
+};
+
 struct FrankBussFormulaWidget : ModuleWidget {
 	FrankBussFormulaWidget(FrankBussFormulaModule *module) : ModuleWidget(module) {
 
@@ -322,6 +641,74 @@ struct FrankBussFormulaWidget : ModuleWidget {
 		}
 	}
 	
+	void appendContextMenu(Menu *menu) override {
+		FrankBussFormulaModule *formulaModule = dynamic_cast<FrankBussFormulaModule*>(module);
+
+		// the approximated functions are faster, with an error of about 1e-6 or 1e-4
+		menu->addChild(MenuEntry::create());
+		menu->addChild(MenuLabel::create("Math functions"));
+		const char* names[] = {"Exact", "Audio", "Fast"};
+		int accuracies[] = {ExactMathAccuracy, AudioMathAccuracy, FastMathAccuracy};
+		for (int i = 0; i < 3; i++) {
+			MathAccuracyItem *item = MenuItem::create<MathAccuracyItem>(names[i], CHECKMARK(formulaModule->mathAccuracy == accuracies[i]));
+			item->module = formulaModule;
+			item->mathAccuracy = accuracies[i];
+			menu->addChild(item);
+		}
+
+		// compiles the formulas to machine code, if the platform is supported
+		menu->addChild(MenuEntry::create());
+		JitItem *jitItem = MenuItem::create<JitItem>("JIT compiler", CHECKMARK(formulaModule->jitEnabled));
+		jitItem->module = formulaModule;
+		menu->addChild(jitItem);
+
+		// reads the subexpressions which depend only on p from wavetables
+		WavetablesItem *wavetablesItem = MenuItem::create<WavetablesItem>("Wavetables", CHECKMARK(formulaModule->wavetablesEnabled));
+		wavetablesItem->module = formulaModule;
+		menu->addChild(wavetablesItem);
+
+		// evaluates the output formula at a multiple of the sample rate, less
+		// aliasing of nonlinear formulas for more CPU time of this module only
+		menu->addChild(MenuEntry::create());
+		menu->addChild(MenuLabel::create("Oversampling"));
+		const char* factorNames[] = {"Off", "2x", "4x", "8x"};
+		int factors[] = {1, 2, 4, 8};
+		for (int i = 0; i < 4; i++) {
+			OversamplingItem *item = MenuItem::create<OversamplingItem>(factorNames[i], CHECKMARK(formulaModule->oversampling == factors[i]));
+			item->module = formulaModule;
+			item->oversampling = factors[i];
+			menu->addChild(item);
+		}
+
+		// the frequency formula at a control rate, for a slowly changing
+		// frequency, the phase is still advanced every sample
+		menu->addChild(MenuEntry::create());
+		menu->addChild(MenuLabel::create("Frequency formula"));
+		const char* rateNames[] = {"Every sample", "Every 16 samples", "Every 64 samples"};
+		int rates[] = {1, 16, 64};
+		for (int i = 0; i < 3; i++) {
+			FreqRateItem *item = MenuItem::create<FreqRateItem>(rateNames[i], CHECKMARK(formulaModule->freqRate == rates[i]));
+			item->module = formulaModule;
+			item->freqRate = rates[i];
+			menu->addChild(item);
+		}
+
+		// the evaluations which were skipped, because the inputs didn't change
+		menu->addChild(MenuEntry::create());
+		menu->addChild(MenuLabel::create(stringf("Skipped evaluations: %d%%", (int) (formulaModule->skipRatio * 100.0f + 0.5f))));
+
+		// the time of the formulas and of their operators and functions, saved
+		// as JSON in the user directory of Rack
+		ProfilingItem *profilingItem = MenuItem::create<ProfilingItem>("Profiling", CHECKMARK(formulaModule->profilingEnabled));
+		profilingItem->module = formulaModule;
+		menu->addChild(profilingItem);
+		if (formulaModule->profilingEnabled) {
+			SaveProfileItem *saveProfileItem = MenuItem::create<SaveProfileItem>("Save profile");
+			saveProfileItem->module = formulaModule;
+			menu->addChild(saveProfileItem);
+		}
+	}
+
 	MyTextField* textField;
 	MyTextField* freqField;
 };
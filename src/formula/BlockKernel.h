@@ -0,0 +1,36 @@
+/**
+ *
+ * Copyright (c) 2001, Frank Bu
+ *
+ * project: Formula
+ * version: $Revision: 1.3 $ $Name:  $
+ *
+ * Block kernels, running a program over a chunk of samples.
+ */
+
+#ifndef BLOCKKERNEL_H
+#define BLOCKKERNEL_H
+
+#include "Evaluator.h"
+
+// A BlockKernel runs the program for count samples, starting at offset in
+// the variable buffers. The stack and the temporaries have one row of
+// EVALUATOR_BLOCK_SIZE values per element, variables and buffers have the
+// value and the bound buffer (or NULL) of every variable of the evaluator.
+// The conditionals need 2 * n + 1 rows for n nested conditionals, they are
+// NULL if the program has none. The state is the state block of the
+// evaluator, see Program::stateSize.
+// Samples with a math error are set to NaN in the output, the number of them is
+// returned. The profile has an entry per instruction, it is only used by
+// the profiled kernels.
+
+// every kernel gives the same results, the getters return NULL if the
+// instruction set was not enabled at compile time; a profiled kernel adds the
+// runs and ticks of every instruction to the profile of the instructions
+BlockKernel getScalarBlockKernel(bool profiled);
+BlockKernel getSse2BlockKernel(bool profiled);
+BlockKernel getAvx2BlockKernel(bool profiled);
+BlockKernel getAvx512BlockKernel(bool profiled);
+
+
+#endif
@@ -0,0 +1,30 @@
+/**
+ *
+ * Copyright (c) 2001, Frank Bu
+ *
+ * project: Formula
+ * version: $Revision: 1.3 $ $Name:  $
+ *
+ * Block kernel for AVX2, processing 8 samples per instruction.
+ * The Makefile compiles this file with -mavx2.
+ */
+
+#include "BlockKernelTemplate.h"
+
+
+// MinGW doesn't align the stack for AVX values, so it is disabled on Windows
+#if defined(__AVX2__) && !defined(_WIN32)
+
+BlockKernel getAvx2BlockKernel(bool profiled)
+{
+	return profiled ? runBlockKernel<Avx2Lanes, true> : runBlockKernel<Avx2Lanes, false>;
+}
+
+#else
+
+BlockKernel getAvx2BlockKernel(bool /*profiled*/)
+{
+	return NULL;
+}
+
+#endif
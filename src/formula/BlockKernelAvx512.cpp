@@ -0,0 +1,30 @@
+/**
+ *
+ * Copyright (c) 2001, Frank Bu
+ *
+ * project: Formula
+ * version: $Revision: 1.3 $ $Name:  $
+ *
+ * Block kernel for AVX-512, processing 16 samples per instruction.
+ * The Makefile compiles this file with -mavx512f.
+ */
+
+#include "BlockKernelTemplate.h"
+
+
+// MinGW doesn't align the stack for AVX values, so it is disabled on Windows
+#if defined(__AVX512F__) && !defined(_WIN32)
+
+BlockKernel getAvx512BlockKernel(bool profiled)
+{
+	return profiled ? runBlockKernel<Avx512Lanes, true> : runBlockKernel<Avx512Lanes, false>;
+}
+
+#else
+
+BlockKernel getAvx512BlockKernel(bool /*profiled*/)
+{
+	return NULL;
+}
+
+#endif
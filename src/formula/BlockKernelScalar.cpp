@@ -0,0 +1,17 @@
+/**
+ *
+ * Copyright (c) 2001, Frank Bu
+ *
+ * project: Formula
+ * version: $Revision: 1.3 $ $Name:  $
+ *
+ * Block kernel without SIMD instructions, used if no other kernel is available.
+ */
+
+#include "BlockKernelTemplate.h"
+
+
+BlockKernel getScalarBlockKernel(bool profiled)
+{
+	return profiled ? runBlockKernel<ScalarLanes, true> : runBlockKernel<ScalarLanes, false>;
+}
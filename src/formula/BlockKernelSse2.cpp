@@ -0,0 +1,28 @@
+/**
+ *
+ * Copyright (c) 2001, Frank Bu
+ *
+ * project: Formula
+ * version: $Revision: 1.3 $ $Name:  $
+ *
+ * Block kernel for SSE2, processing 4 samples per instruction.
+ */
+
+#include "BlockKernelTemplate.h"
+
+
+#if defined(__SSE2__)
+
+BlockKernel getSse2BlockKernel(bool profiled)
+{
+	return profiled ? runBlockKernel<Sse2Lanes, true> : runBlockKernel<Sse2Lanes, false>;
+}
+
+#else
+
+BlockKernel getSse2BlockKernel(bool /*profiled*/)
+{
+	return NULL;
+}
+
+#endif
@@ -0,0 +1,349 @@
+/**
+ *
+ * Copyright (c) 2001, Frank Bu
+ *
+ * project: Formula
+ * version: $Revision: 1.3 $ $Name:  $
+ *
+ * The block kernel, compiled for each instruction set by the BlockKernel*.cpp
+ * files with the Lanes class of the instruction set.
+ */
+
+#ifndef BLOCKKERNELTEMPLATE_H
+#define BLOCKKERNELTEMPLATE_H
+
+#include "BlockKernel.h"
+#include "FastMath.h"
+
+#include <math.h>
+
+namespace {
+
+// Non-finite values are detected where they could vanish: at the operands of
+// divisions (x/inf = 0), comparisons, boolean operators, functions and
+// conditions, and at the result. All other operators give a non-finite result
+// for a non-finite operand, so every sample which is a math error in eval() is
+// found. In a branch of a conditional only the samples which take the branch
+// are checked, active is NULL outside of conditionals.
+template<typename Lanes>
+inline void checkRow(typename Lanes::Mask* errors, const float* active, const float* row, int lanes)
+{
+	for (int i = 0; i < lanes; i += Lanes::Count) {
+		typename Lanes::Mask nonFinite = Lanes::isNonFinite(Lanes::load(row + i));
+		if (active) nonFinite = Lanes::andMask(nonFinite, Lanes::isTrue(Lanes::load(active + i)));
+		errors[i / Lanes::Count] = Lanes::orMask(errors[i / Lanes::Count], nonFinite);
+	}
+}
+
+// Sets the row to the samples of the parent row, where the condition row is
+// true, or false if negate is set. The rows of the samples are 1 or 0. Returns
+// false if there is no such sample.
+template<typename Lanes>
+inline bool selectRow(float* row, const float* parent, const float* condition, bool negate, int lanes)
+{
+	typename Lanes::Mask any = Lanes::noMask();
+	for (int i = 0; i < lanes; i += Lanes::Count) {
+		typename Lanes::Mask mask = Lanes::isTrue(Lanes::load(condition + i));
+		if (negate) mask = Lanes::notMask(mask);
+		mask = Lanes::andMask(mask, Lanes::isTrue(Lanes::load(parent + i)));
+		Lanes::store(row + i, Lanes::select(mask));
+		any = Lanes::orMask(any, mask);
+	}
+	return Lanes::getBits(any) != 0;
+}
+
+// Calculates the approximated built-in functions for all lanes with SIMD
+// instructions, returns false for the exact and all other functions.
+template<typename Lanes>
+inline bool calculateMathRow(const Instruction& instruction, float* row, const float* exponents, int lanes)
+{
+	if (instruction.mathFunction == NoMathFunction) return false;
+	switch (instruction.mathAccuracy) {
+	case AudioMathAccuracy:
+		FastMath<Lanes, AudioMathAccuracy>::calculateRow(instruction.mathFunction, row, exponents, lanes);
+		return true;
+	case FastMathAccuracy:
+		FastMath<Lanes, FastMathAccuracy>::calculateRow(instruction.mathFunction, row, exponents, lanes);
+		return true;
+	}
+	return false;
+}
+
+// the profiled kernel counts the runs and the ticks of every instruction
+template<typename Lanes, bool profiled>
+int runBlockKernel(const Instruction* program, int size, const float* variables,
+                   const float* const* buffers, int offset, int count, float* stack,
+                   float* temporaries, float* conditions, float* state, float* output,
+                   InstructionProfile* profile)
+{
+	typedef typename Lanes::Value Value;
+	typedef typename Lanes::Mask Mask;
+
+	// all rows are calculated up to a multiple of the lane count
+	const int lanes = (count + Lanes::Count - 1) / Lanes::Count * Lanes::Count;
+	Mask errors[EVALUATOR_BLOCK_SIZE / Lanes::Count];
+	for (int i = 0; i < lanes / Lanes::Count; i++) errors[i] = Lanes::noMask();
+
+	// The first row of the conditionals has the samples of the block. Every
+	// nesting level has a row with the samples which take the then branch and
+	// a row with the samples which run the current branch, active points to it.
+	// A branch is skipped if no sample takes it, otherwise the results of both
+	// branches are blended at the Join.
+	int level = 0;
+	const float* active = NULL;
+	if (conditions) {
+		for (int i = 0; i < lanes; i++) conditions[i] = i < count ? 1.0f : 0.0f;
+	}
+
+	// top points to the row of the top stack element
+	float* top = stack - EVALUATOR_BLOCK_SIZE;
+	for (int pc = 0; pc < size; pc++) {
+		const Instruction& instruction = program[pc];
+		float* second = top - EVALUATOR_BLOCK_SIZE;
+		InstructionProfile* current = profiled ? &profile[pc] : NULL;
+		int64_t ticks = profiled ? readProfileTicks() : 0;
+		switch (instruction.opcode) {
+		case NumberOpcode: {
+			top += EVALUATOR_BLOCK_SIZE;
+			Value value = Lanes::set(instruction.value);
+			for (int i = 0; i < lanes; i += Lanes::Count) Lanes::store(top + i, value);
+			break;
+		}
+		case VariableOpcode: {
+			top += EVALUATOR_BLOCK_SIZE;
+			const float* values = buffers[instruction.variable];
+			if (values) {
+				// don't read after the end of the buffer
+				for (int i = 0; i < count; i++) top[i] = values[offset + i];
+				for (int i = count; i < lanes; i++) top[i] = 0.0f;
+			} else {
+				Value value = Lanes::set(variables[instruction.variable]);
+				for (int i = 0; i < lanes; i += Lanes::Count) Lanes::store(top + i, value);
+			}
+			break;
+		}
+		case AddOpcode:
+			for (int i = 0; i < lanes; i += Lanes::Count) {
+				Lanes::store(second + i, Lanes::add(Lanes::load(second + i), Lanes::load(top + i)));
+			}
+			top = second;
+			break;
+		case SubOpcode:
+			for (int i = 0; i < lanes; i += Lanes::Count) {
+				Lanes::store(second + i, Lanes::sub(Lanes::load(second + i), Lanes::load(top + i)));
+			}
+			top = second;
+			break;
+		case MulOpcode:
+			for (int i = 0; i < lanes; i += Lanes::Count) {
+				Lanes::store(second + i, Lanes::mul(Lanes::load(second + i), Lanes::load(top + i)));
+			}
+			top = second;
+			break;
+		case DivOpcode:
+			checkRow<Lanes>(errors, active, top, lanes);
+			for (int i = 0; i < lanes; i += Lanes::Count) {
+				Lanes::store(second + i, Lanes::div(Lanes::load(second + i), Lanes::load(top + i)));
+			}
+			top = second;
+			break;
+		case PowerOpcode:
+			checkRow<Lanes>(errors, active, second, lanes);
+			checkRow<Lanes>(errors, active, top, lanes);
+			if (!calculateMathRow<Lanes>(instruction, second, top, lanes)) {
+				for (int i = 0; i < lanes; i++) second[i] = powf(second[i], top[i]);
+			}
+			top = second;
+			break;
+		case NegOpcode:
+			for (int i = 0; i < lanes; i += Lanes::Count) {
+				Lanes::store(top + i, Lanes::neg(Lanes::load(top + i)));
+			}
+			break;
+		case LessOpcode:
+		case GreaterOpcode:
+		case LessEqualOpcode:
+		case GreaterEqualOpcode:
+		case EqualOpcode:
+		case NotEqualOpcode:
+		case AndOpcode:
+		case OrOpcode:
+			checkRow<Lanes>(errors, active, second, lanes);
+			checkRow<Lanes>(errors, active, top, lanes);
+			for (int i = 0; i < lanes; i += Lanes::Count) {
+				Value op1 = Lanes::load(second + i);
+				Value op2 = Lanes::load(top + i);
+				Mask result;
+				switch (instruction.opcode) {
+				case LessOpcode: result = Lanes::less(op1, op2); break;
+				case GreaterOpcode: result = Lanes::greater(op1, op2); break;
+				case LessEqualOpcode: result = Lanes::lessEqual(op1, op2); break;
+				case GreaterEqualOpcode: result = Lanes::greaterEqual(op1, op2); break;
+				case EqualOpcode: result = Lanes::equal(op1, op2); break;
+				case NotEqualOpcode: result = Lanes::notEqual(op1, op2); break;
+				case AndOpcode: result = Lanes::andMask(Lanes::isTrue(op1), Lanes::isTrue(op2)); break;
+				default: result = Lanes::orMask(Lanes::isTrue(op1), Lanes::isTrue(op2)); break;
+				}
+				Lanes::store(second + i, Lanes::select(result));
+			}
+			top = second;
+			break;
+		case NotOpcode:
+			checkRow<Lanes>(errors, active, top, lanes);
+			for (int i = 0; i < lanes; i += Lanes::Count) {
+				Lanes::store(top + i, Lanes::select(Lanes::notMask(Lanes::isTrue(Lanes::load(top + i)))));
+			}
+			break;
+		case NoArgumentFunctionOpcode:
+			// functions are called for the samples of the branch only, they may
+			// count the calls
+			top += EVALUATOR_BLOCK_SIZE;
+			for (int i = 0; i < count; i++) top[i] = !active || active[i] ? instruction.noArgumentFunction() : 0.0f;
+			for (int i = count; i < lanes; i++) top[i] = 0.0f;
+			break;
+		case OneArgumentFunctionOpcode:
+			checkRow<Lanes>(errors, active, top, lanes);
+			if (!calculateMathRow<Lanes>(instruction, top, top, lanes)) {
+				for (int i = 0; i < count; i++) {
+					if (!active || active[i]) top[i] = instruction.oneArgumentFunction(top[i]);
+				}
+			}
+			break;
+		case TwoArgumentsFunctionOpcode:
+			checkRow<Lanes>(errors, active, second, lanes);
+			checkRow<Lanes>(errors, active, top, lanes);
+			if (!calculateMathRow<Lanes>(instruction, second, top, lanes)) {
+				for (int i = 0; i < count; i++) {
+					if (!active || active[i]) second[i] = instruction.twoArgumentsFunction(second[i], top[i]);
+				}
+			}
+			top = second;
+			break;
+		case WavetableOpcode:
+			checkRow<Lanes>(errors, active, top, lanes);
+			for (int i = 0; i < lanes; i++) top[i] = instruction.wavetable->read(top[i]);
+			break;
+		// The instructions with a state calculate one sample after the other.
+		// Their operands are calculated for all samples before, with the SIMD
+		// instructions. The optimizer moves them out of the conditionals, in
+		// the branch of another program only for the samples of the branch.
+		case DelayOpcode: {
+			checkRow<Lanes>(errors, active, second, lanes);
+			checkRow<Lanes>(errors, active, top, lanes);
+			float* ring = state + instruction.state;
+			for (int i = 0; i < count; i++) {
+				if (!active || active[i]) second[i] = delaySample(ring, instruction.ring.length, second[i], top[i]);
+			}
+			top = second;
+			break;
+		}
+		case OutputOpcode: {
+			// the results of the samples before the chunk, see Evaluator::writeOutputs()
+			top += EVALUATOR_BLOCK_SIZE;
+			const float* ring = state + instruction.state;
+			for (int i = 0; i < count; i++) top[i] = readDelayed(ring, instruction.ring.length, instruction.ring.delay, i);
+			for (int i = count; i < lanes; i++) top[i] = 0.0f;
+			break;
+		}
+		case StatefulFunctionOpcode: {
+			const StatefulFunction* function = instruction.statefulFunction;
+			float* first = top - (function->argumentCount - 1) * EVALUATOR_BLOCK_SIZE;
+			for (int j = 0; j < function->argumentCount; j++) {
+				checkRow<Lanes>(errors, active, first + j * EVALUATOR_BLOCK_SIZE, lanes);
+			}
+			float* functionState = state + instruction.state;
+			float arguments[STATEFUL_MAX_ARGUMENTS];
+			for (int i = 0; i < count; i++) {
+				if (active && !active[i]) continue;
+				for (int j = 0; j < function->argumentCount; j++) arguments[j] = first[j * EVALUATOR_BLOCK_SIZE + i];
+				first[i] = function->function(functionState, arguments);
+			}
+			top = first;
+			break;
+		}
+		case StoreOpcode: {
+			float* row = temporaries + instruction.temporary * EVALUATOR_BLOCK_SIZE;
+			for (int i = 0; i < lanes; i += Lanes::Count) Lanes::store(row + i, Lanes::load(top + i));
+			break;
+		}
+		case LoadOpcode: {
+			top += EVALUATOR_BLOCK_SIZE;
+			const float* row = temporaries + instruction.temporary * EVALUATOR_BLOCK_SIZE;
+			for (int i = 0; i < lanes; i += Lanes::Count) Lanes::store(top + i, Lanes::load(row + i));
+			break;
+		}
+		case PopOpcode:
+			checkRow<Lanes>(errors, active, top, lanes);
+			top = second;
+			break;
+		case JumpIfFalseOpcode: {
+			checkRow<Lanes>(errors, active, top, lanes);
+			const float* parent = conditions + 2 * level * EVALUATOR_BLOCK_SIZE;
+			level++;
+			float* thenSamples = conditions + (2 * level - 1) * EVALUATOR_BLOCK_SIZE;
+			float* current = conditions + 2 * level * EVALUATOR_BLOCK_SIZE;
+			if (selectRow<Lanes>(thenSamples, parent, top, false, lanes)) {
+				for (int i = 0; i < lanes; i++) current[i] = thenSamples[i];
+			} else {
+				for (int i = 0; i < lanes; i++) current[i] = parent[i];
+				pc += instruction.jump - 1;
+			}
+			active = current;
+			top = second;
+			break;
+		}
+		case JumpOpcode: {
+			// the end of the then branch, the else branch runs for the other samples
+			const float* parent = conditions + 2 * (level - 1) * EVALUATOR_BLOCK_SIZE;
+			const float* thenSamples = conditions + (2 * level - 1) * EVALUATOR_BLOCK_SIZE;
+			float* current = conditions + 2 * level * EVALUATOR_BLOCK_SIZE;
+			if (!selectRow<Lanes>(current, parent, thenSamples, true, lanes)) {
+				level--;
+				active = level > 0 ? parent : NULL;
+				pc += instruction.jump - 1;
+			}
+			break;
+		}
+		case JoinOpcode: {
+			// the end of the else branch, the then branch ran if it has samples
+			const float* thenSamples = conditions + (2 * level - 1) * EVALUATOR_BLOCK_SIZE;
+			int bits = 0;
+			for (int i = 0; i < lanes; i += Lanes::Count) bits |= Lanes::getBits(Lanes::isTrue(Lanes::load(thenSamples + i)));
+			if (bits) {
+				for (int i = 0; i < lanes; i += Lanes::Count) {
+					Mask mask = Lanes::isTrue(Lanes::load(thenSamples + i));
+					Lanes::store(second + i, Lanes::blend(mask, Lanes::load(second + i), Lanes::load(top + i)));
+				}
+				top = second;
+			}
+			level--;
+			active = level > 0 ? conditions + 2 * level * EVALUATOR_BLOCK_SIZE : NULL;
+			break;
+		}
+		}
+		if (profiled) {
+			current->count++;
+			current->ticks += readProfileTicks() - ticks;
+		}
+	}
+	checkRow<Lanes>(errors, active, top, lanes);
+
+	int errorCount = 0;
+	for (int i = 0; i < lanes; i += Lanes::Count) {
+		int bits = Lanes::getBits(errors[i / Lanes::Count]);
+		for (int j = 0; j < Lanes::Count && i + j < count; j++) {
+			if (bits & (1 << j)) {
+				output[i + j] = NAN;
+				errorCount++;
+			} else {
+				output[i + j] = top[i + j];
+			}
+		}
+	}
+	return errorCount;
+}
+
+}
+
+
+#endif
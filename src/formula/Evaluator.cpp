@@ -5,257 +5,955 @@
  * project: Formula
  * version: $Revision: 1.3 $ $Name:  $
  *
- * Evaluator class and all Action classes.
+ * Evaluator class, a stack machine running the compiled program.
  */
 
 #include "Evaluator.h"
+#include "Optimizer.h"
+#include "BlockKernel.h"
+#include "JitCompiler.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
 
 using namespace std;
 
-float NumberStack::top()
+
+static bool isInstructionSetSupported(int instructionSet)
 {
-	if (size() == 0) throw StackUnderflow();
-	return m_values[m_size - 1];
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	switch (instructionSet) {
+	case Sse2InstructionSet: return __builtin_cpu_supports("sse2");
+	case Avx2InstructionSet: return __builtin_cpu_supports("avx2");
+	case Avx512InstructionSet: return __builtin_cpu_supports("avx512f");
+	}
+#endif
+	return instructionSet == ScalarInstructionSet;
 }
 
-float NumberStack::pop()
+static BlockKernel getBlockKernel(int instructionSet, bool profiled)
 {
-	if (size() == 0) throw StackUnderflow();
-	return m_values[--m_size];
+	if (!isInstructionSetSupported(instructionSet)) return NULL;
+	switch (instructionSet) {
+	case Sse2InstructionSet: return getSse2BlockKernel(profiled);
+	case Avx2InstructionSet: return getAvx2BlockKernel(profiled);
+	case Avx512InstructionSet: return getAvx512BlockKernel(profiled);
+	}
+	return getScalarBlockKernel(profiled);
 }
 
-void NumberStack::push(float value)
+Evaluator::Evaluator() : m_program(new Program()), m_programShared(false),
+                         m_linked(false), m_linkedProgram(NULL), m_variables(NULL), m_variableCapacity(0),
+                         m_alignedBlockStack(NULL), m_blockTemporaries(NULL), m_blockConditions(NULL),
+                         m_mathAccuracy(ExactMathAccuracy), m_skipUnchanged(false), m_pure(false),
+                         m_lastValid(false), m_lastResult(0), m_sampleCount(0), m_skippedSampleCount(0),
+                         m_profilingEnabled(false), m_errors(0), m_jitEnabled(false)
 {
-	m_size++;
-	if (m_size > m_values.size()) {
-		m_values.push_back(value);
-	} else {
-		m_values[m_size - 1] = value;
-	}
+	m_jit = new JitCompiler();
+	// use the widest SIMD instructions of the CPU
+	m_instructionSet = Avx512InstructionSet;
+	while (!setInstructionSet(m_instructionSet)) m_instructionSet--;
 }
 
 
-void Action::checkTopStackElement(NumberStack& numberStack)
+Evaluator::~Evaluator()
 {
-	if (!isfinite(numberStack.top()) || isnan(numberStack.top())) throw MathError();
+	delete m_jit;
 }
 
-
-NumberAction::NumberAction(string value)
+// returns the program for a change, a shared program is copied before
+Program& Evaluator::changeProgram()
 {
-	m_value = atof(value.c_str());
+	if (m_programShared) {
+		m_program = make_shared<Program>(*m_program);
+		m_programShared = false;
+	}
+	m_linked = false;
+	m_program->stackDepth = -1;
+	return *m_program;
+}
+
+void Evaluator::addInstruction(Opcode opcode)
+{
+	Instruction instruction;
+	instruction.opcode = opcode;
+	instruction.mathFunction = NoMathFunction;
+	instruction.mathAccuracy = m_mathAccuracy;
+	// the operators have no side effects
+	instruction.pure = true;
+	instruction.state = 0;
+	instruction.variable = 0;
+	if (opcode == PowerOpcode) {
+		// the operator uses the pow function of the accuracy
+		instruction.mathFunction = PowMathFunction;
+		instruction.twoArgumentsFunction = getTwoArgumentsMathFunction(PowMathFunction, m_mathAccuracy);
+	}
+	changeProgram().instructions.push_back(instruction);
 }
 
-void NumberAction::run(NumberStack& numberStack)
+void Evaluator::addNumber(float value)
 {
-	numberStack.push(m_value);
-	checkTopStackElement(numberStack);
+	addInstruction(NumberOpcode);
+	m_program->instructions.back().value = value;
 }
 
+void Evaluator::addVariable(string name)
+{
+	// the address is resolved by link(), because the variable may be set after the expression
+	addInstruction(VariableOpcode);
+	vector<string>& names = m_program->variableNames;
+	int variable = 0;
+	while (variable < (int) names.size() && names[variable] != name) variable++;
+	if (variable == (int) names.size()) names.push_back(name);
+	m_program->instructions.back().variable = variable;
+}
 
+void Evaluator::addTemporary(Opcode opcode, int temporary)
+{
+	addInstruction(opcode);
+	m_program->instructions.back().temporary = temporary;
+	if (temporary >= m_program->temporaryCount) m_program->temporaryCount = temporary + 1;
+}
 
-void MulAction::run(NumberStack& numberStack)
+void Evaluator::addFunction(NoArgumentFunction function, bool pure)
 {
-	float op2 = numberStack.pop();
-	float op1 = numberStack.pop();
-	numberStack.push(op1 * op2);
-	checkTopStackElement(numberStack);
+	addInstruction(NoArgumentFunctionOpcode);
+	m_program->instructions.back().noArgumentFunction = function;
+	m_program->instructions.back().pure = pure;
+}
+
+void Evaluator::addFunction(OneArgumentFunction function, int mathFunction, bool pure)
+{
+	addInstruction(OneArgumentFunctionOpcode);
+	m_program->instructions.back().oneArgumentFunction = function;
+	m_program->instructions.back().mathFunction = mathFunction;
+	m_program->instructions.back().pure = pure;
+}
+
+void Evaluator::addFunction(TwoArgumentsFunction function, int mathFunction, bool pure)
+{
+	addInstruction(TwoArgumentsFunctionOpcode);
+	m_program->instructions.back().twoArgumentsFunction = function;
+	m_program->instructions.back().mathFunction = mathFunction;
+	m_program->instructions.back().pure = pure;
+}
+
+void Evaluator::addFunction(const StatefulFunction* function)
+{
+	addInstruction(StatefulFunctionOpcode);
+	m_program->instructions.back().statefulFunction = function;
+	m_program->instructions.back().pure = false;
+}
+
+void Evaluator::addDelay(int length)
+{
+	addInstruction(DelayOpcode);
+	m_program->instructions.back().ring.length = length;
+	m_program->instructions.back().pure = false;
+}
+
+void Evaluator::addOutput(int delay)
+{
+	addInstruction(OutputOpcode);
+	m_program->instructions.back().ring.length = 0;
+	m_program->instructions.back().ring.delay = delay;
+	// the result is different for every sample
+	m_program->instructions.back().pure = false;
+}
+
+// an open conditional of the program, for verify()
+struct Conditional
+{
+	// the stack depth before the conditional
+	int depth;
+	// the start of the else branch, in the else branch the end
+	int target;
+	bool inElse;
+};
+
+// Checks that every instruction has its operands on the stack and that the
+// instructions leave one value, and raises the maximum depths to the depths of
+// the instructions. The states must be in the state block of the size.
+static void verifyInstructions(const vector<Instruction>& instructions, int temporaryCount, int stateSize,
+                               int& maxDepth, int& maxBlockDepth, int& maxNesting)
+{
+	int size = instructions.size();
+	int depth = 0;
+	// the branches of a conditional must have one value more than before it,
+	// and the jumps must go forward to the else branch or the end of it
+	vector<Conditional> conditionals;
+	// evalBlock() keeps the value of the then branch on the stack until the Join
+	int elseBranches = 0;
+	for (int i = 0; i < size; i++) {
+		const Instruction& instruction = instructions[i];
+		switch (instruction.opcode) {
+		case NumberOpcode:
+		case NoArgumentFunctionOpcode:
+		case VariableOpcode:
+			depth++;
+			break;
+		case LoadOpcode:
+			if (instruction.temporary < 0 || instruction.temporary >= temporaryCount) throw StackUnderflow();
+			depth++;
+			break;
+		case NegOpcode:
+		case NotOpcode:
+		case OneArgumentFunctionOpcode:
+		case WavetableOpcode:
+			if (depth < 1) throw StackUnderflow();
+			break;
+		case StoreOpcode:
+			if (depth < 1 || instruction.temporary < 0 || instruction.temporary >= temporaryCount) throw StackUnderflow();
+			break;
+		case PopOpcode:
+			// the statements are not in a conditional
+			if (depth < 1 || conditionals.size() > 0) throw StackUnderflow();
+			depth--;
+			break;
+		case DelayOpcode:
+			if (depth < 2 || instruction.ring.length < 1 || instruction.state < 0
+			        || instruction.state + 1 + instruction.ring.length > stateSize) {
+				throw StackUnderflow();
+			}
+			depth--;
+			break;
+		case OutputOpcode:
+			if (instruction.ring.delay < 1 || instruction.ring.delay >= instruction.ring.length || instruction.state < 0
+			        || instruction.state + 1 + instruction.ring.length > stateSize) {
+				throw StackUnderflow();
+			}
+			depth++;
+			break;
+		case StatefulFunctionOpcode: {
+			int argumentCount = instruction.statefulFunction->argumentCount;
+			if (argumentCount < 1 || argumentCount > STATEFUL_MAX_ARGUMENTS || depth < argumentCount || instruction.state < 0
+			        || instruction.state + instruction.statefulFunction->stateSize > stateSize) {
+				throw StackUnderflow();
+			}
+			depth -= argumentCount - 1;
+			break;
+		}
+		case JumpIfFalseOpcode: {
+			if (depth < 1 || instruction.jump < 2 || instruction.jump > size - i) throw StackUnderflow();
+			depth--;
+			Conditional conditional = {depth, i + instruction.jump, false};
+			conditionals.push_back(conditional);
+			if ((int) conditionals.size() > maxNesting) maxNesting = conditionals.size();
+			break;
+		}
+		case JumpOpcode: {
+			if (conditionals.empty()) throw StackUnderflow();
+			Conditional& conditional = conditionals.back();
+			if (conditional.inElse || conditional.target != i + 1 || depth != conditional.depth + 1
+			        || instruction.jump < 2 || instruction.jump > size - i) {
+				throw StackUnderflow();
+			}
+			conditional.target = i + instruction.jump;
+			conditional.inElse = true;
+			depth--;
+			elseBranches++;
+			break;
+		}
+		case JoinOpcode:
+			if (conditionals.empty() || !conditionals.back().inElse || conditionals.back().target != i + 1
+			        || depth != conditionals.back().depth + 1) {
+				throw StackUnderflow();
+			}
+			conditionals.pop_back();
+			elseBranches--;
+			break;
+		default:
+			if (depth < 2) throw StackUnderflow();
+			depth--;
+		}
+		if (depth > maxDepth) maxDepth = depth;
+		if (depth + elseBranches > maxBlockDepth) maxBlockDepth = depth + elseBranches;
+	}
+	if (conditionals.size() > 0 || (size > 0 && depth != 1)) throw StackUnderflow();
+}
+
+// Verifies the program and the control values and sets the stack depths of
+// the program. The evaluation has no checks, the stacks are allocated with
+// these depths.
+void Evaluator::verify(Program& program)
+{
+	allocateStates(program);
+	int maxDepth = 0;
+	int maxBlockDepth = 0;
+	int maxNesting = 0;
+	verifyInstructions(program.instructions, program.temporaryCount, program.stateSize, maxDepth, maxBlockDepth,
+	                   maxNesting);
+	for (int i = 0; i < (int) program.controlValues.size(); i++) {
+		const ControlValue& control = program.controlValues[i];
+		if (control.instructions.empty() || control.variable < 0 || control.variable >= (int) program.variableNames.size()) {
+			throw StackUnderflow();
+		}
+		verifyInstructions(control.instructions, 0, 0, maxDepth, maxBlockDepth, maxNesting);
+	}
+	program.stackDepth = maxDepth;
+	program.blockStackDepth = maxBlockDepth;
+	program.conditionalNesting = maxNesting;
+}
+
+// Sets the part of the state block of every instruction with a state. The ring
+// buffer of a delay has the length which the parser or the optimizer set for a
+// constant delay, otherwise the longest delay. The OutputOpcodes share one ring
+// buffer, after the others.
+void Evaluator::allocateStates(Program& program)
+{
+	vector<Instruction>& instructions = program.instructions;
+	int size = 0;
+	program.outputLength = 0;
+	program.outputDelay = 0;
+	for (int i = 0; i < (int) instructions.size(); i++) {
+		Instruction& instruction = instructions[i];
+		switch (instruction.opcode) {
+		case DelayOpcode: {
+			int length = instruction.ring.length > 0 ? instruction.ring.length : MAX_DELAY + 1;
+			instruction.state = size;
+			instruction.ring.length = length;
+			size += 1 + length;
+			break;
+		}
+		case OutputOpcode: {
+			int delay = instruction.ring.delay;
+			if (delay >= program.outputLength) program.outputLength = delay + 1;
+			if (program.outputDelay == 0 || delay < program.outputDelay) program.outputDelay = delay;
+			break;
+		}
+		case StatefulFunctionOpcode:
+			instruction.state = size;
+			size += instruction.statefulFunction->stateSize;
+			break;
+		}
+	}
+	program.outputState = size;
+	if (program.outputLength > 0) {
+		for (int i = 0; i < (int) instructions.size(); i++) {
+			if (instructions[i].opcode == OutputOpcode) {
+				instructions[i].state = size;
+				instructions[i].ring.length = program.outputLength;
+			}
+		}
+		size += 1 + program.outputLength;
+	}
+	program.stateSize = size;
 }
 
+void Evaluator::link()
+{
+	if (m_program->stackDepth < 0) verify(changeProgram());
+	const Program& program = *m_program;
+	// the hidden variables of the control values are added by the first link
+	for (int i = 0; i < (int) program.controlValues.size(); i++) {
+		const string& name = program.variableNames[program.controlValues[i].variable];
+		if (m_variableIndices.find(name) == m_variableIndices.end()) setVariable(name, 0.0f);
+	}
+	// the variables of the program are replaced by the indices of the variables
+	// of the evaluator, the instructions are only copied if they are different
+	const vector<string>& names = program.variableNames;
+	vector<int> indices(names.size());
+	bool remapped = false;
+	for (int i = 0; i < (int) names.size(); i++) {
+		indices[i] = getVariableIndex(names[i]);
+		if (indices[i] != i) remapped = true;
+	}
+	if (remapped) {
+		m_remappedProgram = program;
+		remapVariables(m_remappedProgram.instructions, indices);
+		for (int i = 0; i < (int) m_remappedProgram.controlValues.size(); i++) {
+			ControlValue& control = m_remappedProgram.controlValues[i];
+			remapVariables(control.instructions, indices);
+			control.variable = indices[control.variable];
+		}
+		m_linkedProgram = &m_remappedProgram;
+	} else {
+		m_remappedProgram = Program();
+		m_linkedProgram = m_program.get();
+	}
 
-void DivAction::run(NumberStack& numberStack)
+	// the variables which are read by the control values, with NaN as the
+	// last value, so that they are calculated by the first evaluation; a
+	// control value can read the earlier control values, which are no inputs
+	m_controlInputs.clear();
+	m_controlInputValues.assign(m_variableNames.size(), NAN);
+	vector<bool> isInput(m_variableNames.size());
+	for (int i = 0; i < (int) m_linkedProgram->controlValues.size(); i++) {
+		isInput[m_linkedProgram->controlValues[i].variable] = true;
+	}
+	for (int i = 0; i < (int) m_linkedProgram->controlValues.size(); i++) {
+		const vector<Instruction>& instructions = m_linkedProgram->controlValues[i].instructions;
+		for (int j = 0; j < (int) instructions.size(); j++) {
+			if (instructions[j].opcode == VariableOpcode && !isInput[instructions[j].variable]) {
+				isInput[instructions[j].variable] = true;
+				m_controlInputs.push_back(instructions[j].variable);
+			}
+		}
+	}
+
+	// the variables which are read by the program, the hidden variables
+	// depend only on the inputs of the control values
+	m_readVariables = m_controlInputs;
+	m_pure = true;
+	const vector<Instruction>& instructions = m_linkedProgram->instructions;
+	for (int i = 0; i < (int) instructions.size(); i++) {
+		if (!instructions[i].pure) m_pure = false;
+		if (instructions[i].opcode == VariableOpcode && !isInput[instructions[i].variable]) {
+			isInput[instructions[i].variable] = true;
+			m_readVariables.push_back(instructions[i].variable);
+		}
+	}
+	for (int i = 0; i < (int) m_linkedProgram->controlValues.size(); i++) {
+		const vector<Instruction>& control = m_linkedProgram->controlValues[i].instructions;
+		for (int j = 0; j < (int) control.size(); j++) {
+			if (!control[j].pure) m_pure = false;
+		}
+	}
+	m_lastValues.resize(m_readVariables.size());
+	m_lastValid = false;
+	m_profile.instructions.resize(m_linkedProgram->instructions.size());
+	m_profile.clear();
+
+	m_stack.resize(program.stackDepth);
+	int temporaryCount = program.temporaryCount;
+	m_temporaries.resize(temporaryCount);
+	// the rows are aligned to 64 bytes for the SIMD instructions, the rows of
+	// the temporaries and the conditionals follow the stack; the conditionals
+	// have one row for the samples of the block and two rows per nesting level
+	int nesting = program.conditionalNesting;
+	int conditionRows = nesting > 0 ? 2 * nesting + 1 : 0;
+	m_blockStack.resize((program.blockStackDepth + temporaryCount + conditionRows) * EVALUATOR_BLOCK_SIZE + 16);
+	m_alignedBlockStack = (float*) (((uintptr_t) m_blockStack.data() + 63) & ~(uintptr_t) 63);
+	m_blockTemporaries = m_alignedBlockStack + program.blockStackDepth * EVALUATOR_BLOCK_SIZE;
+	m_blockConditions = nesting > 0 ? m_blockTemporaries + temporaryCount * EVALUATOR_BLOCK_SIZE : NULL;
+	m_state.resize(program.stateSize);
+	resetState();
+	m_linked = true;
+	linkBuffers();
+}
+
+void Evaluator::remapVariables(vector<Instruction>& instructions, const vector<int>& indices)
+{
+	for (int i = 0; i < (int) instructions.size(); i++) {
+		if (instructions[i].opcode == VariableOpcode) {
+			instructions[i].variable = indices[instructions[i].variable];
+		}
+	}
+}
+
+// Calculates the control values again if one of the variables they read was
+// changed. In evalBlock() a variable with a buffer has the value of the first
+// sample of the block.
+void Evaluator::updateControlValues(bool block)
 {
-	float op2 = numberStack.pop();
-	float op1 = numberStack.pop();
-	if (op2 == 0.0f) {
-		throw MathError();
+	bool changed = false;
+	for (int i = 0; i < (int) m_controlInputs.size(); i++) {
+		int variable = m_controlInputs[i];
+		const float* buffer = block ? m_variableBuffers[variable] : NULL;
+		float value = buffer ? buffer[0] : m_variables[variable];
+		// NaN is always a change
+		if (!(value == m_controlInputValues[variable])) changed = true;
+		m_controlInputValues[variable] = value;
+	}
+	if (!changed) return;
+	const vector<ControlValue>& controlValues = m_linkedProgram->controlValues;
+	for (int i = 0; i < (int) controlValues.size(); i++) {
+		const vector<Instruction>& instructions = controlValues[i].instructions;
+		uint32_t nonFinite = 0;
+		float value = run<false>(instructions.data(), instructions.data() + instructions.size(), m_controlInputValues.data(), nonFinite);
+		// a math error of the calculation is an error of every use of the value
+		if (nonFinite) value = NAN;
+		m_variables[controlValues[i].variable] = value;
+		m_controlInputValues[controlValues[i].variable] = value;
 	}
-	numberStack.push(op1 / op2);
-	checkTopStackElement(numberStack);
 }
 
+float Evaluator::eval()
+{
+	if (m_program->instructions.size() == 0) return 0;
+	if (!m_linked) {
+		m_errors |= NotLinkedEvalError;
+		return NAN;
+	}
+	if (!m_profilingEnabled) return evalSample();
+	int64_t skipped = m_skippedSampleCount;
+	int64_t start = readProfileTicks();
+	float result = evalSample();
+	m_profile.ticks += readProfileTicks() - start;
+	m_profile.evalCount++;
+	m_profile.sampleCount++;
+	m_profile.skippedSampleCount += m_skippedSampleCount - skipped;
+	if (!isfinite(result)) m_profile.mathErrorCount++;
+	return result;
+}
+
+float Evaluator::evalSample()
+{
+	m_sampleCount++;
+	if (m_skipUnchanged && m_pure && isUnchanged(0)) {
+		m_skippedSampleCount++;
+		// the math error of the last evaluation is an error again
+		if (!isfinite(m_lastResult)) m_errors |= MathEvalError;
+		return m_lastResult;
+	}
+	m_lastResult = evalProgram();
+	writeOutputs(&m_lastResult, 1);
+	return m_lastResult;
+}
 
-void AddAction::run(NumberStack& numberStack)
+float Evaluator::evalProgram()
 {
-	float op2 = numberStack.pop();
-	float op1 = numberStack.pop();
-	numberStack.push(op1 + op2);
-	checkTopStackElement(numberStack);
+	if (m_controlInputs.size() > 0) updateControlValues(false);
+	if (m_jit->isCompiled()) {
+		float result;
+		if (m_jit->eval(&result)) {
+			m_errors |= MathEvalError;
+			return NAN;
+		}
+		return result;
+	}
+
+	// Every non-finite intermediate result is a math error. The check is
+	// collected without a branch and evaluated once after the program.
+	uint32_t nonFinite = 0;
+	const vector<Instruction>& instructions = m_linkedProgram->instructions;
+	float result;
+	if (m_profilingEnabled) {
+		result = run<true>(instructions.data(), instructions.data() + instructions.size(), m_variables, nonFinite);
+	} else {
+		result = run<false>(instructions.data(), instructions.data() + instructions.size(), m_variables, nonFinite);
+	}
+	if (nonFinite) {
+		m_errors |= MathEvalError;
+		return NAN;
+	}
+	return result;
+}
+
+// The interpreter of eval() and of the control values, returns the top of the
+// stack; nonFinite is set if an intermediate result is not finite. If profiled,
+// the instructions are those of the program, and the ticks of an instruction
+// are counted until the next one starts.
+template<bool profiled>
+inline float Evaluator::run(const Instruction* instruction, const Instruction* end, const float* variables,
+                            uint32_t& nonFinite)
+{
+	// sp points to the element after the top of the stack
+	float* sp = m_stack.data();
+	float* temporaries = m_temporaries.data();
+	const Instruction* start = instruction;
+	InstructionProfile* current = NULL;
+	int64_t ticks = 0;
+	for (; instruction != end; instruction++) {
+		if (profiled) {
+			int64_t now = readProfileTicks();
+			if (current) current->ticks += now - ticks;
+			current = &m_profile.instructions[instruction - start];
+			current->count++;
+			ticks = now;
+		}
+		switch (instruction->opcode) {
+		case NumberOpcode:
+			*sp++ = instruction->value;
+			break;
+		case VariableOpcode:
+			*sp++ = variables[instruction->variable];
+			break;
+		case AddOpcode:
+			sp--;
+			sp[-1] = sp[-1] + sp[0];
+			break;
+		case SubOpcode:
+			sp--;
+			sp[-1] = sp[-1] - sp[0];
+			break;
+		case MulOpcode:
+			sp--;
+			sp[-1] = sp[-1] * sp[0];
+			break;
+		case DivOpcode:
+			sp--;
+			sp[-1] = sp[-1] / sp[0];
+			break;
+		case PowerOpcode:
+			sp--;
+			sp[-1] = instruction->twoArgumentsFunction(sp[-1], sp[0]);
+			break;
+		case NegOpcode:
+			sp[-1] = -sp[-1];
+			break;
+		case LessOpcode:
+			sp--;
+			sp[-1] = sp[-1] < sp[0];
+			break;
+		case GreaterOpcode:
+			sp--;
+			sp[-1] = sp[-1] > sp[0];
+			break;
+		case LessEqualOpcode:
+			sp--;
+			sp[-1] = sp[-1] <= sp[0];
+			break;
+		case GreaterEqualOpcode:
+			sp--;
+			sp[-1] = sp[-1] >= sp[0];
+			break;
+		case EqualOpcode:
+			sp--;
+			sp[-1] = sp[-1] == sp[0];
+			break;
+		case NotEqualOpcode:
+			sp--;
+			sp[-1] = sp[-1] != sp[0];
+			break;
+		case AndOpcode:
+			sp--;
+			sp[-1] = sp[-1] && sp[0];
+			break;
+		case OrOpcode:
+			sp--;
+			sp[-1] = sp[-1] || sp[0];
+			break;
+		case NotOpcode:
+			sp[-1] = !sp[-1];
+			break;
+		case NoArgumentFunctionOpcode:
+			*sp++ = instruction->noArgumentFunction();
+			break;
+		case OneArgumentFunctionOpcode:
+			sp[-1] = instruction->oneArgumentFunction(sp[-1]);
+			break;
+		case TwoArgumentsFunctionOpcode:
+			sp--;
+			sp[-1] = instruction->twoArgumentsFunction(sp[-1], sp[0]);
+			break;
+		case StoreOpcode:
+			temporaries[instruction->temporary] = sp[-1];
+			break;
+		case LoadOpcode:
+			*sp++ = temporaries[instruction->temporary];
+			break;
+		case PopOpcode:
+			// the value was checked when it was calculated
+			sp--;
+			continue;
+		// the condition was checked when it was pushed, and the value of a
+		// branch when it was calculated
+		case JumpIfFalseOpcode:
+			if (*--sp == 0) instruction += instruction->jump - 1;
+			continue;
+		case JumpOpcode:
+			instruction += instruction->jump - 1;
+			continue;
+		case JoinOpcode:
+			continue;
+		case WavetableOpcode:
+			sp[-1] = instruction->wavetable->read(sp[-1]);
+			break;
+		case DelayOpcode:
+			sp--;
+			sp[-1] = delaySample(&m_state[instruction->state], instruction->ring.length, sp[-1], sp[0]);
+			break;
+		case OutputOpcode:
+			*sp++ = readDelayed(&m_state[instruction->state], instruction->ring.length, instruction->ring.delay, 0);
+			break;
+		case StatefulFunctionOpcode:
+			// the arguments are in the order of the stack
+			sp -= instruction->statefulFunction->argumentCount - 1;
+			sp[-1] = instruction->statefulFunction->function(&m_state[instruction->state], sp - 1);
+			break;
+		}
+		uint32_t bits;
+		memcpy(&bits, &sp[-1], sizeof(bits));
+		nonFinite |= (bits & 0x7f800000) == 0x7f800000;
+	}
+	if (profiled && current) current->ticks += readProfileTicks() - ticks;
+	return sp[-1];
 }
 
-void LessAction::run(NumberStack& numberStack)
+void Evaluator::linkBuffers()
 {
-	float op2 = numberStack.pop();
-	float op1 = numberStack.pop();
-	numberStack.push(op1 < op2);
-	checkTopStackElement(numberStack);
+	// the machine code has the addresses of the variables and buffers; if the
+	// program can't be compiled, the interpreter is used
+	if (m_jitEnabled) {
+		m_jit->compile(*m_linkedProgram, m_variables, m_variableBuffers.data());
+	} else {
+		m_jit->clear();
+	}
 }
 
-void GreaterAction::run(NumberStack& numberStack)
+int Evaluator::evalBlock(float* output, int count)
 {
-	float op2 = numberStack.pop();
-	float op1 = numberStack.pop();
-	numberStack.push(op1 > op2);
-	checkTopStackElement(numberStack);
+	if (m_program->instructions.size() == 0) {
+		for (int i = 0; i < count; i++) output[i] = 0;
+		return 0;
+	}
+	if (!m_linked) {
+		for (int i = 0; i < count; i++) output[i] = NAN;
+		m_errors |= NotLinkedEvalError;
+		return count;
+	}
+	if (count <= 0) return 0;
+	if (!m_profilingEnabled) return evalSamples(output, count);
+	int64_t skipped = m_skippedSampleCount;
+	int64_t start = readProfileTicks();
+	int errors = evalSamples(output, count);
+	m_profile.ticks += readProfileTicks() - start;
+	m_profile.blockCount++;
+	m_profile.sampleCount += count;
+	m_profile.skippedSampleCount += m_skippedSampleCount - skipped;
+	m_profile.mathErrorCount += errors;
+	return errors;
+}
+
+int Evaluator::evalSamples(float* output, int count)
+{
+	m_sampleCount += count;
+	if (m_skipUnchanged && m_pure && isUnchanged(count)) {
+		m_skippedSampleCount += count;
+		for (int i = 0; i < count; i++) output[i] = m_lastResult;
+		if (isfinite(m_lastResult)) return 0;
+		m_errors |= MathEvalError;
+		return count;
+	}
+	if (m_controlInputs.size() > 0) updateControlValues(true);
+
+	int errors = 0;
+	if (m_jit->isCompiled()) {
+		errors = m_jit->evalBlock(output, count);
+	} else {
+		// the results of a chunk are read by the OutputOpcodes of the next one,
+		// so a chunk is at most as long as their shortest delay
+		const Program& program = *m_linkedProgram;
+		int chunkSize = EVALUATOR_BLOCK_SIZE;
+		if (program.outputLength > 0 && program.outputDelay < chunkSize) chunkSize = program.outputDelay;
+		BlockKernel kernel = m_profilingEnabled ? m_profiledBlockKernel : m_blockKernel;
+		for (int offset = 0; offset < count; offset += chunkSize) {
+			int chunk = count - offset;
+			if (chunk > chunkSize) chunk = chunkSize;
+			errors += kernel(program.instructions.data(), program.instructions.size(),
+			                        m_variables, m_variableBuffers.data(),
+			                        offset, chunk, m_alignedBlockStack, m_blockTemporaries, m_blockConditions,
+			                        m_state.data(), output + offset, m_profile.instructions.data());
+			writeOutputs(output + offset, chunk);
+		}
+	}
+	if (errors) m_errors |= MathEvalError;
+	// the result of the last sample is used by isUnchanged()
+	m_lastResult = output[count - 1];
+	return errors;
+}
+
+// Writes the results to the ring buffer of the OutputOpcodes, a math error is
+// written as 0, so that the next samples are not errors as well.
+void Evaluator::writeOutputs(const float* outputs, int count)
+{
+	const Program& program = *m_linkedProgram;
+	if (program.outputLength == 0) return;
+	float* ring = &m_state[program.outputState];
+	int position = ring[0];
+	for (int i = 0; i < count; i++) {
+		ring[1 + position] = isfinite(outputs[i]) ? outputs[i] : 0.0f;
+		if (++position == program.outputLength) position = 0;
+	}
+	ring[0] = position;
 }
 
-void LessEqualAction::run(NumberStack& numberStack)
+void Evaluator::resetState()
 {
-	float op2 = numberStack.pop();
-	float op1 = numberStack.pop();
-	numberStack.push(op1 <= op2);
-	checkTopStackElement(numberStack);
+	for (int i = 0; i < (int) m_state.size(); i++) m_state[i] = 0;
 }
 
-void GreaterEqualAction::run(NumberStack& numberStack)
+// Returns true if the variables read by the program have the same bits as at
+// the last evaluation, for all samples of the buffers if count is not 0.
+// Otherwise they are stored for the next call; they can be used by it only if
+// they were the same for all samples.
+bool Evaluator::isUnchanged(int count)
 {
-	float op2 = numberStack.pop();
-	float op1 = numberStack.pop();
-	numberStack.push(op1 >= op2);
-	checkTopStackElement(numberStack);
+	bool unchanged = m_lastValid;
+	bool uniform = true;
+	for (int i = 0; i < (int) m_readVariables.size(); i++) {
+		int variable = m_readVariables[i];
+		const float* buffer = count > 0 ? m_variableBuffers[variable] : NULL;
+		uint32_t bits;
+		memcpy(&bits, buffer ? buffer : m_variables + variable, sizeof(bits));
+		if (bits != m_lastValues[i]) {
+			m_lastValues[i] = bits;
+			unchanged = false;
+		}
+		// every sample is compared to the next one
+		if (buffer && memcmp(buffer, buffer + 1, (count - 1) * sizeof(float)) != 0) uniform = false;
+	}
+	m_lastValid = uniform;
+	return unchanged && uniform;
 }
 
-void EqualAction::run(NumberStack& numberStack)
+bool Evaluator::setInstructionSet(int instructionSet)
 {
-	float op2 = numberStack.pop();
-	float op1 = numberStack.pop();
-	numberStack.push(op1 == op2);
-	checkTopStackElement(numberStack);
+	BlockKernel kernel = getBlockKernel(instructionSet, false);
+	if (!kernel) return false;
+	m_blockKernel = kernel;
+	m_profiledBlockKernel = getBlockKernel(instructionSet, true);
+	m_instructionSet = instructionSet;
+	return true;
 }
 
-void NotEqualAction::run(NumberStack& numberStack)
+bool Evaluator::setJitEnabled(bool enabled)
 {
-	float op2 = numberStack.pop();
-	float op1 = numberStack.pop();
-	numberStack.push(op1 != op2);
-	checkTopStackElement(numberStack);
+	if (enabled && !JitCompiler::isAvailable()) return false;
+	m_jitEnabled = enabled;
+	if (m_linked) linkBuffers();
+	return true;
 }
 
-void AndAction::run(NumberStack& numberStack)
+void Evaluator::setProfilingEnabled(bool enabled)
 {
-	float op2 = numberStack.pop();
-	float op1 = numberStack.pop();
-	numberStack.push(op1 && op2);
-	checkTopStackElement(numberStack);
+	m_profilingEnabled = enabled;
+	m_profile.clear();
 }
 
-void OrAction::run(NumberStack& numberStack)
+// the names of the opcodes in the profile, like in the postfix notation
+const char* Evaluator::getOpcodeName(int opcode)
 {
-	float op2 = numberStack.pop();
-	float op1 = numberStack.pop();
-	numberStack.push(op1 || op2);
-	checkTopStackElement(numberStack);
+	static const char* names[] = {
+		"number", "variable", "+", "-", "*", "/", "^", "neg", "<", ">", "<=", ">=", "==", "!=", "&", "|", "!",
+		"function0", "function1", "function2", "store", "load", "pop", "jumpIfFalse", "jump", "join", "wavetable", "delay", "output", "stateful"
+	};
+	if (opcode < 0 || opcode > StatefulFunctionOpcode) return "?";
+	return names[opcode];
 }
 
-void NotAction::run(NumberStack& numberStack)
+void Evaluator::removeAllInstructions()
 {
-	numberStack.push(!numberStack.pop());
-	checkTopStackElement(numberStack);
+	m_program = make_shared<Program>();
+	m_programShared = false;
+	m_linked = false;
 }
 
-void SubAction::run(NumberStack& numberStack)
+void Evaluator::reserveInstructions(int count)
 {
-	float op2 = numberStack.pop();
-	float op1 = numberStack.pop();
-	numberStack.push(op1 - op2);
-	checkTopStackElement(numberStack);
+	changeProgram().instructions.reserve(count);
 }
 
-void NegAction::run(NumberStack& numberStack)
+void Evaluator::setJumpTarget(int index, int target)
 {
-	numberStack.push(-numberStack.pop());
-	checkTopStackElement(numberStack);
+	Instruction& instruction = changeProgram().instructions[index];
+	instruction.jump = target - index;
 }
 
-void PowerAction::run(NumberStack& numberStack)
+void Evaluator::addInstructions(const Program& program, int start, int end, int variableCount)
 {
-	float op2 = numberStack.pop();
-	float op1 = numberStack.pop();
-	numberStack.push(pow(op1, op2));
-	checkTopStackElement(numberStack);
+	Program& target = changeProgram();
+	target.instructions.insert(target.instructions.end(), program.instructions.begin() + start, program.instructions.begin() + end);
+	target.variableNames.assign(program.variableNames.begin(), program.variableNames.begin() + variableCount);
+	if (program.temporaryCount > target.temporaryCount) target.temporaryCount = program.temporaryCount;
 }
 
-Evaluator::~Evaluator()
+void Evaluator::optimize()
 {
-	deleteActions();
-	for (auto it = m_variables.begin(); it != m_variables.end(); it++) {
-		delete it->second;
+	Optimizer optimizer;
+	Program& program = changeProgram();
+	vector<bool> control(program.variableNames.size());
+	for (int i = 0; i < (int) program.variableNames.size(); i++) {
+		if (program.variableNames[i] == m_wavetableVariable) optimizer.setWavetableVariable(i);
+		control[i] = m_controlVariables.count(program.variableNames[i]) > 0;
+	}
+	optimizer.setControlVariables(control);
+	program.instructions = optimizer.optimize(program.instructions);
+	program.temporaryCount = optimizer.getTemporaryCount();
+	program.wavetables = optimizer.getWavetables();
+	// the hidden variables of the control values follow the variables, their
+	// names can't be used in an expression
+	program.controlValues = optimizer.getControlValues();
+	for (int i = 0; i < (int) program.controlValues.size(); i++) {
+		char name[16];
+		snprintf(name, sizeof(name), "#%d", i);
+		program.variableNames.push_back(name);
 	}
 }
 
-void Evaluator::addAction(Action* action)
+shared_ptr<const Program> Evaluator::getProgram()
 {
-	m_actions.push_back(action);
+	m_programShared = true;
+	return m_program;
 }
 
-float Evaluator::eval()
+void Evaluator::setPostfix(string postfix)
 {
-	if (m_actions.size() == 0) return 0;
-	m_numberStack.clear();
-	for (int i = 0; i < (int) m_actions.size(); i++) m_actions[i]->run(m_numberStack);
-	return m_numberStack.pop();
+	changeProgram().postfix = postfix;
 }
 
-void Evaluator::removeAllActions()
+void Evaluator::setProgram(shared_ptr<const Program> program)
 {
-	deleteActions();
-	m_actions.clear();
+	// the program is not changed, it is copied by changeProgram()
+	m_program = const_pointer_cast<Program>(program);
+	m_programShared = true;
+	m_linked = false;
 }
 
 void Evaluator::setVariable(string name, float value)
 {
-	auto i = m_variables.find(name);
-	if (i == m_variables.end()) {
-		m_variables[name] = new float;
+	auto i = m_variableIndices.find(name);
+	if (i != m_variableIndices.end()) {
+		m_variables[i->second] = value;
+		return;
 	}
-	*getVariableAddress(name) = value;
+	int index = m_variableNames.size();
+	if (index == m_variableCapacity) growVariables();
+	m_variableNames.push_back(name);
+	m_variableIndices[name] = index;
+	m_variableBuffers.push_back(NULL);
+	m_variables[index] = value;
 }
 
-float Evaluator::getVariable(string name)
+// The capacity is doubled, starting with a cache line. The machine code has
+// the addresses of the variables, so it is compiled again.
+void Evaluator::growVariables()
 {
-	return *getVariableAddress(name);
+	int capacity = m_variableCapacity ? 2 * m_variableCapacity : 16;
+	vector<float> storage(capacity + 16);
+	float* variables = (float*) (((uintptr_t) storage.data() + 63) & ~(uintptr_t) 63);
+	for (int i = 0; i < (int) m_variableNames.size(); i++) variables[i] = m_variables[i];
+	m_variableStorage.swap(storage);
+	m_variables = variables;
+	m_variableCapacity = capacity;
+	if (m_linked) linkBuffers();
 }
 
-float* Evaluator::getVariableAddress(string name)
+float Evaluator::getVariable(string name)
 {
-	auto i = m_variables.find(name);
-	if (i != m_variables.end()) {
-		return i->second;
-	} else {
-		throw VariableNotFound(name);
-	}
+	return m_variables[getVariableIndex(name)];
 }
 
-void Evaluator::deleteActions()
+void Evaluator::setVariables(const float* values, int count)
 {
-	for (int i = 0; i < (int) m_actions.size(); i++) delete m_actions[i];
+	memcpy(m_variables, values, count * sizeof(float));
 }
 
-
-void VariableAction::run(NumberStack& numberStack)
+void Evaluator::setVariableBuffer(string name, const float* values)
 {
-	if (!m_variableAddress) m_variableAddress = m_evaluator->getVariableAddress(m_name);
-	numberStack.push(*m_variableAddress);
-	checkTopStackElement(numberStack);
+	m_variableBuffers[getVariableIndex(name)] = values;
+	if (m_linked && m_jitEnabled) linkBuffers();
 }
 
-
-void NoArgumentFunctionAction::run(NumberStack& numberStack)
+void Evaluator::setVariableBuffers(const float* const* buffers, int count)
 {
-	numberStack.push(m_function());
-	checkTopStackElement(numberStack);
+	for (int i = 0; i < count; i++) m_variableBuffers[i] = buffers[i];
+	if (m_linked && m_jitEnabled) linkBuffers();
 }
 
-void OneArgumentFunctionAction::run(NumberStack& numberStack)
+float* Evaluator::getVariableAddress(string name)
 {
-	numberStack.push(m_function(numberStack.pop()));
-	checkTopStackElement(numberStack);
+	return m_variables + getVariableIndex(name);
 }
 
-void TwoArgumentsFunctionAction::run(NumberStack& numberStack)
+int Evaluator::getVariableIndex(string name)
 {
-	float op2 = numberStack.pop();
-	float op1 = numberStack.pop();
-	numberStack.push(m_function(op1, op2));
-	checkTopStackElement(numberStack);
+	auto i = m_variableIndices.find(name);
+	if (i != m_variableIndices.end()) {
+		return i->second;
+	} else {
+		throw VariableNotFound(name);
+	}
 }
@@ -5,7 +5,7 @@
  * project: Formula
  * version: $Revision: 1.3 $ $Name:  $
  *
- * Evaluator class and all Action classes.
+ * Evaluator class, a stack machine running the compiled program.
  */
 
 #ifndef EVALUATOR_H
@@ -14,212 +14,391 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <set>
+#include <memory>
 #include <math.h>
 #include <float.h>
+#include <stdint.h>
 
 #include "Exception.h"
-#include "Exception.h"
+#include "MathFunctions.h"
+#include "StatefulFunctions.h"
+#include "Wavetable.h"
+#include "Profile.h"
 
 using namespace std;
 
-typedef float(*NoArgumentFunction)();
-typedef float(*OneArgumentFunction)(float);
-typedef float(*TwoArgumentsFunction)(float, float);
-
-class NumberStack : public vector<float>
-{
-public:
-	NumberStack() : m_size(0) {}
-	float top();
-	float pop();
-	void push(float value);
-	size_t size() { return m_size; }
-private:
-	vector<float> m_values;
-	size_t m_size;
-};
-
-
-class Action
-{
-public:
-	virtual ~Action() {};
-	virtual void run(NumberStack& numberStack) = 0;
-protected:
-	void checkTopStackElement(NumberStack& numberStack);
-};
-
-
-class NumberAction : public Action
-{
-public:
-	NumberAction(float value) : m_value(value) {}
-	NumberAction(string value);
-
-	void run(NumberStack& numberStack) override;
-
-private:
-	float m_value;
-};
-
-
-class MulAction : public Action
-{
-public:
-	void run(NumberStack& numberStack) override;
-};
-
-
-class DivAction : public Action
-{
-public:
-	void run(NumberStack& numberStack) override;
-};
-
-
-class AddAction : public Action
-{
-public:
-	void run(NumberStack& numberStack) override;
+enum Opcodes {
+	NumberOpcode,
+	VariableOpcode,
+	AddOpcode,
+	SubOpcode,
+	MulOpcode,
+	DivOpcode,
+	PowerOpcode,
+	NegOpcode,
+	LessOpcode,
+	GreaterOpcode,
+	LessEqualOpcode,
+	GreaterEqualOpcode,
+	EqualOpcode,
+	NotEqualOpcode,
+	AndOpcode,
+	OrOpcode,
+	NotOpcode,
+	NoArgumentFunctionOpcode,
+	OneArgumentFunctionOpcode,
+	TwoArgumentsFunctionOpcode,
+	// stores the top of the stack in a temporary, without removing it
+	StoreOpcode,
+	// pushes a temporary, for a subexpression which is used more than once
+	LoadOpcode,
+	// removes the top of the stack, after the value of a statement is stored
+	PopOpcode,
+	// A conditional is "condition JumpIfFalse then Jump else Join". The jumps
+	// go to the else branch and after the Join, the Join marks the end of
+	// the else branch for evalBlock(), which calculates both branches when
+	// the samples of a block take different branches.
+	JumpIfFalseOpcode,
+	JumpOpcode,
+	JoinOpcode,
+	// replaces the phase on the stack by the value of a subexpression of it,
+	// read from a wavetable, see Optimizer::setWavetableVariable()
+	WavetableOpcode,
+	// The opcodes with a state in the state block of the evaluator. A delay
+	// replaces the sample and the delay in samples by the sample delayed in
+	// its ring buffer; Output pushes the result of an earlier sample; a
+	// stateful function replaces its arguments by its result.
+	DelayOpcode,
+	OutputOpcode,
+	StatefulFunctionOpcode
 };
 
-class LessAction : public Action
+typedef unsigned char Opcode;
+
+// One entry of the flat program. The operand depends on the opcode: a number,
+// the index of a variable in the variable names of the program, the index of a
+// temporary, the distance of a jump to its target, a function pointer or a
+// wavetable of the program.
+// Built-in math functions and the power operator have their MathFunctions
+// value and the accuracy, so that evalBlock() can calculate them with SIMD
+// instructions. Functions without side effects are pure, the Optimizer
+// calculates them once for the same arguments.
+// The instructions with a state are impure, their state is the index of their
+// part of the state block, set by link().
+struct Instruction
 {
-public:
-	void run(NumberStack& numberStack) override;
-};
-
-class GreaterAction : public Action
-{
-public:
-	void run(NumberStack& numberStack) override;
-};
-
-class LessEqualAction : public Action
-{
-public:
-	void run(NumberStack& numberStack) override;
-};
-
-class GreaterEqualAction : public Action
-{
-public:
-	void run(NumberStack& numberStack) override;
+	Opcode opcode;
+	unsigned char mathFunction;
+	unsigned char mathAccuracy;
+	bool pure;
+	int state;
+	union {
+		float value;
+		int variable;
+		int temporary;
+		int jump;
+		NoArgumentFunction noArgumentFunction;
+		OneArgumentFunction oneArgumentFunction;
+		TwoArgumentsFunction twoArgumentsFunction;
+		const Wavetable* wavetable;
+		const StatefulFunction* statefulFunction;
+		// the ring buffer of a DelayOpcode or OutputOpcode, and the delay of
+		// the OutputOpcode in samples; the length of a DelayOpcode is 0 until
+		// link() if its delay is not constant
+		struct {
+			int length;
+			int delay;
+		} ring;
+	};
 };
 
-class EqualAction : public Action
-{
-public:
-	void run(NumberStack& numberStack) override;
-};
 
-class NotEqualAction : public Action
+// A subexpression of the control variables, which is calculated before the
+// program when one of them changed. The result is stored in a hidden variable,
+// which is read by the program.
+struct ControlValue
 {
-public:
-	void run(NumberStack& numberStack) override;
+	vector<Instruction> instructions;
+	// the index of the hidden variable
+	int variable;
 };
 
-class AndAction : public Action
+// The compiled program of an expression. It doesn't have the values of the
+// variables, so it can be shared by all evaluators, see ProgramCache.h.
+struct Program
 {
-public:
-	void run(NumberStack& numberStack) override;
+	vector<Instruction> instructions;
+	// every name is used once
+	vector<string> variableNames;
+	// the number of temporaries used by StoreOpcode and LoadOpcode
+	int temporaryCount;
+	// the wavetables used by WavetableOpcode, they are shared by the copies
+	vector<shared_ptr<const Wavetable> > wavetables;
+	// see Evaluator::setControlVariable()
+	vector<ControlValue> controlValues;
+	// the expression in postfix notation, for debugging
+	string postfix;
+	// The maximum stack depth of eval() and evalBlock() and the maximum
+	// nesting of the conditionals, -1 until the program is verified by link().
+	// A verified program is not checked again when it is linked again.
+	int stackDepth;
+	int blockStackDepth;
+	int conditionalNesting;
+	// The floats of the state block, set by link() like the stack depths. The
+	// results of the program are written to the ring buffer at outputState for
+	// the OutputOpcodes, if outputLength is not 0; evalBlock() calculates at
+	// most outputDelay samples at once, the shortest delay of them.
+	int stateSize;
+	int outputState;
+	int outputLength;
+	int outputDelay;
+
+	Program() : temporaryCount(0), stackDepth(-1), blockStackDepth(-1), conditionalNesting(-1), stateSize(0),
+	            outputState(0), outputLength(0), outputDelay(0) {
+	}
 };
 
-class OrAction : public Action
-{
-public:
-	void run(NumberStack& numberStack) override;
-};
+// evalBlock() processes the samples in chunks of this size
+#define EVALUATOR_BLOCK_SIZE 64
 
-class NotAction : public Action
-{
-public:
-	void run(NumberStack& numberStack) override;
+// SIMD instructions used by evalBlock(), the results are the same for all
+enum InstructionSets {
+	ScalarInstructionSet,
+	Sse2InstructionSet,
+	Avx2InstructionSet,
+	Avx512InstructionSet
 };
 
-class SubAction : public Action
-{
-public:
-	void run(NumberStack& numberStack) override;
+// Error flags of eval() and evalBlock(). They are not thrown, because the
+// evaluation runs in the audio thread, but collected until clearErrors().
+enum EvalErrors {
+	// a division by zero, sqrt(-1), an overflow etc., the result is NaN
+	MathEvalError = 1,
+	// the program was changed and not linked again, the result is NaN
+	NotLinkedEvalError = 2
 };
 
-class NegAction : public Action
-{
-public:
-	void run(NumberStack& numberStack) override;
-};
+class JitCompiler;
 
-class PowerAction : public Action
-{
-public:
-	void run(NumberStack& numberStack) override;
-};
+typedef int (*BlockKernel)(const Instruction* program, int size, const float* variables,
+                           const float* const* buffers, int offset, int count, float* stack,
+                           float* temporaries, float* conditions, float* state, float* output,
+                           InstructionProfile* profile);
 
 class Evaluator
 {
 public:
+	Evaluator();
 	~Evaluator();
-	void addAction(Action* action);
+	void addInstruction(Opcode opcode);
+	void addNumber(float value);
+	void addVariable(string name);
+	// adds a StoreOpcode or LoadOpcode of the temporary
+	void addTemporary(Opcode opcode, int temporary);
+	void addFunction(NoArgumentFunction function, bool pure = false);
+	void addFunction(OneArgumentFunction function, int mathFunction = NoMathFunction, bool pure = false);
+	void addFunction(TwoArgumentsFunction function, int mathFunction = NoMathFunction, bool pure = false);
+	void addFunction(const StatefulFunction* function);
+	// Adds a DelayOpcode, its ring buffer is allocated by link(). The length is
+	// the constant delay + 1, or 0 for a delay which is calculated.
+	void addDelay(int length = 0);
+	// pushes the result of the evaluation delay samples before, delay >= 1
+	void addOutput(int delay);
 	float eval();
-	void removeAllActions();
+	int evalBlock(float* output, int count);
+	void removeAllInstructions();
+	// reserves the memory for the instructions which are added next
+	void reserveInstructions(int count);
+	int getInstructionCount() {
+		return m_program->instructions.size();
+	}
+	// sets the target of the jump at the index to the instruction at the target
+	// index, which may be the end of the program
+	void setJumpTarget(int index, int target);
+	// Adds the instructions from start to end of another program. The first
+	// variableCount variables of it replace the variables; the variables of
+	// the added instructions must have the same index in both programs.
+	void addInstructions(const Program& program, int start, int end, int variableCount);
+	// the program while it is built, it is not copied like by getProgram()
+	const Program& peekProgram() {
+		return *m_program;
+	}
+	// the subexpressions of the wavetable variable are replaced by wavetables
+	void optimize();
+	// the program must not be changed by the caller, the evaluator copies it
+	// before it is changed the next time
+	shared_ptr<const Program> getProgram();
+	// replaces the program, link() is required before the evaluation
+	void setProgram(shared_ptr<const Program> program);
+	void setPostfix(string postfix);
+	// resolves the variables and verifies the stack of a changed program,
+	// throws VariableNotFound or StackUnderflow; required after changing the
+	// program
+	void link();
+	// The variables are numbered in the order they are set the first time and
+	// stored in one array. The addresses are valid until a new variable is set.
 	void setVariable(string name, float value);
 	float getVariable(string name);
 	float* getVariableAddress(string name);
+	int getVariableIndex(string name);
+	int getVariableCount() {
+		return m_variableNames.size();
+	}
+	float* getVariables() {
+		return m_variables;
+	}
+	// sets the first count variables, in the order of the indices
+	void setVariables(const float* values, int count);
+	void setVariableBuffer(string name, const float* values);
+	// binds the first count variables, NULL unbinds a variable
+	void setVariableBuffers(const float* const* buffers, int count);
+	bool setInstructionSet(int instructionSet);
+	int getInstructionSet() {
+		return m_instructionSet;
+	}
+	// runs eval() and evalBlock() as machine code, returns false if the
+	// compiler is not available for the platform
+	bool setJitEnabled(bool enabled);
+	bool isJitEnabled() {
+		return m_jitEnabled;
+	}
+	// used for the instructions added after the call
+	void setMathAccuracy(int mathAccuracy) {
+		m_mathAccuracy = mathAccuracy;
+	}
+	// used by optimize(), an empty name doesn't create wavetables
+	void setWavetableVariable(string name) {
+		m_wavetableVariable = name;
+	}
+	// Used by optimize(). A control variable changes slowly, e.g. a knob, so
+	// the subexpressions which depend only on control variables are calculated
+	// again only when one of them changed, by eval() or once per evalBlock(),
+	// with the first sample of a buffer. Their results are stored in hidden
+	// variables, which are added by link().
+	void setControlVariable(string name, bool control = true) {
+		if (control) {
+			m_controlVariables.insert(name);
+		} else {
+			m_controlVariables.erase(name);
+		}
+	}
+	// A pure program returns the same value for the same variables, so if the
+	// variables it reads are the same as for the last evaluation, eval() and
+	// evalBlock() return the last value again. evalBlock() skips only if the
+	// variables are the same for all samples of the block.
+	void setSkipUnchanged(bool skip) {
+		m_skipUnchanged = skip;
+		m_lastValid = false;
+	}
+	// the evaluated samples, one for eval(), and the skipped of them, since
+	// the last clearSampleCounts()
+	int64_t getSampleCount() {
+		return m_sampleCount;
+	}
+	int64_t getSkippedSampleCount() {
+		return m_skippedSampleCount;
+	}
+	void clearSampleCounts() {
+		m_sampleCount = 0;
+		m_skippedSampleCount = 0;
+	}
+	int getErrors() {
+		return m_errors;
+	}
+	void clearErrors() {
+		m_errors = 0;
+	}
+	// Collects the Profile of eval() and evalBlock(). The profiled evaluation
+	// reads the time before every instruction, so it is slower; without
+	// profiling the instructions are run without any check.
+	void setProfilingEnabled(bool enabled);
+	bool isProfilingEnabled() {
+		return m_profilingEnabled;
+	}
+	// the profile since the last clearProfile() or link()
+	const Profile& getProfile() {
+		return m_profile;
+	}
+	void clearProfile() {
+		m_profile.clear();
+	}
+	// the state of the delays, the outputs and the stateful functions is
+	// cleared by link() and this method
+	void resetState();
+	static const char* getOpcodeName(int opcode);
 
 private:
-	NumberStack m_numberStack;
-
-	void deleteActions();
-
-	vector<Action*> m_actions;
-	map<string, float*> m_variables;
-};
-
-
-class VariableAction : public Action
-{
-public:
-	VariableAction(Evaluator* evaluator, string name) : m_evaluator(evaluator), m_name(name), m_variableAddress(NULL) {}
-	void run(NumberStack& numberStack) override;
-
-private:
-	Evaluator* m_evaluator;
-	string m_name;
-	float* m_variableAddress;
-};
-
-
-class NoArgumentFunctionAction : public Action
-{
-public:
-	NoArgumentFunctionAction(Evaluator* evaluator, NoArgumentFunction function) : m_evaluator(evaluator), m_function(function) {}
-	void run(NumberStack& numberStack) override;
-
-private:
-	Evaluator* m_evaluator;
-	NoArgumentFunction m_function;
-};
-
-class OneArgumentFunctionAction : public Action
-{
-public:
-	OneArgumentFunctionAction(Evaluator* evaluator, OneArgumentFunction function) : m_evaluator(evaluator), m_function(function) {}
-	void run(NumberStack& numberStack) override;
-
-private:
-	Evaluator* m_evaluator;
-	OneArgumentFunction m_function;
-};
-
-class TwoArgumentsFunctionAction : public Action
-{
-public:
-	TwoArgumentsFunctionAction(Evaluator* evaluator, TwoArgumentsFunction function) : m_evaluator(evaluator), m_function(function) {}
-	void run(NumberStack& numberStack) override;
-
-private:
-	Evaluator* m_evaluator;
-	TwoArgumentsFunction m_function;
+	Program& changeProgram();
+	static void verify(Program& program);
+	static void allocateStates(Program& program);
+	static void remapVariables(vector<Instruction>& instructions, const vector<int>& indices);
+	void updateControlValues(bool block);
+	bool isUnchanged(int count);
+	float evalSample();
+	int evalSamples(float* output, int count);
+	float evalProgram();
+	void writeOutputs(const float* outputs, int count);
+	template<bool profiled>
+	float run(const Instruction* instruction, const Instruction* end, const float* variables, uint32_t& nonFinite);
+	void linkBuffers();
+	void growVariables();
+
+	shared_ptr<Program> m_program;
+	// the program was passed to getProgram() or setProgram()
+	bool m_programShared;
+	vector<float> m_stack;
+	vector<float> m_temporaries;
+	bool m_linked;
+	// The program which is evaluated, set by link(). The variables of the
+	// instructions are the indices of the variables of the evaluator, so it is
+	// a copy of the program if they are numbered differently in it.
+	const Program* m_linkedProgram;
+	Program m_remappedProgram;
+
+	// the values of the variables, aligned to 64 bytes, see growVariables()
+	vector<float> m_variableStorage;
+	float* m_variables;
+	int m_variableCapacity;
+	vector<string> m_variableNames;
+	map<string, int> m_variableIndices;
+
+	// block evaluation: the bound buffer (or NULL) of every variable, and one
+	// row of EVALUATOR_BLOCK_SIZE values per stack element and temporary
+	vector<const float*> m_variableBuffers;
+	vector<float> m_blockStack;
+	float* m_alignedBlockStack;
+	float* m_blockTemporaries;
+	// the rows of the nested conditionals, NULL if there are none
+	float* m_blockConditions;
+	// the state block of the program, see Program::stateSize
+	vector<float> m_state;
+	int m_instructionSet;
+	BlockKernel m_blockKernel;
+	BlockKernel m_profiledBlockKernel;
+	int m_mathAccuracy;
+	string m_wavetableVariable;
+	set<string> m_controlVariables;
+	// the variables read by the control values, and their values when the
+	// control values were calculated, by the index of the variable
+	vector<int> m_controlInputs;
+	vector<float> m_controlInputValues;
+	// the variables read by the program, also by the control values, and
+	// their bits at the last evaluation, which returned m_lastResult, see
+	// setSkipUnchanged()
+	bool m_skipUnchanged;
+	bool m_pure;
+	vector<int> m_readVariables;
+	vector<uint32_t> m_lastValues;
+	bool m_lastValid;
+	float m_lastResult;
+	int64_t m_sampleCount;
+	int64_t m_skippedSampleCount;
+	bool m_profilingEnabled;
+	Profile m_profile;
+	int m_errors;
+	bool m_jitEnabled;
+	JitCompiler* m_jit;
 };
 
 
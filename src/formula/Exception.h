@@ -25,7 +25,7 @@ using namespace std;
 class ParserException : public exception
 {
 public:
-	ParserException(string message = "");
+	ParserException(string message = "", int position = -1);
 	ParserException(const ParserException& other);
 	virtual ~ParserException();
 	ParserException& operator= (const ParserException& other);
@@ -33,9 +33,14 @@ public:
 	string getMessage() {
 		return m_message;
 	}
+	// the index of the character in the expression, -1 if there is none
+	int getPosition() {
+		return m_position;
+	}
 
 protected:
 	string m_message;
+	int m_position;
 };
 
 // Construct the exception
@@ -43,10 +48,11 @@ inline ParserException::ParserException(const ParserException& other)
 	: exception(other)
 {
 	m_message = other.m_message;
+	m_position = other.m_position;
 }
 
-inline ParserException::ParserException(string message)
-	: m_message(message)
+inline ParserException::ParserException(string message, int position)
+	: m_message(message), m_position(position)
 {}
 
 
@@ -59,7 +65,10 @@ inline ParserException::~ParserException()
 inline ParserException& ParserException::operator= (const ParserException& other)
 {
 	exception::operator= (other);
-	if (&other != this) m_message = other.m_message;
+	if (&other != this) {
+		m_message = other.m_message;
+		m_position = other.m_position;
+	}
 	return *this;
 }
 
@@ -75,20 +84,20 @@ inline const char *ParserException::what() const throw ()
 class SyntaxError : public ParserException
 {
 public:
-	explicit SyntaxError(string message) : ParserException(message) {}
+	explicit SyntaxError(string message, int position = -1) : ParserException(message, position) {}
 };
 
 class EvalError: public ParserException
 {
 public:
-	explicit EvalError(string message) : ParserException(message) {}
+	explicit EvalError(string message, int position = -1) : ParserException(message, position) {}
 };
 
 class VariableNotFound : public EvalError
 {
 public:
-	explicit VariableNotFound(string variableName) :
-		EvalError("Variable not found: " + variableName), m_variableName(variableName) {}
+	explicit VariableNotFound(string variableName, int position = -1) :
+		EvalError("Variable not found: " + variableName, position), m_variableName(variableName) {}
 	string getVariableName();
 private:
 	string m_variableName;
@@ -103,8 +112,8 @@ inline string VariableNotFound::getVariableName()
 class FunctionNotFound : public EvalError
 {
 public:
-	explicit FunctionNotFound(string functionName) :
-		EvalError("Function not found: " + functionName), m_functionName(functionName) {}
+	explicit FunctionNotFound(string functionName, int position = -1) :
+		EvalError("Function not found: " + functionName, position), m_functionName(functionName) {}
 	string getFunctionName();
 private:
 	string m_functionName;
@@ -119,8 +128,8 @@ inline string FunctionNotFound::getFunctionName()
 class TooManyArgumentsError : public EvalError
 {
 public:
-	explicit TooManyArgumentsError(string functionName) :
-		EvalError("Too many arguments for function: " + functionName), m_functionName(functionName) {}
+	explicit TooManyArgumentsError(string functionName, int position = -1) :
+		EvalError("Too many arguments for function: " + functionName, position), m_functionName(functionName) {}
 	string getFunctionName();
 private:
 	string m_functionName;
@@ -147,4 +156,43 @@ public:
 };
 
 
+enum ParserErrors {
+	NoParserError,
+	SyntaxParserError,
+	VariableNotFoundParserError,
+	FunctionNotFoundParserError,
+	TooManyArgumentsParserError,
+	StackUnderflowParserError
+};
+
+// An error of Formula::setExpression() without an exception. The type is a
+// ParserErrors value, the name is the unknown variable or function.
+struct ParserError
+{
+	ParserError() : type(NoParserError), position(-1) {}
+	int type;
+	string message;
+	// the index of the character in the expression, -1 if there is none
+	int position;
+	string name;
+};
+
+// throws the exception which is the same as the error
+inline void throwParserError(const ParserError& error)
+{
+	switch (error.type) {
+	case VariableNotFoundParserError:
+		throw VariableNotFound(error.name, error.position);
+	case FunctionNotFoundParserError:
+		throw FunctionNotFound(error.name, error.position);
+	case TooManyArgumentsParserError:
+		throw TooManyArgumentsError(error.name, error.position);
+	case StackUnderflowParserError:
+		throw StackUnderflow();
+	default:
+		throw SyntaxError(error.message, error.position);
+	}
+}
+
+
 #endif
@@ -0,0 +1,242 @@
+/**
+ *
+ * Copyright (c) 2001, Frank Bu
+ *
+ * project: Formula
+ * version: $Revision: 1.3 $ $Name:  $
+ *
+ * Polynomial approximations of the math functions, for the scalar functions
+ * and the block kernels. The coefficients are minimax fits for the reduced
+ * ranges, see MathAccuracies in MathFunctions.h for the errors.
+ *
+ * Like Lanes.h, only include this in a kernel source file.
+ */
+
+#ifndef FASTMATH_H
+#define FASTMATH_H
+
+#include "MathFunctions.h"
+#include "Lanes.h"
+
+namespace {
+
+template<typename Lanes, int Accuracy>
+struct FastMath
+{
+	typedef typename Lanes::Value Value;
+	typedef typename Lanes::Mask Mask;
+	typedef typename Lanes::Int Int;
+
+	static Value polynomial(Value x, float c0, float c1) {
+		return Lanes::add(Lanes::set(c0), Lanes::mul(x, Lanes::set(c1)));
+	}
+	static Value polynomial(Value x, float c0, float c1, float c2) {
+		return Lanes::add(Lanes::set(c0), Lanes::mul(x, polynomial(x, c1, c2)));
+	}
+	static Value polynomial(Value x, float c0, float c1, float c2, float c3) {
+		return Lanes::add(Lanes::set(c0), Lanes::mul(x, polynomial(x, c1, c2, c3)));
+	}
+
+	// Returns the value unchanged, but the compiler doesn't know it. This keeps
+	// -funsafe-math-optimizations from merging the steps of a calculation which
+	// are separated to avoid rounding errors or overflows.
+	static Value separate(Value value) {
+#if defined(__GNUC__) && defined(__SSE2__)
+		__asm__("" : "+v"(value));
+#endif
+		return value;
+	}
+
+	// value * 2^exponent, in two steps, so that the exponent can be out of the
+	// normal range and the result overflows to infinity or underflows to 0
+	static Value scale(Value value, Int exponent) {
+		Int half = Lanes::shiftRight(exponent, 1);
+		Int rest = Lanes::subInt(exponent, half);
+		value = separate(Lanes::mul(value, Lanes::fromBits(Lanes::shiftLeft(Lanes::addInt(half, Lanes::setInt(127)), 23))));
+		return Lanes::mul(value, Lanes::fromBits(Lanes::shiftLeft(Lanes::addInt(rest, Lanes::setInt(127)), 23)));
+	}
+
+	// e^r for |r| <= ln(2) / 2
+	static Value expReduced(Value r) {
+		Value q;
+		if (Accuracy == FastMathAccuracy) {
+			q = polynomial(r, 5.039410281e-01f, 1.666281098e-01f);
+		} else {
+			q = polynomial(r, 4.999923179e-01f, 1.666711447e-01f, 4.189011322e-02f, 8.312524910e-03f);
+		}
+		return Lanes::add(Lanes::set(1.0f), Lanes::add(r, Lanes::mul(Lanes::mul(r, r), q)));
+	}
+
+	static Value exp(Value x) {
+		// NaN is kept by max and min, the limits overflow and underflow
+		x = Lanes::min(Lanes::set(90.0f), Lanes::max(Lanes::set(-110.0f), x));
+		Int k = Lanes::toInt(Lanes::mul(x, Lanes::set(1.44269504f)));
+		Value kv = Lanes::toValue(k);
+		// ln(2) in two parts, the first product is exact
+		Value r = separate(Lanes::sub(x, Lanes::mul(kv, Lanes::set(0.693359375f))));
+		r = Lanes::sub(r, Lanes::mul(kv, Lanes::set(-2.12194440e-4f)));
+		return scale(expReduced(r), k);
+	}
+
+	static Value exp2(Value x) {
+		x = Lanes::min(Lanes::set(130.0f), Lanes::max(Lanes::set(-160.0f), x));
+		Int k = Lanes::toInt(x);
+		Value r = Lanes::mul(Lanes::sub(x, Lanes::toValue(k)), Lanes::set(0.693147181f));
+		return scale(expReduced(r), k);
+	}
+
+	static Value log2(Value x) {
+		// x = m * 2^e with sqrt(0.5) <= m < sqrt(2)
+		Int bits = Lanes::toBits(x);
+		Value e = Lanes::toValue(Lanes::subInt(Lanes::shiftRight(bits, 23), Lanes::setInt(127)));
+		Value m = Lanes::fromBits(Lanes::orInt(Lanes::andInt(bits, Lanes::setInt(0x7fffff)), Lanes::setInt(0x3f800000)));
+		Mask large = Lanes::greater(m, Lanes::set(1.41421356f));
+		m = Lanes::blend(large, Lanes::mul(m, Lanes::set(0.5f)), m);
+		e = Lanes::blend(large, Lanes::add(e, Lanes::set(1.0f)), e);
+
+		// log2(m) = log2((1 + t) / (1 - t)), an odd function of t
+		Value t = Lanes::div(Lanes::sub(m, Lanes::set(1.0f)), Lanes::add(m, Lanes::set(1.0f)));
+		Value u = Lanes::mul(t, t);
+		Value q;
+		if (Accuracy == FastMathAccuracy) {
+			q = polynomial(u, 2.885228570f, 9.835345088e-01f);
+		} else {
+			q = polynomial(u, 2.885391289f, 9.614708090e-01f, 5.989738855e-01f);
+		}
+		Value result = Lanes::add(e, Lanes::mul(t, q));
+
+		// same results as the C library for the special cases
+		result = Lanes::blend(Lanes::isNonFinite(x), x, result);
+		result = Lanes::blend(Lanes::less(x, Lanes::set(0.0f)), Lanes::set(NAN), result);
+		return Lanes::blend(Lanes::equal(x, Lanes::set(0.0f)), Lanes::set(-INFINITY), result);
+	}
+
+	static Value log(Value x) {
+		return Lanes::mul(log2(x), Lanes::set(0.693147181f));
+	}
+
+	static Value log10(Value x) {
+		return Lanes::mul(log2(x), Lanes::set(0.301029996f));
+	}
+
+	// x = r + k * pi with |r| <= pi / 2, returns the sign of (-1)^k as sign bit
+	static Value reduce(Value x, Value& r) {
+		Int k = Lanes::toInt(Lanes::mul(x, Lanes::set(0.318309886f)));
+		Value kv = Lanes::toValue(k);
+		// pi in three parts, the first products are exact
+		r = separate(Lanes::sub(x, Lanes::mul(kv, Lanes::set(3.140625f))));
+		r = separate(Lanes::sub(r, Lanes::mul(kv, Lanes::set(9.67502593994140625e-4f))));
+		r = Lanes::sub(r, Lanes::mul(kv, Lanes::set(1.509957990978376e-7f)));
+		// k is rounded for large arguments, so r can be a bit larger than pi / 2;
+		// for very large arguments the reduction is wrong, but sin and cos stay bounded
+		r = Lanes::min(Lanes::set(1.6f), Lanes::max(Lanes::set(-1.6f), r));
+		return Lanes::fromBits(Lanes::shiftLeft(k, 31));
+	}
+
+	static Value sinReduced(Value r) {
+		Value u = Lanes::mul(r, r);
+		Value q;
+		if (Accuracy == FastMathAccuracy) {
+			q = polynomial(u, -1.660786240e-01f, 7.633773277e-03f);
+		} else {
+			q = polynomial(u, -1.666665710e-01f, 8.333017291e-03f, -1.980661519e-04f, 2.600054755e-06f);
+		}
+		return Lanes::add(r, Lanes::mul(Lanes::mul(r, u), q));
+	}
+
+	static Value cosReduced(Value r) {
+		Value u = Lanes::mul(r, r);
+		Value q;
+		if (Accuracy == FastMathAccuracy) {
+			q = polynomial(u, -4.999356307e-01f, 4.150706682e-02f, -1.275751976e-03f);
+		} else {
+			q = polynomial(u, -4.999993229e-01f, 4.166398945e-02f, -1.385592718e-03f, 2.319438639e-05f);
+		}
+		return Lanes::add(Lanes::set(1.0f), Lanes::mul(u, q));
+	}
+
+	static Value sin(Value x) {
+		Value r;
+		Value sign = reduce(x, r);
+		return Lanes::xorBits(sinReduced(r), sign);
+	}
+
+	static Value cos(Value x) {
+		Value r;
+		Value sign = reduce(x, r);
+		return Lanes::xorBits(cosReduced(r), sign);
+	}
+
+	static Value tan(Value x) {
+		Value r;
+		reduce(x, r);
+		return Lanes::div(sinReduced(r), cosReduced(r));
+	}
+
+	static Value sinh(Value x) {
+		Value e = exp(x);
+		Value result = Lanes::mul(Lanes::sub(e, Lanes::div(Lanes::set(1.0f), e)), Lanes::set(0.5f));
+		// the Taylor series for small x, where the difference cancels out
+		Value u = Lanes::mul(x, x);
+		Value series = Lanes::add(x, Lanes::mul(Lanes::mul(x, u), polynomial(u, 1.0f / 6.0f, 1.0f / 120.0f, 1.0f / 5040.0f)));
+		return Lanes::blend(Lanes::less(Lanes::abs(x), Lanes::set(0.5f)), series, result);
+	}
+
+	static Value cosh(Value x) {
+		Value e = exp(x);
+		return Lanes::mul(Lanes::add(e, Lanes::div(Lanes::set(1.0f), e)), Lanes::set(0.5f));
+	}
+
+	static Value tanh(Value x) {
+		// 1 - 2 / (e^2|x| + 1), which is 1 if e^2|x| overflows
+		Value e = exp(Lanes::add(Lanes::abs(x), Lanes::abs(x)));
+		Value result = Lanes::sub(Lanes::set(1.0f), Lanes::div(Lanes::set(2.0f), Lanes::add(e, Lanes::set(1.0f))));
+		return Lanes::xorBits(result, Lanes::andBits(x, Lanes::set(-0.0f)));
+	}
+
+	static Value pow(Value x, Value y) {
+		Value result = exp2(Lanes::mul(y, log2(Lanes::abs(x))));
+
+		// a negative x needs an integer y, an odd y negates the result;
+		// all floats from 2^24 on are even integers
+		Int k = Lanes::toInt(y);
+		Mask large = Lanes::greaterEqual(Lanes::abs(y), Lanes::set(16777216.0f));
+		Mask integer = Lanes::orMask(Lanes::equal(y, Lanes::toValue(k)), large);
+		Value sign = Lanes::blend(large, Lanes::set(0.0f), Lanes::fromBits(Lanes::shiftLeft(k, 31)));
+		Mask negative = Lanes::less(x, Lanes::set(0.0f));
+		result = Lanes::blend(negative, Lanes::xorBits(result, sign), result);
+		result = Lanes::blend(Lanes::andMask(negative, Lanes::notMask(integer)), Lanes::set(NAN), result);
+		return Lanes::blend(Lanes::equal(y, Lanes::set(0.0f)), Lanes::set(1.0f), result);
+	}
+
+	template<Value (*Function)(Value)>
+	static void calculateRow(float* row, int lanes) {
+		for (int i = 0; i < lanes; i += Lanes::Count) Lanes::store(row + i, Function(Lanes::load(row + i)));
+	}
+
+	// calculates a row of the block stack, the exponent row is only used by pow
+	static void calculateRow(int mathFunction, float* row, const float* exponents, int lanes) {
+		switch (mathFunction) {
+		case SinMathFunction: calculateRow<sin>(row, lanes); break;
+		case CosMathFunction: calculateRow<cos>(row, lanes); break;
+		case TanMathFunction: calculateRow<tan>(row, lanes); break;
+		case ExpMathFunction: calculateRow<exp>(row, lanes); break;
+		case LogMathFunction: calculateRow<log>(row, lanes); break;
+		case Log2MathFunction: calculateRow<log2>(row, lanes); break;
+		case Log10MathFunction: calculateRow<log10>(row, lanes); break;
+		case SinhMathFunction: calculateRow<sinh>(row, lanes); break;
+		case CoshMathFunction: calculateRow<cosh>(row, lanes); break;
+		case TanhMathFunction: calculateRow<tanh>(row, lanes); break;
+		case PowMathFunction:
+			for (int i = 0; i < lanes; i += Lanes::Count) {
+				Lanes::store(row + i, pow(Lanes::load(row + i), Lanes::load(exponents + i)));
+			}
+			break;
+		}
+	}
+};
+
+}
+
+
+#endif
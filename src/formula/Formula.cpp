@@ -31,6 +31,11 @@ void Formula::setExpression(string expression)
 	m_parser->setExpression(expression);
 }
 
+bool Formula::setExpression(string expression, ParserError& error)
+{
+	return m_parser->setExpression(expression, error);
+}
+
 
 void Formula::setVariable(string name, float value)
 {
@@ -44,23 +49,53 @@ float* Formula::getVariableAddress(string name)
 }
 
 
-void Formula::setFunction(string name, float(*function)())
+int Formula::getVariableIndex(string name)
+{
+	return m_parser->getVariableIndex(name);
+}
+
+
+void Formula::setVariables(const float* values, int count)
+{
+	m_parser->setVariables(values, count);
+}
+
+
+void Formula::setVariableBuffer(string name, const float* values)
+{
+	m_parser->setVariableBuffer(name, values);
+}
+
+
+void Formula::setVariableBuffers(const float* const* buffers, int count)
+{
+	m_parser->setVariableBuffers(buffers, count);
+}
+
+
+void Formula::setConstant(string name, float value)
 {
-	m_parser->setFunction(name, function);
+	m_parser->setConstant(name, value);
 }
 
 
+void Formula::setFunction(string name, float(*function)(), bool pure)
+{
+	m_parser->setFunction(name, function, pure);
+}
+
 
-void Formula::setFunction(string name, float(*function)(float))
+
+void Formula::setFunction(string name, float(*function)(float), bool pure)
 {
-	m_parser->setFunction(name, function);
+	m_parser->setFunction(name, function, pure);
 }
 
 
 
-void Formula::setFunction(string name, float(*function)(float, float))
+void Formula::setFunction(string name, float(*function)(float, float), bool pure)
 {
-	m_parser->setFunction(name, function);
+	m_parser->setFunction(name, function, pure);
 }
 
 
@@ -69,3 +104,157 @@ float Formula::eval()
 {
 	return m_parser->eval();
 }
+
+
+
+int Formula::evalBlock(float* output, int count)
+{
+	return m_parser->evalBlock(output, count);
+}
+
+
+
+int Formula::getErrors()
+{
+	return m_parser->getErrors();
+}
+
+
+
+void Formula::clearErrors()
+{
+	m_parser->clearErrors();
+}
+
+
+
+void Formula::resetState()
+{
+	m_parser->resetState();
+}
+
+
+
+void Formula::setSkipUnchanged(bool skip)
+{
+	m_parser->setSkipUnchanged(skip);
+}
+
+
+
+int64_t Formula::getSampleCount()
+{
+	return m_parser->getSampleCount();
+}
+
+
+
+int64_t Formula::getSkippedSampleCount()
+{
+	return m_parser->getSkippedSampleCount();
+}
+
+
+
+void Formula::clearSampleCounts()
+{
+	m_parser->clearSampleCounts();
+}
+
+
+
+void Formula::setProfilingEnabled(bool enabled)
+{
+	m_parser->setProfilingEnabled(enabled);
+}
+
+
+
+bool Formula::isProfilingEnabled()
+{
+	return m_parser->isProfilingEnabled();
+}
+
+
+
+const Profile& Formula::getProfile()
+{
+	return m_parser->getProfile();
+}
+
+
+
+void Formula::clearProfile()
+{
+	m_parser->clearProfile();
+}
+
+
+
+string Formula::getProfileJson()
+{
+	return m_parser->getProfileJson();
+}
+
+
+
+bool Formula::setInstructionSet(int instructionSet)
+{
+	return m_parser->setInstructionSet(instructionSet);
+}
+
+
+
+int Formula::getInstructionSet()
+{
+	return m_parser->getInstructionSet();
+}
+
+
+
+bool Formula::setJitEnabled(bool enabled)
+{
+	return m_parser->setJitEnabled(enabled);
+}
+
+
+
+bool Formula::isJitEnabled()
+{
+	return m_parser->isJitEnabled();
+}
+
+
+
+void Formula::setMathAccuracy(int mathAccuracy)
+{
+	m_parser->setMathAccuracy(mathAccuracy);
+}
+
+
+
+int Formula::getMathAccuracy()
+{
+	return m_parser->getMathAccuracy();
+}
+
+
+
+void Formula::setWavetableVariable(string name)
+{
+	m_parser->setWavetableVariable(name);
+}
+
+
+
+string Formula::getWavetableVariable()
+{
+	return m_parser->getWavetableVariable();
+}
+
+
+
+void Formula::setControlVariable(string name, bool control)
+{
+	m_parser->setControlVariable(name, control);
+}
@@ -11,7 +11,11 @@
 #ifndef FORMULA_H
 #define FORMULA_H
 
+#include <stdint.h>
+
 #include "Exception.h"
+#include "MathFunctions.h"
+#include "Profile.h"
 
 using namespace std;
 
@@ -23,13 +27,92 @@ public:
 	Formula();
 	Formula(string formula);
 	~Formula();
+	// throws a ParserException for syntax errors and unknown variables or
+	// functions, so all variables must be set before
 	void setExpression(string expression);
+	// Returns false for the same errors, without an exception. The position
+	// of the error is the index of the character in the expression.
+	bool setExpression(string expression, ParserError& error);
+	// The variables are numbered in the order they are set the first time. An
+	// address is valid until a new variable is set, also a hidden variable,
+	// see setControlVariable().
 	void setVariable(string name, float value);
 	float* getVariableAddress(string name);
-	void setFunction(string name, float(*function)());
-	void setFunction(string name, float(*function)(float));
-	void setFunction(string name, float(*function)(float, float));
+	int getVariableIndex(string name);
+	// sets the first count variables at once, in the order of the indices
+	void setVariables(const float* values, int count);
+	// binds a variable to an array of values for evalBlock(), NULL unbinds it
+	void setVariableBuffer(string name, const float* values);
+	// binds the first count variables at once, in the order of the indices
+	void setVariableBuffers(const float* const* buffers, int count);
+	// constants are replaced by their value when the expression is set
+	void setConstant(string name, float value);
+	// A pure function has no side effects and returns the same value for the
+	// same arguments, so equal calls in the expression are calculated once.
+	// Functions like random numbers or counters must not be pure. The name "if"
+	// is the conditional if(condition, then, else), it can't be a function.
+	void setFunction(string name, float(*function)(), bool pure = false);
+	void setFunction(string name, float(*function)(float), bool pure = false);
+	void setFunction(string name, float(*function)(float, float), bool pure = false);
+	// Doesn't throw exceptions. A math error returns NaN and sets MathEvalError,
+	// see EvalErrors in Evaluator.h.
 	float eval();
+	// evaluates count samples, sample i reads element i of all variable buffers;
+	// samples with a math error are set to NaN, returns the number of them
+	int evalBlock(float* output, int count);
+	// the EvalErrors flags of all evaluations since the last clearErrors()
+	int getErrors();
+	void clearErrors();
+	// The delays, out[n] and the filters start with 0 for a new expression;
+	// this clears them for the current one.
+	void resetState();
+	// If enabled, eval() and evalBlock() return the last value again without
+	// calculating it, if the expression has no functions which are not pure
+	// and the variables it reads have the same values as for the last call.
+	// evalBlock() skips only blocks in which they are the same for all
+	// samples. The counters are the evaluated samples, one per eval(), and the
+	// skipped of them.
+	void setSkipUnchanged(bool skip);
+	int64_t getSampleCount();
+	int64_t getSkippedSampleCount();
+	void clearSampleCounts();
+	// Profiles the evaluations, see Profile.h: the calls, samples, math errors
+	// and the time of them, and the runs and the time of every instruction.
+	// Without profiling the evaluation has no additional cost.
+	void setProfilingEnabled(bool enabled);
+	bool isProfilingEnabled();
+	const Profile& getProfile();
+	void clearProfile();
+	// the profile as a JSON object, with the instructions summed up by opcode
+	// and by function name
+	string getProfileJson();
+	// selects the SIMD instructions for evalBlock(), see InstructionSets in
+	// Evaluator.h; the default is the widest the CPU supports
+	bool setInstructionSet(int instructionSet);
+	int getInstructionSet();
+	// compiles the expression to machine code for eval() and evalBlock(), with
+	// the same results as the interpreter; returns false if the platform is not
+	// supported (only x86-64 Linux and Mac OS X are)
+	bool setJitEnabled(bool enabled);
+	bool isJitEnabled();
+	// selects the accuracy of the built-in math functions, see MathAccuracies
+	// in MathFunctions.h; used when the expression is set the next time
+	void setMathAccuracy(int mathAccuracy);
+	int getMathAccuracy();
+	// Subexpressions which depend only on this variable, e.g. sin(2*pi*p), are
+	// calculated once for the values 0 to 1 and read from a wavetable, if they
+	// are periodic with a period of 1. The interpolation error is less than
+	// 1e-5 of the peak value. Used when the expression is set the next time,
+	// an empty name disables the wavetables.
+	void setWavetableVariable(string name);
+	string getWavetableVariable();
+	// A control variable changes slowly, like a knob. The subexpressions which
+	// depend only on control variables, e.g. pow(2, k*5), are calculated again
+	// only when one of them changed, by eval() or at the start of evalBlock(),
+	// which uses the first element of a variable buffer for them. The results
+	// are stored in hidden variables, which are added when the expression is
+	// set. Used when the expression is set the next time.
+	void setControlVariable(string name, bool control = true);
 
 private:
 	Parser* m_parser;
@@ -0,0 +1,674 @@
+/**
+ *
+ * Copyright (c) 2001, Frank Bu
+ *
+ * project: Formula
+ * version: $Revision: 1.3 $ $Name:  $
+ *
+ * JitCompiler class, compiles a linked program to x86-64 machine code.
+ */
+
+#include "JitCompiler.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__))
+#define JIT_AVAILABLE
+#endif
+
+#ifdef JIT_AVAILABLE
+#include "FastMath.h"
+
+#include <sys/mman.h>
+#endif
+
+using namespace std;
+
+// xmm0 to xmm13 are the stack, xmm14 is a temporary register and xmm15
+// collects the error bits of the samples
+#define JIT_STACK_REGISTERS 14
+#define JIT_TEMPORARY 14
+#define JIT_ERRORS 15
+
+// The registers are saved in 16 byte slots on the machine stack when a
+// function is called, the next slot is for the error bits, followed by the
+// slots of the temporaries.
+#define JIT_TEMPORARIES_SLOT (JIT_STACK_REGISTERS + 1)
+#define JIT_FRAME_SIZE(temporaryCount) (16 * (JIT_TEMPORARIES_SLOT + (temporaryCount)) + 8)
+
+// SSE opcodes, after the 0x0f byte
+#define SSE_MOVUPS_LOAD 0x10
+#define SSE_MOVUPS_STORE 0x11
+#define SSE_MOVAPS_LOAD 0x28
+#define SSE_MOVAPS_STORE 0x29
+#define SSE_MOVMSKPS 0x50
+#define SSE_ANDPS 0x54
+#define SSE_ORPS 0x56
+#define SSE_XORPS 0x57
+#define SSE_ADDPS 0x58
+#define SSE_MULPS 0x59
+#define SSE_SUBPS 0x5c
+#define SSE_DIVPS 0x5e
+#define SSE_MOVD 0x6e
+#define SSE_CMPPS 0xc2
+#define SSE_SHUFPS 0xc6
+
+// predicates of cmpps
+#define CMP_EQ 0
+#define CMP_LT 1
+#define CMP_LE 2
+#define CMP_UNORD 3
+#define CMP_NEQ 4
+#define CMP_NLT 5
+#define CMP_NLE 6
+
+
+#ifdef JIT_AVAILABLE
+
+// The approximated math functions, with the operands and the result in SSE
+// registers.
+template<int Accuracy>
+struct SimdMath
+{
+	typedef FastMath<Sse2Lanes, Accuracy> Math;
+	static __m128 sin(__m128 x) { return Math::sin(x); }
+	static __m128 cos(__m128 x) { return Math::cos(x); }
+	static __m128 tan(__m128 x) { return Math::tan(x); }
+	static __m128 exp(__m128 x) { return Math::exp(x); }
+	static __m128 log(__m128 x) { return Math::log(x); }
+	static __m128 log2(__m128 x) { return Math::log2(x); }
+	static __m128 log10(__m128 x) { return Math::log10(x); }
+	static __m128 sinh(__m128 x) { return Math::sinh(x); }
+	static __m128 cosh(__m128 x) { return Math::cosh(x); }
+	static __m128 tanh(__m128 x) { return Math::tanh(x); }
+	static __m128 pow(__m128 x, __m128 y) { return Math::pow(x, y); }
+
+	static uintptr_t getFunction(int mathFunction) {
+		switch (mathFunction) {
+		case SinMathFunction: return (uintptr_t) sin;
+		case CosMathFunction: return (uintptr_t) cos;
+		case TanMathFunction: return (uintptr_t) tan;
+		case ExpMathFunction: return (uintptr_t) exp;
+		case LogMathFunction: return (uintptr_t) log;
+		case Log2MathFunction: return (uintptr_t) log2;
+		case Log10MathFunction: return (uintptr_t) log10;
+		case SinhMathFunction: return (uintptr_t) sinh;
+		case CoshMathFunction: return (uintptr_t) cosh;
+		case TanhMathFunction: return (uintptr_t) tanh;
+		case PowMathFunction: return (uintptr_t) pow;
+		}
+		return 0;
+	}
+};
+
+static uintptr_t getSimdFunction(const Instruction* instruction)
+{
+	switch (instruction->mathAccuracy) {
+	case AudioMathAccuracy: return SimdMath<AudioMathAccuracy>::getFunction(instruction->mathFunction);
+	case FastMathAccuracy: return SimdMath<FastMathAccuracy>::getFunction(instruction->mathFunction);
+	}
+	return 0;
+}
+
+// Called by the generated code for all other functions. The operands are in
+// rows of 4 values, the result is stored in the first row. A single lane is
+// broadcast to all lanes.
+static void callFunction(const Instruction* instruction, float* values, int lanes)
+{
+	switch (instruction->opcode) {
+	case NoArgumentFunctionOpcode:
+		for (int i = 0; i < lanes; i++) values[i] = instruction->noArgumentFunction();
+		break;
+	case OneArgumentFunctionOpcode:
+		for (int i = 0; i < lanes; i++) values[i] = instruction->oneArgumentFunction(values[i]);
+		break;
+	case WavetableOpcode:
+		for (int i = 0; i < lanes; i++) values[i] = instruction->wavetable->read(values[i]);
+		break;
+	default:
+		for (int i = 0; i < lanes; i++) values[i] = instruction->twoArgumentsFunction(values[i], values[i + 4]);
+		break;
+	}
+	for (int i = lanes; i < 4; i++) values[i] = values[0];
+}
+
+// called by the scalar function for a wavetable, like a one argument function
+static float readWavetable(const Wavetable* wavetable, float phase)
+{
+	return wavetable->read(phase);
+}
+
+// the function of the instruction for a single sample, like in the interpreter
+static uintptr_t getScalarFunction(const Instruction* instruction)
+{
+	switch (instruction->opcode) {
+	case NoArgumentFunctionOpcode: return (uintptr_t) instruction->noArgumentFunction;
+	case OneArgumentFunctionOpcode: return (uintptr_t) instruction->oneArgumentFunction;
+	case WavetableOpcode: return (uintptr_t) readWavetable;
+	default: return (uintptr_t) instruction->twoArgumentsFunction;
+	}
+}
+
+#endif
+
+JitCompiler::JitCompiler() : m_code(NULL), m_codeSize(0), m_scalarFunction(NULL),
+                             m_blockFunction(NULL), m_sampleFunction(NULL)
+{
+}
+
+JitCompiler::~JitCompiler()
+{
+	clear();
+}
+
+bool JitCompiler::isAvailable()
+{
+#ifdef JIT_AVAILABLE
+	return true;
+#else
+	return false;
+#endif
+}
+
+void JitCompiler::clear()
+{
+#ifdef JIT_AVAILABLE
+	if (m_code) munmap(m_code, m_codeSize);
+#endif
+	m_code = NULL;
+	m_codeSize = 0;
+	m_scalarFunction = NULL;
+	m_blockFunction = NULL;
+	m_sampleFunction = NULL;
+}
+
+bool JitCompiler::compile(const Program& program, const float* variables, const float* const* buffers)
+{
+	clear();
+#ifdef JIT_AVAILABLE
+	if (program.instructions.size() == 0) return false;
+	// the delays and the stateful functions are run by the interpreter and the block kernels
+	if (program.stateSize > 0) return false;
+
+	// the samples of a block can take different branches, so there is no
+	// block function for a program with conditionals
+	bool conditional = false;
+	for (int i = 0; i < (int) program.instructions.size(); i++) {
+		if (program.instructions[i].opcode == JumpIfFalseOpcode) conditional = true;
+	}
+
+	// the functions are aligned to 16 bytes
+	m_buffer.clear();
+	size_t starts[3];
+	for (int mode = ScalarMode; mode <= SampleMode; mode++) {
+		if (mode == BlockMode && conditional) continue;
+		while (m_buffer.size() % 16) emitByte(0xcc);
+		starts[mode] = m_buffer.size();
+		if (!emitFunction(program, variables, buffers, mode)) return false;
+	}
+
+	// the memory is made executable after writing the code
+	void* code = mmap(NULL, m_buffer.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (code == MAP_FAILED) return false;
+	memcpy(code, m_buffer.data(), m_buffer.size());
+	if (mprotect(code, m_buffer.size(), PROT_READ | PROT_EXEC) != 0) {
+		munmap(code, m_buffer.size());
+		return false;
+	}
+	m_code = (unsigned char*) code;
+	m_codeSize = m_buffer.size();
+	m_scalarFunction = (JitFunction) (m_code + starts[ScalarMode]);
+	m_blockFunction = conditional ? NULL : (JitFunction) (m_code + starts[BlockMode]);
+	m_sampleFunction = (JitFunction) (m_code + starts[SampleMode]);
+	return true;
+#else
+	return false;
+#endif
+}
+
+int JitCompiler::evalBlock(float* output, int count)
+{
+	int errorCount = 0;
+	int i = 0;
+	for (; m_blockFunction && i + 4 <= count; i += 4) {
+		int errors = m_blockFunction(i, output + i);
+		if (errors) {
+			for (int j = 0; j < 4; j++) {
+				if (errors & (1 << j)) {
+					output[i + j] = NAN;
+					errorCount++;
+				}
+			}
+		}
+	}
+	// the last samples are calculated one by one, to not read after the end of the buffers
+	for (; i < count; i++) {
+		float results[4];
+		if (m_sampleFunction(i, results) & 1) {
+			output[i] = NAN;
+			errorCount++;
+		} else {
+			output[i] = results[0];
+		}
+	}
+	return errorCount;
+}
+
+// Non-finite values are detected at the same places as in the block kernels,
+// see BlockKernelTemplate.h, but every stack element is checked only once.
+bool JitCompiler::emitFunction(const Program& program, const float* variables, const float* const* buffers, int mode)
+{
+	const int lanes = mode == BlockMode ? 4 : 1;
+	const int frameSize = JIT_FRAME_SIZE(program.temporaryCount);
+	m_constants.clear();
+	m_constantFixups.clear();
+	m_temporaryFinite.assign(program.temporaryCount, false);
+	m_conditionals.clear();
+
+	// push rbx; push r12; sub rsp, frameSize
+	emitByte(0x53);
+	emitByte(0x41);
+	emitByte(0x54);
+	emitByte(0x48);
+	emitByte(0x81);
+	emitByte(0xec);
+	emitInt(frameSize);
+	// movsxd rbx, edi (the offset); mov r12, rsi (the output)
+	emitByte(0x48);
+	emitByte(0x63);
+	emitByte(0xdf);
+	emitByte(0x49);
+	emitByte(0x89);
+	emitByte(0xf4);
+	emitSse(0, SSE_XORPS, JIT_ERRORS, JIT_ERRORS);
+
+	// the register of the top stack element is depth - 1
+	int depth = 0;
+	for (int pc = 0; pc < (int) program.instructions.size(); pc++) {
+		const Instruction& instruction = program.instructions[pc];
+		int top = depth - 1;
+		int second = depth - 2;
+		switch (instruction.opcode) {
+		case NumberOpcode:
+			if (depth == JIT_STACK_REGISTERS) return false;
+			emitConstant(SSE_MOVAPS_LOAD, depth, instruction.value);
+			m_finite[depth] = isfinite(instruction.value);
+			depth++;
+			break;
+		case VariableOpcode:
+			if (depth == JIT_STACK_REGISTERS) return false;
+			if (buffers[instruction.variable] && mode != ScalarMode) {
+				// mov rax, buffer; movups or movss xmm, [rax + rbx * 4]
+				emitByte(0x48);
+				emitByte(0xb8);
+				emitPointer(buffers[instruction.variable]);
+				if (mode == BlockMode) {
+					emitSse(0, SSE_MOVUPS_LOAD, depth, SampleAddress, 0);
+				} else {
+					emitSse(0xf3, SSE_MOVUPS_LOAD, depth, SampleAddress, 0);
+					emitSse(0, SSE_SHUFPS, depth, depth);
+					emitByte(0);
+				}
+			} else {
+				// mov rax, variable; movss xmm, [rax]
+				emitByte(0x48);
+				emitByte(0xb8);
+				emitPointer(variables + instruction.variable);
+				emitSse(0xf3, SSE_MOVUPS_LOAD, depth, RaxAddress, 0);
+				emitSse(0, SSE_SHUFPS, depth, depth);
+				emitByte(0);
+			}
+			m_finite[depth] = false;
+			depth++;
+			break;
+		case AddOpcode:
+			emitSse(0, SSE_ADDPS, second, top);
+			m_finite[second] = false;
+			depth--;
+			break;
+		case SubOpcode:
+			emitSse(0, SSE_SUBPS, second, top);
+			m_finite[second] = false;
+			depth--;
+			break;
+		case MulOpcode:
+			emitSse(0, SSE_MULPS, second, top);
+			m_finite[second] = false;
+			depth--;
+			break;
+		case DivOpcode:
+			emitCheck(top);
+			emitSse(0, SSE_DIVPS, second, top);
+			m_finite[second] = false;
+			depth--;
+			break;
+		case NegOpcode:
+			emitConstant(SSE_XORPS, top, -0.0f);
+			break;
+		case LessOpcode:
+		case GreaterOpcode:
+		case LessEqualOpcode:
+		case GreaterEqualOpcode:
+		case EqualOpcode:
+		case NotEqualOpcode:
+		case AndOpcode:
+		case OrOpcode:
+			emitCheck(second);
+			emitCheck(top);
+			if (instruction.opcode == AndOpcode || instruction.opcode == OrOpcode) {
+				emitSse(0, SSE_XORPS, JIT_TEMPORARY, JIT_TEMPORARY);
+				emitSse(0, SSE_CMPPS, second, JIT_TEMPORARY);
+				emitByte(CMP_NEQ);
+				emitSse(0, SSE_CMPPS, top, JIT_TEMPORARY);
+				emitByte(CMP_NEQ);
+				emitSse(0, instruction.opcode == AndOpcode ? SSE_ANDPS : SSE_ORPS, second, top);
+			} else if (instruction.opcode == GreaterOpcode || instruction.opcode == GreaterEqualOpcode) {
+				// op1 > op2 is op2 < op1, also for NaN, which can select a
+				// branch of a conditional
+				emitSse(0, SSE_CMPPS, top, second);
+				emitByte(instruction.opcode == GreaterOpcode ? CMP_LT : CMP_LE);
+				emitSse(0, SSE_MOVAPS_LOAD, second, top);
+			} else {
+				int predicate;
+				switch (instruction.opcode) {
+				case LessOpcode: predicate = CMP_LT; break;
+				case LessEqualOpcode: predicate = CMP_LE; break;
+				case EqualOpcode: predicate = CMP_EQ; break;
+				default: predicate = CMP_NEQ; break;
+				}
+				emitSse(0, SSE_CMPPS, second, top);
+				emitByte(predicate);
+			}
+			emitConstant(SSE_ANDPS, second, 1.0f);
+			depth--;
+			break;
+		case NotOpcode:
+			emitCheck(top);
+			emitSse(0, SSE_XORPS, JIT_TEMPORARY, JIT_TEMPORARY);
+			emitSse(0, SSE_CMPPS, top, JIT_TEMPORARY);
+			emitByte(CMP_EQ);
+			emitConstant(SSE_ANDPS, top, 1.0f);
+			break;
+		case NoArgumentFunctionOpcode:
+			if (depth == JIT_STACK_REGISTERS) return false;
+			emitCall(&instruction, depth, depth, lanes, mode);
+			m_finite[depth] = false;
+			depth++;
+			break;
+		case OneArgumentFunctionOpcode:
+		case WavetableOpcode:
+			emitCheck(top);
+			emitCall(&instruction, depth, top, lanes, mode);
+			m_finite[top] = false;
+			break;
+		case PowerOpcode:
+		case TwoArgumentsFunctionOpcode:
+			emitCheck(second);
+			emitCheck(top);
+			emitCall(&instruction, depth, second, lanes, mode);
+			m_finite[second] = false;
+			depth--;
+			break;
+		case StoreOpcode:
+			emitSse(0, SSE_MOVAPS_STORE, top, StackAddress, 16 * (JIT_TEMPORARIES_SLOT + instruction.temporary));
+			m_temporaryFinite[instruction.temporary] = m_finite[top];
+			break;
+		case LoadOpcode:
+			if (depth == JIT_STACK_REGISTERS) return false;
+			emitSse(0, SSE_MOVAPS_LOAD, depth, StackAddress, 16 * (JIT_TEMPORARIES_SLOT + instruction.temporary));
+			m_finite[depth] = m_temporaryFinite[instruction.temporary];
+			depth++;
+			break;
+		case PopOpcode:
+			emitCheck(top);
+			depth--;
+			break;
+		case JumpIfFalseOpcode: {
+			// xorps xmm14, xmm14; cmpneqps xmm14, xmm; movmskps eax, xmm14;
+			// test al, 1; jz else
+			emitCheck(top);
+			emitSse(0, SSE_XORPS, JIT_TEMPORARY, JIT_TEMPORARY);
+			emitSse(0, SSE_CMPPS, JIT_TEMPORARY, top);
+			emitByte(CMP_NEQ);
+			emitSse(0, SSE_MOVMSKPS, 0, JIT_TEMPORARY);
+			emitByte(0xa8);
+			emitByte(0x01);
+			Conditional conditional;
+			conditional.jump = emitJump(0x84);
+			conditional.temporaryFinite = m_temporaryFinite;
+			m_conditionals.push_back(conditional);
+			depth--;
+			break;
+		}
+		case JumpOpcode: {
+			// jmp end; the else branch has the temporaries from before the conditional
+			Conditional& conditional = m_conditionals.back();
+			size_t jump = emitJump(0);
+			setJumpTarget(conditional.jump);
+			conditional.jump = jump;
+			m_temporaryFinite.swap(conditional.temporaryFinite);
+			depth--;
+			break;
+		}
+		case JoinOpcode: {
+			// the value or a temporary is known to be finite if it is in both branches
+			Conditional& conditional = m_conditionals.back();
+			setJumpTarget(conditional.jump);
+			for (int i = 0; i < program.temporaryCount; i++) {
+				m_temporaryFinite[i] = m_temporaryFinite[i] && conditional.temporaryFinite[i];
+			}
+			m_conditionals.pop_back();
+			m_finite[top] = false;
+			break;
+		}
+		}
+	}
+	// the result is the top of the stack, like in the interpreter
+	emitCheck(depth - 1);
+
+	// mov rax, r12; movups [rax], xmm; movmskps eax, xmm15
+	emitByte(0x4c);
+	emitByte(0x89);
+	emitByte(0xe0);
+	emitSse(0, SSE_MOVUPS_STORE, depth - 1, RaxAddress, 0);
+	emitSse(0, SSE_MOVMSKPS, 0, JIT_ERRORS);
+	// add rsp, frameSize; pop r12; pop rbx; ret
+	emitByte(0x48);
+	emitByte(0x81);
+	emitByte(0xc4);
+	emitInt(frameSize);
+	emitByte(0x41);
+	emitByte(0x5c);
+	emitByte(0x5b);
+	emitByte(0xc3);
+	emitConstants();
+	return true;
+}
+
+void JitCompiler::emitByte(int value)
+{
+	m_buffer.push_back(value);
+}
+
+void JitCompiler::emitInt(uint32_t value)
+{
+	for (int i = 0; i < 4; i++) emitByte((value >> (8 * i)) & 0xff);
+}
+
+void JitCompiler::emitPointer(const void* pointer)
+{
+	uint64_t value = (uintptr_t) pointer;
+	emitInt(value);
+	emitInt(value >> 32);
+}
+
+// an SSE instruction with two registers
+void JitCompiler::emitSse(int prefix, int opcode, int reg, int rm)
+{
+	if (prefix) emitByte(prefix);
+	if (reg >= 8 || rm >= 8) emitByte(0x40 | (reg >= 8 ? 4 : 0) | (rm >= 8 ? 1 : 0));
+	emitByte(0x0f);
+	emitByte(opcode);
+	emitByte(0xc0 | (reg & 7) << 3 | (rm & 7));
+}
+
+// An SSE instruction with a register and [rax], [rax + rbx * 4], [rsp + value]
+// or the constant with the index value.
+void JitCompiler::emitSse(int prefix, int opcode, int reg, int address, int value)
+{
+	if (prefix) emitByte(prefix);
+	if (reg >= 8) emitByte(0x44);
+	emitByte(0x0f);
+	emitByte(opcode);
+	switch (address) {
+	case RaxAddress:
+		emitByte((reg & 7) << 3);
+		break;
+	case SampleAddress:
+		emitByte(0x04 | (reg & 7) << 3);
+		emitByte(0x98);
+		break;
+	case StackAddress:
+		emitByte(0x84 | (reg & 7) << 3);
+		emitByte(0x24);
+		emitInt(value);
+		break;
+	case ConstantAddress: {
+		// [rip + displacement], set by emitConstants()
+		emitByte(0x05 | (reg & 7) << 3);
+		ConstantFixup fixup;
+		fixup.position = m_buffer.size();
+		fixup.constant = value;
+		m_constantFixups.push_back(fixup);
+		emitInt(0);
+		break;
+	}
+	}
+}
+
+// an SSE instruction with a register and the constant in all lanes
+void JitCompiler::emitConstant(int opcode, int reg, float value)
+{
+	// 0 and -0 are different constants
+	int constant = 0;
+	while (constant < (int) m_constants.size() && memcmp(&m_constants[constant], &value, sizeof(value)) != 0) {
+		constant++;
+	}
+	if (constant == (int) m_constants.size()) m_constants.push_back(value);
+	emitSse(0, opcode, reg, ConstantAddress, constant);
+}
+
+// stores the constants after the code, aligned for the SSE instructions
+void JitCompiler::emitConstants()
+{
+	while (m_buffer.size() % 16) emitByte(0xcc);
+	size_t start = m_buffer.size();
+	for (int i = 0; i < (int) m_constants.size(); i++) {
+		uint32_t bits;
+		memcpy(&bits, &m_constants[i], sizeof(bits));
+		for (int j = 0; j < 4; j++) emitInt(bits);
+	}
+	for (int i = 0; i < (int) m_constantFixups.size(); i++) {
+		size_t position = m_constantFixups[i].position;
+		uint32_t displacement = start + 16 * m_constantFixups[i].constant - (position + 4);
+		memcpy(&m_buffer[position], &displacement, sizeof(displacement));
+	}
+}
+
+// Emits a jump with the condition code of the jcc opcode after 0x0f, or a jmp
+// for 0. Returns the position of the displacement, for setJumpTarget().
+size_t JitCompiler::emitJump(int opcode)
+{
+	if (opcode) {
+		emitByte(0x0f);
+		emitByte(opcode);
+	} else {
+		emitByte(0xe9);
+	}
+	size_t position = m_buffer.size();
+	emitInt(0);
+	return position;
+}
+
+// the jump goes to the next instruction which is emitted
+void JitCompiler::setJumpTarget(size_t jump)
+{
+	uint32_t displacement = m_buffer.size() - (jump + 4);
+	memcpy(&m_buffer[jump], &displacement, sizeof(displacement));
+}
+
+// x - x is NaN for infinity and NaN, and 0 for all finite values
+void JitCompiler::emitCheck(int reg)
+{
+	if (m_finite[reg]) return;
+	emitSse(0, SSE_MOVAPS_LOAD, JIT_TEMPORARY, reg);
+	emitSse(0, SSE_SUBPS, JIT_TEMPORARY, reg);
+	emitSse(0, SSE_CMPPS, JIT_TEMPORARY, JIT_TEMPORARY);
+	emitByte(CMP_UNORD);
+	emitSse(0, SSE_ORPS, JIT_ERRORS, JIT_TEMPORARY);
+	// the error is sticky, so the element doesn't need another check
+	m_finite[reg] = true;
+}
+
+// Calls the function of the instruction with the operand at the register
+// operand, which is replaced by the result. All registers are changed by the
+// function, so the stack elements and the errors are saved in the frame. The
+// scalar function calls the function of the instruction directly, with the
+// operands in xmm0 and xmm1 like a SIMD function, and broadcasts the result.
+void JitCompiler::emitCall(const Instruction* instruction, int depth, int operand, int lanes, int mode)
+{
+#ifdef JIT_AVAILABLE
+	uintptr_t function = mode == ScalarMode ? getScalarFunction(instruction) : getSimdFunction(instruction);
+	int saved = function ? operand : depth;
+	for (int i = 0; i < saved; i++) emitSse(0, SSE_MOVAPS_STORE, i, StackAddress, 16 * i);
+	emitSse(0, SSE_MOVAPS_STORE, JIT_ERRORS, StackAddress, 16 * JIT_STACK_REGISTERS);
+	if (function) {
+		if (instruction->opcode == WavetableOpcode) {
+			// mov rdi, wavetable
+			emitByte(0x48);
+			emitByte(0xbf);
+			emitPointer(instruction->wavetable);
+		}
+		// the operands are passed in xmm0 and xmm1, the result is returned in xmm0
+		bool twoArguments = instruction->opcode == PowerOpcode || instruction->opcode == TwoArgumentsFunctionOpcode;
+		if (operand != 0 && instruction->opcode != NoArgumentFunctionOpcode) {
+			emitSse(0, SSE_MOVAPS_LOAD, 0, operand);
+			if (twoArguments) emitSse(0, SSE_MOVAPS_LOAD, 1, operand + 1);
+		}
+		// mov rax, function; call rax
+		emitByte(0x48);
+		emitByte(0xb8);
+		emitPointer((const void*) function);
+		emitByte(0xff);
+		emitByte(0xd0);
+		if (mode == ScalarMode) {
+			emitSse(0, SSE_SHUFPS, 0, 0);
+			emitByte(0);
+		}
+		if (operand != 0) emitSse(0, SSE_MOVAPS_LOAD, operand, 0);
+	} else {
+		// mov rdi, instruction
+		emitByte(0x48);
+		emitByte(0xbf);
+		emitPointer(instruction);
+		// lea rsi, [rsp + 16 * operand]
+		emitByte(0x48);
+		emitByte(0x8d);
+		emitByte(0xb4);
+		emitByte(0x24);
+		emitInt(16 * operand);
+		// mov edx, lanes
+		emitByte(0xba);
+		emitInt(lanes);
+		// mov rax, callFunction; call rax
+		emitByte(0x48);
+		emitByte(0xb8);
+		emitPointer((const void*) (uintptr_t) callFunction);
+		emitByte(0xff);
+		emitByte(0xd0);
+		emitSse(0, SSE_MOVAPS_LOAD, operand, StackAddress, 16 * operand);
+	}
+	for (int i = 0; i < operand; i++) emitSse(0, SSE_MOVAPS_LOAD, i, StackAddress, 16 * i);
+	emitSse(0, SSE_MOVAPS_LOAD, JIT_ERRORS, StackAddress, 16 * JIT_STACK_REGISTERS);
+#endif
+}
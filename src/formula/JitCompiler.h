@@ -0,0 +1,112 @@
+/**
+ *
+ * Copyright (c) 2001, Frank Bu
+ *
+ * project: Formula
+ * version: $Revision: 1.3 $ $Name:  $
+ *
+ * JitCompiler class, compiles a linked program to x86-64 machine code.
+ */
+
+#ifndef JITCOMPILER_H
+#define JITCOMPILER_H
+
+#include "Evaluator.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+using namespace std;
+
+// The generated code calculates 4 samples with SSE instructions, the result is
+// stored at output and the error bits of the samples are returned.
+typedef int (*JitFunction)(int offset, float* output);
+
+// Compiles the program for the System V ABI of x86-64 (Linux and Mac OS X).
+// The stack elements are kept in the registers xmm0 to xmm13 and the
+// temporaries on the machine stack, the approximated math functions are called
+// with the SIMD functions of the block kernels. The code of eval() calls the
+// functions of the instructions, like the interpreter.
+// Programs with a deeper stack or with a state are not compiled and the
+// Evaluator uses the interpreter. The conditionals are compiled to jumps, so the samples of a
+// program with conditionals are calculated one by one.
+class JitCompiler
+{
+public:
+	JitCompiler();
+	~JitCompiler();
+	// returns false if the program can't be compiled; the code has the
+	// addresses of the instructions, variables and buffers, so the program
+	// must be compiled again when they change; the variables of the
+	// instructions are indices of variables and buffers, like for a BlockKernel
+	bool compile(const Program& program, const float* variables, const float* const* buffers);
+	void clear();
+	bool isCompiled() {
+		return m_code != NULL;
+	}
+	// returns true for a math error, like Evaluator::eval()
+	bool eval(float* result) {
+		float results[4];
+		int errors = m_scalarFunction(0, results);
+		*result = results[0];
+		return errors & 1;
+	}
+	// like a BlockKernel, returns the number of samples with a math error
+	int evalBlock(float* output, int count);
+	static bool isAvailable();
+
+private:
+	enum Modes {
+		// all variables are read from their address
+		ScalarMode,
+		// buffer variables are read for 4 samples at offset
+		BlockMode,
+		// buffer variables are read for 1 sample at offset, for the end of a block
+		SampleMode
+	};
+	enum Addresses {
+		RaxAddress,
+		SampleAddress,
+		StackAddress,
+		ConstantAddress
+	};
+	struct ConstantFixup {
+		size_t position;
+		int constant;
+	};
+	// an open conditional, the jump to the else branch or the end isn't set yet
+	struct Conditional {
+		size_t jump;
+		vector<bool> temporaryFinite;
+	};
+
+	bool emitFunction(const Program& program, const float* variables, const float* const* buffers, int mode);
+	void emitByte(int value);
+	void emitInt(uint32_t value);
+	void emitPointer(const void* pointer);
+	void emitSse(int prefix, int opcode, int reg, int rm);
+	void emitSse(int prefix, int opcode, int reg, int address, int displacement);
+	void emitConstant(int opcode, int reg, float value);
+	void emitConstants();
+	void emitCheck(int reg);
+	void emitCall(const Instruction* instruction, int depth, int operand, int lanes, int mode);
+	size_t emitJump(int opcode);
+	void setJumpTarget(size_t jump);
+
+	vector<unsigned char> m_buffer;
+	// the constants of the function, which are stored after the code
+	vector<float> m_constants;
+	vector<ConstantFixup> m_constantFixups;
+	// the stack elements which are known to be finite, or are already checked
+	bool m_finite[16];
+	vector<bool> m_temporaryFinite;
+	vector<Conditional> m_conditionals;
+	unsigned char* m_code;
+	size_t m_codeSize;
+	JitFunction m_scalarFunction;
+	JitFunction m_blockFunction;
+	JitFunction m_sampleFunction;
+};
+
+
+#endif
@@ -0,0 +1,268 @@
+/**
+ *
+ * Copyright (c) 2001, Frank Bu
+ *
+ * project: Formula
+ * version: $Revision: 1.3 $ $Name:  $
+ *
+ * Lanes classes, wrapping the SIMD instructions used by the block kernel
+ * and the approximated math functions.
+ *
+ * Only include this in a kernel source file. The kernel files are compiled
+ * with different instruction sets, so all classes are in an anonymous
+ * namespace and no function of them is shared with the rest of the program.
+ */
+
+#ifndef LANES_H
+#define LANES_H
+
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// A comparison result is 1 or 0, like the comparison operators of C.
+// For all classes: min() and max() return the second operand if one of them is
+// NaN and toInt() rounds to the nearest integer, like the SSE instructions.
+struct ScalarLanes
+{
+	typedef float Value;
+	typedef int Mask;
+	static const int Count = 1;
+	static Value load(const float* values) { return *values; }
+	static void store(float* values, Value value) { *values = value; }
+	static Value set(float value) { return value; }
+	static Value add(Value op1, Value op2) { return op1 + op2; }
+	static Value sub(Value op1, Value op2) { return op1 - op2; }
+	static Value mul(Value op1, Value op2) { return op1 * op2; }
+	static Value div(Value op1, Value op2) { return op1 / op2; }
+	static Value neg(Value op) { return -op; }
+	static Mask less(Value op1, Value op2) { return op1 < op2; }
+	static Mask greater(Value op1, Value op2) { return op1 > op2; }
+	static Mask lessEqual(Value op1, Value op2) { return op1 <= op2; }
+	static Mask greaterEqual(Value op1, Value op2) { return op1 >= op2; }
+	static Mask equal(Value op1, Value op2) { return op1 == op2; }
+	static Mask notEqual(Value op1, Value op2) { return op1 != op2; }
+	static Mask isTrue(Value op) { return op != 0.0f; }
+	static Mask andMask(Mask op1, Mask op2) { return op1 & op2; }
+	static Mask orMask(Mask op1, Mask op2) { return op1 | op2; }
+	static Mask notMask(Mask op) { return op ^ 1; }
+	static Mask noMask() { return 0; }
+	static Value select(Mask mask) { return mask ? 1.0f : 0.0f; }
+	static Mask isNonFinite(Value op) {
+		uint32_t bits;
+		memcpy(&bits, &op, sizeof(bits));
+		return (bits & 0x7f800000) == 0x7f800000;
+	}
+	static int getBits(Mask mask) { return mask; }
+
+	typedef int32_t Int;
+	static Value abs(Value op) { return fabsf(op); }
+	static Value min(Value op1, Value op2) { return op1 < op2 ? op1 : op2; }
+	static Value max(Value op1, Value op2) { return op1 > op2 ? op1 : op2; }
+	static Value blend(Mask mask, Value op1, Value op2) { return mask ? op1 : op2; }
+	static Value andBits(Value op1, Value op2) { return fromBits(toBits(op1) & toBits(op2)); }
+	static Value xorBits(Value op1, Value op2) { return fromBits(toBits(op1) ^ toBits(op2)); }
+	static Int toBits(Value op) {
+		Int bits;
+		memcpy(&bits, &op, sizeof(bits));
+		return bits;
+	}
+	static Value fromBits(Int bits) {
+		Value value;
+		memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+#if defined(__SSE2__)
+	static Int toInt(Value op) { return _mm_cvtss_si32(_mm_set_ss(op)); }
+#else
+	static Int toInt(Value op) { return lrintf(op); }
+#endif
+	static Value toValue(Int op) { return (Value) op; }
+	static Int setInt(int32_t value) { return value; }
+	static Int addInt(Int op1, Int op2) { return op1 + op2; }
+	static Int subInt(Int op1, Int op2) { return op1 - op2; }
+	static Int andInt(Int op1, Int op2) { return op1 & op2; }
+	static Int orInt(Int op1, Int op2) { return op1 | op2; }
+	static Int shiftLeft(Int op, int count) { return (uint32_t) op << count; }
+	static Int shiftRight(Int op, int count) { return op >> count; }
+};
+
+
+#if defined(__SSE2__)
+struct Sse2Lanes
+{
+	typedef __m128 Value;
+	typedef __m128 Mask;
+	static const int Count = 4;
+	static Value load(const float* values) { return _mm_loadu_ps(values); }
+	static void store(float* values, Value value) { _mm_storeu_ps(values, value); }
+	static Value set(float value) { return _mm_set1_ps(value); }
+	static Value add(Value op1, Value op2) { return _mm_add_ps(op1, op2); }
+	static Value sub(Value op1, Value op2) { return _mm_sub_ps(op1, op2); }
+	static Value mul(Value op1, Value op2) { return _mm_mul_ps(op1, op2); }
+	static Value div(Value op1, Value op2) { return _mm_div_ps(op1, op2); }
+	static Value neg(Value op) { return _mm_xor_ps(op, _mm_set1_ps(-0.0f)); }
+	static Mask less(Value op1, Value op2) { return _mm_cmplt_ps(op1, op2); }
+	static Mask greater(Value op1, Value op2) { return _mm_cmpgt_ps(op1, op2); }
+	static Mask lessEqual(Value op1, Value op2) { return _mm_cmple_ps(op1, op2); }
+	static Mask greaterEqual(Value op1, Value op2) { return _mm_cmpge_ps(op1, op2); }
+	static Mask equal(Value op1, Value op2) { return _mm_cmpeq_ps(op1, op2); }
+	static Mask notEqual(Value op1, Value op2) { return _mm_cmpneq_ps(op1, op2); }
+	static Mask isTrue(Value op) { return _mm_cmpneq_ps(op, _mm_setzero_ps()); }
+	static Mask andMask(Mask op1, Mask op2) { return _mm_and_ps(op1, op2); }
+	static Mask orMask(Mask op1, Mask op2) { return _mm_or_ps(op1, op2); }
+	static Mask notMask(Mask op) { return _mm_xor_ps(op, _mm_castsi128_ps(_mm_set1_epi32(-1))); }
+	static Mask noMask() { return _mm_setzero_ps(); }
+	static Value select(Mask mask) { return _mm_and_ps(mask, _mm_set1_ps(1.0f)); }
+	static Mask isNonFinite(Value op) {
+		// NaN is unordered, so it is not less or equal than FLT_MAX either
+		return _mm_cmpnle_ps(_mm_andnot_ps(_mm_set1_ps(-0.0f), op), _mm_set1_ps(FLT_MAX));
+	}
+	static int getBits(Mask mask) { return _mm_movemask_ps(mask); }
+
+	typedef __m128i Int;
+	static Value abs(Value op) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), op); }
+	static Value min(Value op1, Value op2) { return _mm_min_ps(op1, op2); }
+	static Value max(Value op1, Value op2) { return _mm_max_ps(op1, op2); }
+	static Value blend(Mask mask, Value op1, Value op2) {
+		return _mm_or_ps(_mm_and_ps(mask, op1), _mm_andnot_ps(mask, op2));
+	}
+	static Value andBits(Value op1, Value op2) { return _mm_and_ps(op1, op2); }
+	static Value xorBits(Value op1, Value op2) { return _mm_xor_ps(op1, op2); }
+	static Int toBits(Value op) { return _mm_castps_si128(op); }
+	static Value fromBits(Int bits) { return _mm_castsi128_ps(bits); }
+	static Int toInt(Value op) { return _mm_cvtps_epi32(op); }
+	static Value toValue(Int op) { return _mm_cvtepi32_ps(op); }
+	static Int setInt(int32_t value) { return _mm_set1_epi32(value); }
+	static Int addInt(Int op1, Int op2) { return _mm_add_epi32(op1, op2); }
+	static Int subInt(Int op1, Int op2) { return _mm_sub_epi32(op1, op2); }
+	static Int andInt(Int op1, Int op2) { return _mm_and_si128(op1, op2); }
+	static Int orInt(Int op1, Int op2) { return _mm_or_si128(op1, op2); }
+	static Int shiftLeft(Int op, int count) { return _mm_sll_epi32(op, _mm_cvtsi32_si128(count)); }
+	static Int shiftRight(Int op, int count) { return _mm_sra_epi32(op, _mm_cvtsi32_si128(count)); }
+};
+#endif
+
+
+#if defined(__AVX2__)
+struct Avx2Lanes
+{
+	typedef __m256 Value;
+	typedef __m256 Mask;
+	static const int Count = 8;
+	static Value load(const float* values) { return _mm256_loadu_ps(values); }
+	static void store(float* values, Value value) { _mm256_storeu_ps(values, value); }
+	static Value set(float value) { return _mm256_set1_ps(value); }
+	static Value add(Value op1, Value op2) { return _mm256_add_ps(op1, op2); }
+	static Value sub(Value op1, Value op2) { return _mm256_sub_ps(op1, op2); }
+	static Value mul(Value op1, Value op2) { return _mm256_mul_ps(op1, op2); }
+	static Value div(Value op1, Value op2) { return _mm256_div_ps(op1, op2); }
+	static Value neg(Value op) { return _mm256_xor_ps(op, _mm256_set1_ps(-0.0f)); }
+	static Mask less(Value op1, Value op2) { return _mm256_cmp_ps(op1, op2, _CMP_LT_OQ); }
+	static Mask greater(Value op1, Value op2) { return _mm256_cmp_ps(op1, op2, _CMP_GT_OQ); }
+	static Mask lessEqual(Value op1, Value op2) { return _mm256_cmp_ps(op1, op2, _CMP_LE_OQ); }
+	static Mask greaterEqual(Value op1, Value op2) { return _mm256_cmp_ps(op1, op2, _CMP_GE_OQ); }
+	static Mask equal(Value op1, Value op2) { return _mm256_cmp_ps(op1, op2, _CMP_EQ_OQ); }
+	static Mask notEqual(Value op1, Value op2) { return _mm256_cmp_ps(op1, op2, _CMP_NEQ_UQ); }
+	static Mask isTrue(Value op) { return _mm256_cmp_ps(op, _mm256_setzero_ps(), _CMP_NEQ_UQ); }
+	static Mask andMask(Mask op1, Mask op2) { return _mm256_and_ps(op1, op2); }
+	static Mask orMask(Mask op1, Mask op2) { return _mm256_or_ps(op1, op2); }
+	static Mask notMask(Mask op) { return _mm256_xor_ps(op, _mm256_castsi256_ps(_mm256_set1_epi32(-1))); }
+	static Mask noMask() { return _mm256_setzero_ps(); }
+	static Value select(Mask mask) { return _mm256_and_ps(mask, _mm256_set1_ps(1.0f)); }
+	static Mask isNonFinite(Value op) {
+		return _mm256_cmp_ps(_mm256_andnot_ps(_mm256_set1_ps(-0.0f), op), _mm256_set1_ps(FLT_MAX), _CMP_NLE_UQ);
+	}
+	static int getBits(Mask mask) { return _mm256_movemask_ps(mask); }
+
+	typedef __m256i Int;
+	static Value abs(Value op) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), op); }
+	static Value min(Value op1, Value op2) { return _mm256_min_ps(op1, op2); }
+	static Value max(Value op1, Value op2) { return _mm256_max_ps(op1, op2); }
+	static Value blend(Mask mask, Value op1, Value op2) { return _mm256_blendv_ps(op2, op1, mask); }
+	static Value andBits(Value op1, Value op2) { return _mm256_and_ps(op1, op2); }
+	static Value xorBits(Value op1, Value op2) { return _mm256_xor_ps(op1, op2); }
+	static Int toBits(Value op) { return _mm256_castps_si256(op); }
+	static Value fromBits(Int bits) { return _mm256_castsi256_ps(bits); }
+	static Int toInt(Value op) { return _mm256_cvtps_epi32(op); }
+	static Value toValue(Int op) { return _mm256_cvtepi32_ps(op); }
+	static Int setInt(int32_t value) { return _mm256_set1_epi32(value); }
+	static Int addInt(Int op1, Int op2) { return _mm256_add_epi32(op1, op2); }
+	static Int subInt(Int op1, Int op2) { return _mm256_sub_epi32(op1, op2); }
+	static Int andInt(Int op1, Int op2) { return _mm256_and_si256(op1, op2); }
+	static Int orInt(Int op1, Int op2) { return _mm256_or_si256(op1, op2); }
+	static Int shiftLeft(Int op, int count) { return _mm256_sll_epi32(op, _mm_cvtsi32_si128(count)); }
+	static Int shiftRight(Int op, int count) { return _mm256_sra_epi32(op, _mm_cvtsi32_si128(count)); }
+};
+#endif
+
+
+#if defined(__AVX512F__)
+struct Avx512Lanes
+{
+	typedef __m512 Value;
+	typedef __mmask16 Mask;
+	static const int Count = 16;
+	static Value load(const float* values) { return _mm512_loadu_ps(values); }
+	static void store(float* values, Value value) { _mm512_storeu_ps(values, value); }
+	static Value set(float value) { return _mm512_set1_ps(value); }
+	static Value add(Value op1, Value op2) { return _mm512_add_ps(op1, op2); }
+	static Value sub(Value op1, Value op2) { return _mm512_sub_ps(op1, op2); }
+	static Value mul(Value op1, Value op2) { return _mm512_mul_ps(op1, op2); }
+	static Value div(Value op1, Value op2) { return _mm512_div_ps(op1, op2); }
+	static Value neg(Value op) {
+		return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(op), _mm512_set1_epi32(0x80000000)));
+	}
+	static Mask less(Value op1, Value op2) { return _mm512_cmp_ps_mask(op1, op2, _CMP_LT_OQ); }
+	static Mask greater(Value op1, Value op2) { return _mm512_cmp_ps_mask(op1, op2, _CMP_GT_OQ); }
+	static Mask lessEqual(Value op1, Value op2) { return _mm512_cmp_ps_mask(op1, op2, _CMP_LE_OQ); }
+	static Mask greaterEqual(Value op1, Value op2) { return _mm512_cmp_ps_mask(op1, op2, _CMP_GE_OQ); }
+	static Mask equal(Value op1, Value op2) { return _mm512_cmp_ps_mask(op1, op2, _CMP_EQ_OQ); }
+	static Mask notEqual(Value op1, Value op2) { return _mm512_cmp_ps_mask(op1, op2, _CMP_NEQ_UQ); }
+	static Mask isTrue(Value op) { return _mm512_cmp_ps_mask(op, _mm512_setzero_ps(), _CMP_NEQ_UQ); }
+	static Mask andMask(Mask op1, Mask op2) { return op1 & op2; }
+	static Mask orMask(Mask op1, Mask op2) { return op1 | op2; }
+	static Mask notMask(Mask op) { return ~op; }
+	static Mask noMask() { return 0; }
+	static Value select(Mask mask) { return _mm512_maskz_mov_ps(mask, _mm512_set1_ps(1.0f)); }
+	static Mask isNonFinite(Value op) {
+		return _mm512_cmp_ps_mask(_mm512_abs_ps(op), _mm512_set1_ps(FLT_MAX), _CMP_NLE_UQ);
+	}
+	static int getBits(Mask mask) { return mask; }
+
+	typedef __m512i Int;
+	static Value abs(Value op) { return _mm512_abs_ps(op); }
+	static Value min(Value op1, Value op2) { return _mm512_min_ps(op1, op2); }
+	static Value max(Value op1, Value op2) { return _mm512_max_ps(op1, op2); }
+	static Value blend(Mask mask, Value op1, Value op2) { return _mm512_mask_blend_ps(mask, op2, op1); }
+	static Value andBits(Value op1, Value op2) {
+		return _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(op1), _mm512_castps_si512(op2)));
+	}
+	static Value xorBits(Value op1, Value op2) {
+		return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(op1), _mm512_castps_si512(op2)));
+	}
+	static Int toBits(Value op) { return _mm512_castps_si512(op); }
+	static Value fromBits(Int bits) { return _mm512_castsi512_ps(bits); }
+	static Int toInt(Value op) { return _mm512_cvtps_epi32(op); }
+	static Value toValue(Int op) { return _mm512_cvtepi32_ps(op); }
+	static Int setInt(int32_t value) { return _mm512_set1_epi32(value); }
+	static Int addInt(Int op1, Int op2) { return _mm512_add_epi32(op1, op2); }
+	static Int subInt(Int op1, Int op2) { return _mm512_sub_epi32(op1, op2); }
+	static Int andInt(Int op1, Int op2) { return _mm512_and_si512(op1, op2); }
+	static Int orInt(Int op1, Int op2) { return _mm512_or_si512(op1, op2); }
+	static Int shiftLeft(Int op, int count) { return _mm512_sll_epi32(op, _mm_cvtsi32_si128(count)); }
+	static Int shiftRight(Int op, int count) { return _mm512_sra_epi32(op, _mm_cvtsi32_si128(count)); }
+};
+#endif
+
+}
+
+
+#endif
@@ -0,0 +1,84 @@
+/**
+ *
+ * Copyright (c) 2001, Frank Bu
+ *
+ * project: Formula
+ * version: $Revision: 1.3 $ $Name:  $
+ *
+ * Built-in math functions with selectable accuracy.
+ */
+
+#include "FastMath.h"
+
+#include <math.h>
+#include <stddef.h>
+
+
+template<int Accuracy>
+struct ScalarMath
+{
+	typedef FastMath<ScalarLanes, Accuracy> Math;
+	static float sin(float x) { return Math::sin(x); }
+	static float cos(float x) { return Math::cos(x); }
+	static float tan(float x) { return Math::tan(x); }
+	static float exp(float x) { return Math::exp(x); }
+	static float log(float x) { return Math::log(x); }
+	static float log2(float x) { return Math::log2(x); }
+	static float log10(float x) { return Math::log10(x); }
+	static float sinh(float x) { return Math::sinh(x); }
+	static float cosh(float x) { return Math::cosh(x); }
+	static float tanh(float x) { return Math::tanh(x); }
+	static float pow(float x, float y) { return Math::pow(x, y); }
+
+	static OneArgumentFunction getFunction(int mathFunction) {
+		switch (mathFunction) {
+		case SinMathFunction: return sin;
+		case CosMathFunction: return cos;
+		case TanMathFunction: return tan;
+		case ExpMathFunction: return exp;
+		case LogMathFunction: return log;
+		case Log2MathFunction: return log2;
+		case Log10MathFunction: return log10;
+		case SinhMathFunction: return sinh;
+		case CoshMathFunction: return cosh;
+		case TanhMathFunction: return tanh;
+		}
+		return NULL;
+	}
+};
+
+static OneArgumentFunction getExactFunction(int mathFunction)
+{
+	switch (mathFunction) {
+	case SinMathFunction: return sinf;
+	case CosMathFunction: return cosf;
+	case TanMathFunction: return tanf;
+	case ExpMathFunction: return expf;
+	case LogMathFunction: return logf;
+	case Log2MathFunction: return log2f;
+	case Log10MathFunction: return log10f;
+	case SinhMathFunction: return sinhf;
+	case CoshMathFunction: return coshf;
+	case TanhMathFunction: return tanhf;
+	}
+	return NULL;
+}
+
+OneArgumentFunction getOneArgumentMathFunction(int mathFunction, int mathAccuracy)
+{
+	switch (mathAccuracy) {
+	case AudioMathAccuracy: return ScalarMath<AudioMathAccuracy>::getFunction(mathFunction);
+	case FastMathAccuracy: return ScalarMath<FastMathAccuracy>::getFunction(mathFunction);
+	}
+	return getExactFunction(mathFunction);
+}
+
+TwoArgumentsFunction getTwoArgumentsMathFunction(int mathFunction, int mathAccuracy)
+{
+	if (mathFunction != PowMathFunction) return NULL;
+	switch (mathAccuracy) {
+	case AudioMathAccuracy: return ScalarMath<AudioMathAccuracy>::pow;
+	case FastMathAccuracy: return ScalarMath<FastMathAccuracy>::pow;
+	}
+	return powf;
+}
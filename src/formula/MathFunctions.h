@@ -0,0 +1,51 @@
+/**
+ *
+ * Copyright (c) 2001, Frank Bu
+ *
+ * project: Formula
+ * version: $Revision: 1.3 $ $Name:  $
+ *
+ * Built-in math functions with selectable accuracy.
+ */
+
+#ifndef MATHFUNCTIONS_H
+#define MATHFUNCTIONS_H
+
+typedef float(*NoArgumentFunction)();
+typedef float(*OneArgumentFunction)(float);
+typedef float(*TwoArgumentsFunction)(float, float);
+
+// Exact uses the functions of the C library. The others are polynomial
+// approximations, which evalBlock() calculates with SIMD instructions. The
+// error is about 1e-6 for Audio and 1e-4 for Fast, relative to the result for
+// tan, exp, pow, sinh and cosh. The arguments of sin, cos and tan should be
+// less than 1e5, the precision is lost for larger arguments.
+enum MathAccuracies {
+	ExactMathAccuracy,
+	AudioMathAccuracy,
+	FastMathAccuracy
+};
+
+// the built-in functions which are approximated
+enum MathFunctions {
+	NoMathFunction,
+	SinMathFunction,
+	CosMathFunction,
+	TanMathFunction,
+	ExpMathFunction,
+	LogMathFunction,
+	Log2MathFunction,
+	Log10MathFunction,
+	SinhMathFunction,
+	CoshMathFunction,
+	TanhMathFunction,
+	PowMathFunction
+};
+
+// returns the scalar implementation of a math function, NULL if the function
+// has a different number of arguments
+OneArgumentFunction getOneArgumentMathFunction(int mathFunction, int mathAccuracy);
+TwoArgumentsFunction getTwoArgumentsMathFunction(int mathFunction, int mathAccuracy);
+
+
+#endif
@@ -0,0 +1,920 @@
+/**
+ *
+ * Copyright (c) 2001, Frank Bu
+ *
+ * project: Formula
+ * version: $Revision: 1.3 $ $Name:  $
+ *
+ * Optimizer class, folds constants, simplifies the compiled program,
+ * calculates common subexpressions once, replaces subexpressions of the
+ * phase by wavetables and moves subexpressions of the control variables out
+ * of the program.
+ *
+ * The program is rebuilt instruction by instruction. For every value on the
+ * stack the start of the instructions calculating it is recorded, so the
+ * operands of an operator are known when the operator is added.
+ * Only calculations which give exactly the same result at runtime are folded,
+ * everything which would raise a MathError is left to the evaluator.
+ *
+ * Then the folded program is converted to a graph, where equal pure
+ * subexpressions are the same node, and converted back to a program which
+ * stores the nodes used more than once in temporaries. The jumps of the
+ * conditionals are relative, so they stay valid when instructions before or
+ * after a conditional are removed.
+ *
+ * Before it is converted back, the largest subexpressions which depend only
+ * on the wavetable variable are rendered with an Evaluator for one period.
+ * If the wavetable gives the same values, the node is replaced by a
+ * WavetableOpcode node, so that e.g. a sum of sines of the phase is one read.
+ * The largest subexpressions which depend only on control variables are moved
+ * to the control values, and replaced by their hidden variables.
+ *
+ * The local variables of the statements before the last one are temporaries
+ * of the program. Their Loads are replaced by the nodes of their values, so
+ * they are merged like the other subexpressions. A statement which calls an
+ * impure function is calculated before the result, in the order of the
+ * statements, even if its variable is not used.
+ *
+ * The delays and the stateful functions in a conditional are moved before it
+ * first, so that their states are updated for every sample.
+ */
+
+#include "Optimizer.h"
+
+#include <string.h>
+
+using namespace std;
+
+
+// the flags of a node for the wavetables and the control values
+enum NodeFlags {
+	ClassifiedFlag = 1,
+	// the node depends only on the wavetable variable and numbers
+	PhaseOnlyFlag = 2,
+	UsesPhaseFlag = 4,
+	// the node and its operands call at least one or two functions
+	FunctionFlag = 8,
+	FunctionsFlag = 16,
+	// the node depends only on the control variables and numbers
+	ControlOnlyFlag = 32,
+	UsesControlFlag = 64,
+	// addWavetables() or addControlValues() was called for the node
+	VisitedFlag = 128,
+	ControlVisitedFlag = 256
+};
+
+// the power is calculated with the function of the instruction, so the folded
+// value is the same as the value of the selected math accuracy at runtime
+static bool calculate(const Instruction& instruction, float op1, float op2, float& result)
+{
+	switch (instruction.opcode) {
+	case AddOpcode: result = op1 + op2; break;
+	case SubOpcode: result = op1 - op2; break;
+	case MulOpcode: result = op1 * op2; break;
+	case DivOpcode:
+		if (op2 == 0.0f) return false;
+		result = op1 / op2;
+		break;
+	case PowerOpcode: result = instruction.twoArgumentsFunction(op1, op2); break;
+	case NegOpcode: result = -op1; break;
+	case LessOpcode: result = op1 < op2; break;
+	case GreaterOpcode: result = op1 > op2; break;
+	case LessEqualOpcode: result = op1 <= op2; break;
+	case GreaterEqualOpcode: result = op1 >= op2; break;
+	case EqualOpcode: result = op1 == op2; break;
+	case NotEqualOpcode: result = op1 != op2; break;
+	case AndOpcode: result = op1 && op2; break;
+	case OrOpcode: result = op1 || op2; break;
+	case NotOpcode: result = !op1; break;
+	default: return false;
+	}
+	return isfinite(result);
+}
+
+vector<Instruction> Optimizer::optimize(const vector<Instruction>& instructions)
+{
+	m_program.clear();
+	m_program.reserve(instructions.size());
+	m_starts.clear();
+	m_conditionals.clear();
+	m_temporaryValues.clear();
+	m_wavetables.clear();
+	m_controlValues.clear();
+	// the temporaries of the program, if it is not optimized
+	m_temporaryCount = 0;
+	for (int i = 0; i < (int) instructions.size(); i++) {
+		const Instruction& instruction = instructions[i];
+		if ((instruction.opcode == StoreOpcode || instruction.opcode == LoadOpcode) && instruction.temporary >= m_temporaryCount) {
+			m_temporaryCount = instruction.temporary + 1;
+		}
+	}
+	const vector<Instruction> program = moveStates(instructions);
+	for (int i = 0; i < (int) program.size(); i++) {
+		const Instruction& instruction = program[i];
+		switch (instruction.opcode) {
+		case JumpIfFalseOpcode:
+		case JumpOpcode:
+		case JoinOpcode:
+			if (!conditional(instruction)) return program;
+			break;
+		case NumberOpcode:
+		case VariableOpcode:
+		case NoArgumentFunctionOpcode:
+		case OutputOpcode:
+			push(instruction);
+			break;
+		case NegOpcode:
+		case NotOpcode:
+			unaryOperator(instruction);
+			break;
+		case OneArgumentFunctionOpcode:
+		case WavetableOpcode:
+			if (m_starts.size() < 1) return program;
+			m_program.push_back(instruction);
+			break;
+		case TwoArgumentsFunctionOpcode:
+			if (m_starts.size() < 2) return program;
+			m_starts.pop_back();
+			m_program.push_back(instruction);
+			break;
+		case DelayOpcode:
+			if (m_starts.size() < 2) return program;
+			m_program.push_back(instruction);
+			// the ring buffer of a delay which is folded to a number is only as
+			// long as the delay
+			if (isNumber(m_starts.back(), m_program.size() - 1)) {
+				m_program.back().ring.length = getDelaySamples(m_program[m_starts.back()].value, MAX_DELAY + 1) + 1;
+			}
+			m_starts.pop_back();
+			break;
+		case StatefulFunctionOpcode: {
+			int argumentCount = instruction.statefulFunction->argumentCount;
+			if (argumentCount < 1 || (int) m_starts.size() < argumentCount) return program;
+			m_starts.resize(m_starts.size() - (argumentCount - 1));
+			m_program.push_back(instruction);
+			break;
+		}
+		case StoreOpcode:
+			if (m_starts.empty() || instruction.temporary < 0) return program;
+			store(instruction);
+			break;
+		case LoadOpcode:
+			if (instruction.temporary >= 0 && instruction.temporary < (int) m_temporaryValues.size()) {
+				push(m_temporaryValues[instruction.temporary]);
+			} else {
+				push(instruction);
+			}
+			break;
+		case PopOpcode:
+			if (!pop(instruction)) return program;
+			continue;
+		default:
+			binaryOperator(instruction);
+		}
+		// a malformed program is not optimized, the evaluator reports the error
+		if (m_starts.empty() && m_conditionals.empty()) return program;
+	}
+	if (m_conditionals.size() > 0) return program;
+	return mergeSubexpressions(m_program);
+}
+
+// Moves the delays and the stateful functions in the branches of the
+// conditionals before the outermost conditional. The instruction is
+// calculated with its operands like a statement, stored in a new temporary
+// and loaded in the branch; mergeSubexpressions() calculates the impure
+// statement before the result. An instruction with operands which can't be
+// moved stays in the branch, the parser doesn't add it.
+vector<Instruction> Optimizer::moveStates(const vector<Instruction>& program)
+{
+	vector<Instruction> moved;
+	moved.reserve(program.size());
+	// the JumpIfFalse of the outermost open conditional
+	int outermost = -1;
+	int nesting = 0;
+	bool changed = false;
+	for (int i = 0; i < (int) program.size(); i++) {
+		moved.push_back(program[i]);
+		switch (program[i].opcode) {
+		case JumpIfFalseOpcode:
+			if (nesting++ == 0) outermost = moved.size() - 1;
+			break;
+		case JoinOpcode:
+			nesting--;
+			break;
+		case DelayOpcode:
+		case StatefulFunctionOpcode: {
+			if (nesting <= 0) break;
+			int start = findMovableOperands(moved, moved.size() - 1);
+			if (start < 0) break;
+			Instruction store = Instruction();
+			store.opcode = StoreOpcode;
+			store.pure = true;
+			store.temporary = m_temporaryCount++;
+			Instruction pop = store;
+			pop.opcode = PopOpcode;
+			Instruction load = store;
+			load.opcode = LoadOpcode;
+			vector<Instruction> statement(moved.begin() + start, moved.end());
+			statement.push_back(store);
+			statement.push_back(pop);
+			moved.resize(start);
+			moved.push_back(load);
+			moved.insert(moved.begin() + outermost, statement.begin(), statement.end());
+			outermost += statement.size();
+			changed = true;
+			break;
+		}
+		}
+	}
+	if (!changed) return program;
+
+	// the jumps are set again, like by the parser
+	vector<int> jumps;
+	for (int i = 0; i < (int) moved.size(); i++) {
+		switch (moved[i].opcode) {
+		case JumpIfFalseOpcode:
+			jumps.push_back(i);
+			break;
+		case JumpOpcode:
+		case JoinOpcode:
+			if (jumps.empty()) return program;
+			moved[jumps.back()].jump = i + 1 - jumps.back();
+			if (moved[i].opcode == JumpOpcode) {
+				jumps.back() = i;
+			} else {
+				jumps.pop_back();
+			}
+			break;
+		}
+	}
+	return moved;
+}
+
+int Optimizer::findMovableOperands(const vector<Instruction>& program, int index)
+{
+	const Instruction& state = program[index];
+	int values = state.opcode == DelayOpcode ? 2 : state.statefulFunction->argumentCount;
+	for (int i = index - 1; i >= 0; i--) {
+		const Instruction& instruction = program[i];
+		switch (instruction.opcode) {
+		case StoreOpcode:
+			continue;
+		case LoadOpcode:
+			values--;
+			break;
+		case PopOpcode:
+		case JumpIfFalseOpcode:
+		case JumpOpcode:
+		case JoinOpcode:
+			return -1;
+		case NoArgumentFunctionOpcode:
+		case OneArgumentFunctionOpcode:
+		case TwoArgumentsFunctionOpcode:
+			if (!instruction.pure) return -1;
+			values += getOperandCount(instruction) - 1;
+			break;
+		default:
+			values += getOperandCount(instruction) - 1;
+		}
+		if (values == 0) return i;
+	}
+	return -1;
+}
+
+// The uses are counted from the result, the order of the impure functions
+// doesn't change, because every call is a node of its own.
+vector<Instruction> Optimizer::mergeSubexpressions(const vector<Instruction>& program)
+{
+	m_nodes.clear();
+	m_nodes.reserve(program.size());
+	// at most half of the slots are used
+	int tableSize = 16;
+	while (tableSize < 2 * (int) program.size()) tableSize *= 2;
+	m_nodeTable.assign(tableSize, -1);
+	m_storedNodes.clear();
+	vector<int> stack;
+	stack.reserve(program.size());
+	// the node of every temporary, -1 before it is stored
+	vector<int> temporaries(m_temporaryCount, -1);
+	// the statements which call impure functions, and the result
+	vector<int> roots;
+	for (int i = 0; i < (int) program.size(); i++) {
+		const Instruction& instruction = program[i];
+		switch (instruction.opcode) {
+		// the condition and the then branch stay on the stack until the Join
+		case JumpIfFalseOpcode:
+		case JumpOpcode:
+			continue;
+		case StoreOpcode:
+			if (stack.empty() || instruction.temporary >= (int) temporaries.size()) return program;
+			temporaries[instruction.temporary] = stack.back();
+			continue;
+		case LoadOpcode:
+			if (instruction.temporary >= (int) temporaries.size() || temporaries[instruction.temporary] < 0) return program;
+			stack.push_back(temporaries[instruction.temporary]);
+			continue;
+		case PopOpcode:
+			if (stack.empty()) return program;
+			if (m_nodes[stack.back()].impure) roots.push_back(stack.back());
+			stack.pop_back();
+			continue;
+		}
+		Node node;
+		node.instruction = instruction;
+		node.operandCount = getOperandCount(instruction);
+		node.uses = 0;
+		node.temporary = -1;
+		node.impure = !instruction.pure;
+		if ((int) stack.size() < node.operandCount) return program;
+		for (int j = node.operandCount - 1; j >= 0; j--) {
+			node.operands[j] = stack.back();
+			node.impure = node.impure || m_nodes[node.operands[j]].impure;
+			stack.pop_back();
+		}
+		m_nodes.push_back(node);
+		int index = m_nodes.size() - 1;
+		if (instruction.pure) {
+			index = findNode(index);
+			if (index != (int) m_nodes.size() - 1) m_nodes.pop_back();
+		}
+		stack.push_back(index);
+	}
+	if (stack.size() != 1) return program;
+
+	roots.push_back(stack[0]);
+	bool control = false;
+	for (int i = 0; i < (int) m_controlVariables.size(); i++) control = control || m_controlVariables[i];
+	if (m_wavetableVariable >= 0 || control) {
+		m_nodeFlags.assign(m_nodes.size(), 0);
+		for (int i = 0; i < (int) roots.size(); i++) {
+			classifyNode(roots[i]);
+			if (m_wavetableVariable >= 0) addWavetables(roots[i]);
+			if (control) addControlValues(roots[i]);
+		}
+	}
+
+	for (int i = 0; i < (int) roots.size(); i++) countUses(roots[i]);
+	m_program.clear();
+	m_temporaryCount = 0;
+	Instruction pop = Instruction();
+	pop.opcode = PopOpcode;
+	pop.pure = true;
+	for (int i = 0; i < (int) roots.size() - 1; i++) {
+		emitNode(roots[i]);
+		m_program.push_back(pop);
+	}
+	emitNode(roots.back());
+	return m_program;
+}
+
+// returns an equal node which was added before, or adds the node to the table
+int Optimizer::findNode(int node)
+{
+	const Node& current = m_nodes[node];
+	uint64_t hash = current.instruction.opcode;
+	hash = hash * 31 + current.instruction.mathFunction;
+	hash = hash * 31 + current.instruction.mathAccuracy;
+	hash = hash * 31 + getOperand(current.instruction);
+	for (int i = 0; i < current.operandCount; i++) hash = hash * 31 + current.operands[i];
+	hash ^= hash >> 29;
+	hash *= 0xbf58476d1ce4e5b9ULL;
+	hash ^= hash >> 32;
+
+	int mask = m_nodeTable.size() - 1;
+	for (int slot = hash & mask; ; slot = (slot + 1) & mask) {
+		int other = m_nodeTable[slot];
+		if (other < 0) {
+			m_nodeTable[slot] = node;
+			return node;
+		}
+		if (isEqual(m_nodes[other], current)) return other;
+	}
+}
+
+bool Optimizer::isEqual(const Node& node1, const Node& node2)
+{
+	if (node1.instruction.opcode != node2.instruction.opcode
+	        || node1.instruction.mathFunction != node2.instruction.mathFunction
+	        || node1.instruction.mathAccuracy != node2.instruction.mathAccuracy
+	        || getOperand(node1.instruction) != getOperand(node2.instruction))
+	{
+		return false;
+	}
+	for (int i = 0; i < node1.operandCount; i++) {
+		if (node1.operands[i] != node2.operands[i]) return false;
+	}
+	return true;
+}
+
+void Optimizer::countUses(int node)
+{
+	// the operands are calculated at the first use only
+	if (m_nodes[node].uses++ > 0) return;
+	for (int i = 0; i < m_nodes[node].operandCount; i++) countUses(m_nodes[node].operands[i]);
+}
+
+void Optimizer::emitNode(int node)
+{
+	Node& current = m_nodes[node];
+	Instruction instruction = Instruction();
+	instruction.pure = true;
+	if (current.temporary >= 0) {
+		instruction.opcode = LoadOpcode;
+		instruction.temporary = current.temporary;
+		m_program.push_back(instruction);
+		return;
+	}
+	if (current.instruction.opcode == JoinOpcode) {
+		emitNode(current.operands[0]);
+		int condition = emitJump(JumpIfFalseOpcode);
+		emitBranch(current.operands[1]);
+		int jump = emitJump(JumpOpcode);
+		m_program[condition].jump = m_program.size() - condition;
+		emitBranch(current.operands[2]);
+		m_program.push_back(current.instruction);
+		m_program[jump].jump = m_program.size() - jump;
+	} else {
+		for (int i = 0; i < current.operandCount; i++) emitNode(current.operands[i]);
+		m_program.push_back(current.instruction);
+	}
+	// numbers and variables are pushed as fast as a temporary
+	if (current.uses > 1 && current.instruction.opcode != NumberOpcode
+	        && current.instruction.opcode != VariableOpcode)
+	{
+		current.temporary = m_temporaryCount++;
+		m_storedNodes.push_back(node);
+		instruction.opcode = StoreOpcode;
+		instruction.temporary = current.temporary;
+		m_program.push_back(instruction);
+	}
+}
+
+// A temporary which is stored in a branch is not set if the branch is skipped,
+// so the nodes stored in it are calculated again after the branch.
+void Optimizer::emitBranch(int node)
+{
+	int stored = m_storedNodes.size();
+	emitNode(node);
+	for (int i = stored; i < (int) m_storedNodes.size(); i++) m_nodes[m_storedNodes[i]].temporary = -1;
+	m_storedNodes.resize(stored);
+}
+
+// adds a jump, the target is set by the caller
+int Optimizer::emitJump(Opcode opcode)
+{
+	Instruction instruction = Instruction();
+	instruction.opcode = opcode;
+	instruction.pure = true;
+	m_program.push_back(instruction);
+	return m_program.size() - 1;
+}
+
+// returns the NodeFlags of the node
+int Optimizer::classifyNode(int node)
+{
+	if (m_nodeFlags[node] & ClassifiedFlag) return m_nodeFlags[node];
+	const Node& current = m_nodes[node];
+	int flags = ClassifiedFlag | PhaseOnlyFlag | ControlOnlyFlag;
+	int functions = 0;
+	switch (current.instruction.opcode) {
+	case VariableOpcode: {
+		int variable = current.instruction.variable;
+		if (variable == m_wavetableVariable) {
+			flags |= UsesPhaseFlag;
+		} else {
+			flags &= ~PhaseOnlyFlag;
+		}
+		if (variable < (int) m_controlVariables.size() && m_controlVariables[variable]) {
+			flags |= UsesControlFlag;
+		} else {
+			flags &= ~ControlOnlyFlag;
+		}
+		break;
+	}
+	case NoArgumentFunctionOpcode:
+	case OneArgumentFunctionOpcode:
+	case TwoArgumentsFunctionOpcode:
+	case PowerOpcode:
+		functions++;
+		if (!current.instruction.pure) flags &= ~(PhaseOnlyFlag | ControlOnlyFlag);
+		break;
+	// the state changes with every sample
+	case DelayOpcode:
+	case OutputOpcode:
+	case StatefulFunctionOpcode:
+		flags &= ~(PhaseOnlyFlag | ControlOnlyFlag);
+		break;
+	}
+	for (int i = 0; i < current.operandCount; i++) {
+		int operandFlags = classifyNode(current.operands[i]);
+		flags &= operandFlags | ~(PhaseOnlyFlag | ControlOnlyFlag);
+		flags |= operandFlags & (UsesPhaseFlag | UsesControlFlag);
+		if (operandFlags & FunctionsFlag) {
+			functions += 2;
+		} else if (operandFlags & FunctionFlag) {
+			functions++;
+		}
+	}
+	if (functions > 0) flags |= FunctionFlag;
+	if (functions > 1) flags |= FunctionsFlag;
+	m_nodeFlags[node] = flags;
+	return flags;
+}
+
+// Replaces the largest subexpressions of the phase which call more than one
+// function by wavetables, a single function is about as fast as reading the
+// wavetable. If a subexpression can't be replaced, its operands are tried.
+void Optimizer::addWavetables(int node)
+{
+	if (m_nodeFlags[node] & VisitedFlag) return;
+	m_nodeFlags[node] |= VisitedFlag;
+	const int required = PhaseOnlyFlag | UsesPhaseFlag | FunctionsFlag;
+	if ((m_nodeFlags[node] & required) == required) {
+		shared_ptr<const Wavetable> wavetable = renderWavetable(node);
+		if (wavetable) {
+			Node phase = Node();
+			phase.instruction.opcode = VariableOpcode;
+			phase.instruction.variable = m_wavetableVariable;
+			phase.instruction.pure = true;
+			phase.temporary = -1;
+			m_nodes.push_back(phase);
+			m_nodeFlags.push_back(ClassifiedFlag | VisitedFlag);
+
+			Node& current = m_nodes[node];
+			current.instruction = Instruction();
+			current.instruction.opcode = WavetableOpcode;
+			current.instruction.pure = true;
+			current.instruction.wavetable = wavetable.get();
+			current.operands[0] = m_nodes.size() - 1;
+			current.operandCount = 1;
+			m_wavetables.push_back(wavetable);
+			return;
+		}
+	}
+	for (int i = 0; i < m_nodes[node].operandCount; i++) addWavetables(m_nodes[node].operands[i]);
+}
+
+// Moves the largest subexpressions of the control variables to the control
+// values. A subexpression in a branch of a conditional is calculated even if
+// the branch is not taken, but a math error is only an error where it is used.
+void Optimizer::addControlValues(int node)
+{
+	if (m_nodeFlags[node] & ControlVisitedFlag) return;
+	m_nodeFlags[node] |= ControlVisitedFlag;
+	const int required = ControlOnlyFlag | UsesControlFlag;
+	if ((m_nodeFlags[node] & required) == required && m_nodes[node].instruction.opcode != VariableOpcode) {
+		ControlValue control;
+		emitTree(node, control.instructions);
+		control.variable = m_controlVariables.size() + m_controlValues.size();
+		m_controlValues.push_back(control);
+
+		Node& current = m_nodes[node];
+		current.instruction = Instruction();
+		current.instruction.opcode = VariableOpcode;
+		current.instruction.pure = true;
+		current.instruction.variable = control.variable;
+		current.operandCount = 0;
+		return;
+	}
+	for (int i = 0; i < m_nodes[node].operandCount; i++) addControlValues(m_nodes[node].operands[i]);
+}
+
+// emits the subexpression without temporaries
+void Optimizer::emitTree(int node, vector<Instruction>& program)
+{
+	const Node& current = m_nodes[node];
+	if (current.instruction.opcode == JoinOpcode) {
+		Instruction jump = Instruction();
+		jump.pure = true;
+		emitTree(current.operands[0], program);
+		int condition = program.size();
+		jump.opcode = JumpIfFalseOpcode;
+		program.push_back(jump);
+		emitTree(current.operands[1], program);
+		int end = program.size();
+		jump.opcode = JumpOpcode;
+		program.push_back(jump);
+		program[condition].jump = program.size() - condition;
+		emitTree(current.operands[2], program);
+		program.push_back(current.instruction);
+		program[end].jump = program.size() - end;
+		return;
+	}
+	for (int i = 0; i < current.operandCount; i++) emitTree(current.operands[i], program);
+	program.push_back(current.instruction);
+}
+
+// Calculates the subexpression for one period, for the next period to check
+// that it is periodic and between the samples to check the interpolation.
+// Returns NULL if a value is different or a math error.
+shared_ptr<const Wavetable> Optimizer::renderWavetable(int node)
+{
+	shared_ptr<Program> program(new Program());
+	emitTree(node, program->instructions);
+	// the wavetable variable is the only one
+	for (int i = 0; i < (int) program->instructions.size(); i++) {
+		if (program->instructions[i].opcode == VariableOpcode) program->instructions[i].variable = 0;
+	}
+	program->variableNames.push_back("phase");
+	Evaluator evaluator;
+	evaluator.setVariable("phase", 0.0f);
+	evaluator.setProgram(program);
+	evaluator.link();
+
+	const int size = WAVETABLE_SIZE;
+	vector<float> phases(3 * size);
+	vector<float> values(3 * size);
+	for (int i = 0; i < size; i++) {
+		phases[i] = float(i) / size;
+		phases[size + i] = phases[i] + 1.0f;
+		phases[2 * size + i] = (i + 0.5f) / size;
+	}
+	evaluator.setVariableBuffer("phase", phases.data());
+	if (evaluator.evalBlock(values.data(), 3 * size) > 0) return shared_ptr<const Wavetable>();
+
+	shared_ptr<Wavetable> wavetable(new Wavetable());
+	float peak = 1.0f;
+	for (int i = 0; i < size; i++) {
+		wavetable->samples[i + 1] = values[i];
+		if (fabsf(values[i]) > peak) peak = fabsf(values[i]);
+	}
+	wavetable->samples[0] = values[size - 1];
+	wavetable->samples[size + 1] = values[0];
+	wavetable->samples[size + 2] = values[1];
+
+	// the next period is calculated with less precise phases, so it has a
+	// larger tolerance
+	for (int i = 0; i < size; i++) {
+		if (fabsf(values[size + i] - values[i]) > 100.0f * WAVETABLE_TOLERANCE * peak) return shared_ptr<const Wavetable>();
+		float error = wavetable->read(phases[2 * size + i]) - values[2 * size + i];
+		if (fabsf(error) > WAVETABLE_TOLERANCE * peak) return shared_ptr<const Wavetable>();
+	}
+	return wavetable;
+}
+
+int Optimizer::getOperandCount(const Instruction& instruction)
+{
+	switch (instruction.opcode) {
+	case NumberOpcode:
+	case VariableOpcode:
+	case NoArgumentFunctionOpcode:
+	case OutputOpcode:
+		return 0;
+	case NegOpcode:
+	case NotOpcode:
+	case OneArgumentFunctionOpcode:
+	case WavetableOpcode:
+		return 1;
+	case JoinOpcode:
+		return 3;
+	case StatefulFunctionOpcode:
+		return instruction.statefulFunction->argumentCount;
+	}
+	return 2;
+}
+
+// the operand of the union which is used by the opcode, the others may be
+// uninitialized
+uint64_t Optimizer::getOperand(const Instruction& instruction)
+{
+	uint32_t bits;
+	switch (instruction.opcode) {
+	case NumberOpcode:
+		// 0 and -0 are different numbers
+		memcpy(&bits, &instruction.value, sizeof(bits));
+		return bits;
+	case VariableOpcode:
+		return instruction.variable;
+	case NoArgumentFunctionOpcode:
+		return (uintptr_t) instruction.noArgumentFunction;
+	case OneArgumentFunctionOpcode:
+		return (uintptr_t) instruction.oneArgumentFunction;
+	case PowerOpcode:
+	case TwoArgumentsFunctionOpcode:
+		return (uintptr_t) instruction.twoArgumentsFunction;
+	case WavetableOpcode:
+		return (uintptr_t) instruction.wavetable;
+	}
+	return 0;
+}
+
+// Copies the jumps of a conditional and sets their targets in the optimized
+// program. If the condition is a number, the branch which is not taken is
+// removed at its end, so it is checked like the rest of the program. The
+// condition is replaced by the conditional on the stack.
+bool Optimizer::conditional(const Instruction& instruction)
+{
+	if (instruction.opcode == JumpIfFalseOpcode) {
+		if (m_starts.empty()) return false;
+		int start = m_starts.back();
+		Conditional conditional;
+		if (isNumber(start, m_program.size())) {
+			conditional.jump = -1;
+			conditional.removed = m_program[start].value == 0 ? start : -1;
+			m_program.pop_back();
+			m_starts.pop_back();
+		} else {
+			conditional.jump = m_program.size();
+			conditional.removed = -1;
+			m_program.push_back(instruction);
+		}
+		conditional.depth = m_starts.size();
+		m_conditionals.push_back(conditional);
+		return true;
+	}
+
+	// every branch adds one value
+	if (m_conditionals.empty() || (int) m_starts.size() != m_conditionals.back().depth + 1) return false;
+	Conditional& conditional = m_conditionals.back();
+	if (conditional.removed >= 0) {
+		m_program.resize(conditional.removed);
+		m_starts.pop_back();
+	}
+	if (conditional.jump < 0) {
+		// the else branch is removed, if the then branch is not
+		if (instruction.opcode == JumpOpcode) {
+			conditional.removed = conditional.removed < 0 ? m_program.size() : -1;
+			conditional.depth = m_starts.size();
+		} else {
+			m_conditionals.pop_back();
+		}
+		return true;
+	}
+	m_starts.pop_back();
+	m_program.push_back(instruction);
+	m_program[conditional.jump].jump = m_program.size() - conditional.jump;
+	if (instruction.opcode == JumpOpcode) {
+		conditional.jump = m_program.size() - 1;
+		conditional.depth = m_starts.size();
+	} else {
+		m_conditionals.pop_back();
+	}
+	return true;
+}
+
+void Optimizer::push(const Instruction& instruction)
+{
+	m_starts.push_back(m_program.size());
+	m_program.push_back(instruction);
+}
+
+// A number which is stored in a temporary is pushed instead of loading it, so
+// that it is folded with the operators.
+void Optimizer::store(const Instruction& instruction)
+{
+	Instruction load = instruction;
+	load.opcode = LoadOpcode;
+	while ((int) m_temporaryValues.size() <= instruction.temporary) {
+		load.temporary = m_temporaryValues.size();
+		m_temporaryValues.push_back(load);
+	}
+	load.temporary = instruction.temporary;
+	int start = m_starts.back();
+	m_temporaryValues[instruction.temporary] = isNumber(start, m_program.size()) ? m_program[start] : load;
+	m_program.push_back(instruction);
+}
+
+// removes the value of a statement, a stored number is not needed
+bool Optimizer::pop(const Instruction& instruction)
+{
+	if (m_starts.empty() || m_conditionals.size() > 0) return false;
+	int start = m_starts.back();
+	m_starts.pop_back();
+	if (isNumber(start, start + 1) && (int) m_program.size() == start + 2 && m_program[start + 1].opcode == StoreOpcode) {
+		m_program.resize(start);
+	} else {
+		m_program.push_back(instruction);
+	}
+	return true;
+}
+
+void Optimizer::unaryOperator(const Instruction& instruction)
+{
+	if (m_starts.empty()) return;
+	int start = m_starts.back();
+	int end = m_program.size();
+	float result;
+	if (isNumber(start, end) && calculate(instruction, m_program[start].value, 0, result)) {
+		m_program[start].value = result;
+		return;
+	}
+	const Instruction& last = m_program.back();
+	if (instruction.opcode == NegOpcode && last.opcode == NegOpcode) {
+		// --x = x
+		m_program.pop_back();
+		return;
+	}
+	if (instruction.opcode == NotOpcode && last.opcode == NotOpcode && isBoolean(start, end - 1)) {
+		// !!x = x, if x is 0 or 1
+		m_program.pop_back();
+		return;
+	}
+	m_program.push_back(instruction);
+}
+
+void Optimizer::binaryOperator(const Instruction& instruction)
+{
+	if (m_starts.size() < 2) {
+		m_starts.clear();
+		return;
+	}
+	int start2 = m_starts.back();
+	m_starts.pop_back();
+	int start1 = m_starts.back();
+	int end = m_program.size();
+	float result;
+	if (isNumber(start1, start2) && isNumber(start2, end)
+	        && calculate(instruction, m_program[start1].value, m_program[start2].value, result))
+	{
+		m_program[start1].value = result;
+		m_program.pop_back();
+		return;
+	}
+	switch (instruction.opcode) {
+	case AddOpcode:
+		// x+0 = 0+x = x
+		if (isNumber(start2, end, 0)) {
+			removeInstruction(start2);
+			return;
+		}
+		if (isNumber(start1, start2, 0)) {
+			removeInstruction(start1);
+			return;
+		}
+		break;
+	case SubOpcode:
+		// x-0 = x
+		if (isNumber(start2, end, 0)) {
+			removeInstruction(start2);
+			return;
+		}
+		break;
+	case MulOpcode:
+		// x*1 = 1*x = x
+		if (isNumber(start2, end, 1)) {
+			removeInstruction(start2);
+			return;
+		}
+		if (isNumber(start1, start2, 1)) {
+			removeInstruction(start1);
+			return;
+		}
+		break;
+	case NotEqualOpcode:
+		// x!=0 = x, if x is 0 or 1
+		if (isNumber(start2, end, 0) && isBoolean(start1, start2)) {
+			removeInstruction(start2);
+			return;
+		}
+		break;
+	case DivOpcode:
+		// x/1 = x
+		if (isNumber(start2, end, 1)) {
+			removeInstruction(start2);
+			return;
+		}
+		break;
+	case PowerOpcode:
+		// x^1 = x, the approximated pow functions are not exact for it
+		if (isNumber(start2, end, 1) && instruction.mathAccuracy == ExactMathAccuracy) {
+			removeInstruction(start2);
+			return;
+		}
+		break;
+	}
+	m_program.push_back(instruction);
+}
+
+bool Optimizer::isNumber(int start, int end)
+{
+	return end - start == 1 && m_program[start].opcode == NumberOpcode && isfinite(m_program[start].value);
+}
+
+bool Optimizer::isNumber(int start, int end, float value)
+{
+	return isNumber(start, end) && m_program[start].value == value;
+}
+
+bool Optimizer::isBoolean(int start, int end)
+{
+	if (isNumber(start, end, 0) || isNumber(start, end, 1)) return true;
+	if (end - start < 1) return false;
+	switch (m_program[end - 1].opcode) {
+	case LessOpcode:
+	case GreaterOpcode:
+	case LessEqualOpcode:
+	case GreaterEqualOpcode:
+	case EqualOpcode:
+	case NotEqualOpcode:
+	case AndOpcode:
+	case OrOpcode:
+	case NotOpcode:
+		return true;
+	}
+	return false;
+}
+
+void Optimizer::removeInstruction(int index)
+{
+	m_program.erase(m_program.begin() + index);
+}
@@ -0,0 +1,135 @@
+/**
+ *
+ * Copyright (c) 2001, Frank Bu
+ *
+ * project: Formula
+ * version: $Revision: 1.3 $ $Name:  $
+ *
+ * Optimizer class, folds constants, simplifies the compiled program,
+ * calculates common subexpressions once, replaces subexpressions of the
+ * phase by wavetables and moves subexpressions of the control variables out
+ * of the program.
+ */
+
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include "Evaluator.h"
+
+#include <stdint.h>
+
+using namespace std;
+
+class Optimizer
+{
+public:
+	Optimizer() : m_temporaryCount(0), m_wavetableVariable(-1) {
+	}
+	vector<Instruction> optimize(const vector<Instruction>& program);
+	// The start of the operands of the DelayOpcode or StatefulFunctionOpcode
+	// at the index, if optimize() can move them out of a conditional: they
+	// have no conditional and call no impure function, except of the
+	// instructions with a state. -1 if they can't be moved.
+	static int findMovableOperands(const vector<Instruction>& program, int index);
+	// the temporaries used by the last optimized program
+	int getTemporaryCount() {
+		return m_temporaryCount;
+	}
+	// A subexpression which depends only on the variable with this index and
+	// calls functions is replaced by a wavetable, if it is periodic with a
+	// period of 1, see Wavetable.h. -1 doesn't create wavetables.
+	void setWavetableVariable(int variable) {
+		m_wavetableVariable = variable;
+	}
+	// the wavetables used by the last optimized program
+	const vector<shared_ptr<const Wavetable> >& getWavetables() {
+		return m_wavetables;
+	}
+	// The variables which are set are control variables, see
+	// Evaluator::setControlVariable(). The control value i is stored in the
+	// variable with the index control.size() + i.
+	void setControlVariables(const vector<bool>& control) {
+		m_controlVariables = control;
+	}
+	// the control values of the last optimized program
+	const vector<ControlValue>& getControlValues() {
+		return m_controlValues;
+	}
+
+private:
+	// a node of the expression graph, pure nodes with the same instruction and
+	// operands are the same node; a conditional is a JoinOpcode node with the
+	// condition and the branches as operands
+	struct Node {
+		Instruction instruction;
+		int operands[3];
+		int operandCount;
+		// how often the value is used, counting the uses inside of the
+		// subexpressions which are calculated once only once
+		int uses;
+		int temporary;
+		// the node or its operands call an impure function
+		bool impure;
+	};
+
+	vector<Instruction> moveStates(const vector<Instruction>& program);
+	vector<Instruction> mergeSubexpressions(const vector<Instruction>& program);
+	int findNode(int node);
+	bool isEqual(const Node& node1, const Node& node2);
+	void countUses(int node);
+	void emitNode(int node);
+	void emitBranch(int node);
+	int emitJump(Opcode opcode);
+	int classifyNode(int node);
+	void addWavetables(int node);
+	void addControlValues(int node);
+	void emitTree(int node, vector<Instruction>& program);
+	shared_ptr<const Wavetable> renderWavetable(int node);
+	static int getOperandCount(const Instruction& instruction);
+	static uint64_t getOperand(const Instruction& instruction);
+
+	bool conditional(const Instruction& instruction);
+	void unaryOperator(const Instruction& instruction);
+	void binaryOperator(const Instruction& instruction);
+	void push(const Instruction& instruction);
+	void store(const Instruction& instruction);
+	bool pop(const Instruction& instruction);
+	bool isNumber(int start, int end, float value);
+	bool isNumber(int start, int end);
+	bool isBoolean(int start, int end);
+	void removeInstruction(int index);
+
+	// the optimized program and the start index of every value on the stack
+	vector<Instruction> m_program;
+	vector<int> m_starts;
+	// the open conditionals, see conditional()
+	struct Conditional {
+		// the index of the jump which isn't set yet, -1 if the condition is a number
+		int jump;
+		// the start of the branch which is not taken, -1 if the branch is taken
+		int removed;
+		// the number of values on the stack before the branch
+		int depth;
+	};
+	vector<Conditional> m_conditionals;
+	// the values of the temporaries of the statements, a number or the
+	// LoadOpcode of the temporary
+	vector<Instruction> m_temporaryValues;
+
+	vector<Node> m_nodes;
+	// a hash table of the pure nodes with open addressing, -1 is a free slot
+	vector<int> m_nodeTable;
+	// the nodes which are stored in a temporary, in the order of the stores
+	vector<int> m_storedNodes;
+	int m_temporaryCount;
+
+	// the NodeFlags of every node, see classifyNode()
+	vector<int> m_nodeFlags;
+	int m_wavetableVariable;
+	vector<shared_ptr<const Wavetable> > m_wavetables;
+	vector<bool> m_controlVariables;
+	vector<ControlValue> m_controlValues;
+};
+
+
+#endif
@@ -0,0 +1,104 @@
+/**
+ *
+ * Copyright (c) 2001, Frank Bu
+ *
+ * project: Formula
+ * version: $Revision: 1.3 $ $Name:  $
+ *
+ * Polyphase FIR upsampler and decimator, for evaluating a formula at a
+ * multiple of the sample rate.
+ */
+
+#include "Oversampler.h"
+
+#include <math.h>
+#include <string.h>
+
+using namespace std;
+
+// the cutoff frequency of the lowpass filter, relative to the original sample
+// rate; a bit below the Nyquist frequency, so that less of the transition band
+// is mirrored back
+#define OVERSAMPLER_CUTOFF 0.42
+
+
+void OversamplingFilter::setFactor(int factor)
+{
+	if (factor < 1) factor = 1;
+	if (factor > MAX_OVERSAMPLING) factor = MAX_OVERSAMPLING;
+	m_factor = factor;
+	memset(m_phases, 0, sizeof(m_phases));
+	if (factor == 1) {
+		m_phases[0][0] = 1.0f;
+		return;
+	}
+
+	// windowed sinc with a Blackman window, the coefficient i of the
+	// prototype filter is the coefficient i / factor of the phase i % factor
+	int length = factor * OVERSAMPLER_TAPS;
+	double center = 0.5 * (length - 1);
+	double cutoff = OVERSAMPLER_CUTOFF / factor;
+	double coefficients[MAX_OVERSAMPLING * OVERSAMPLER_TAPS];
+	double sum = 0;
+	for (int i = 0; i < length; i++) {
+		double x = 2.0 * cutoff * (i - center);
+		double sinc = sin(M_PI * x) / (M_PI * x);
+		double t = 2.0 * M_PI * i / (length - 1);
+		double window = 0.42 - 0.5 * cos(t) + 0.08 * cos(2.0 * t);
+		coefficients[i] = sinc * window;
+		sum += coefficients[i];
+	}
+
+	// the gain at 0 Hz is 1
+	for (int i = 0; i < length; i++) {
+		m_phases[i % factor][i / factor] = float(coefficients[i] / sum);
+	}
+}
+
+void Upsampler::reset()
+{
+	memset(m_history, 0, sizeof(m_history));
+	m_position = 0;
+}
+
+void Upsampler::process(float input, float* output)
+{
+	// the newest input is the first one, the oldest one is overwritten
+	if (--m_position < 0) m_position = OVERSAMPLER_TAPS - 1;
+	m_history[m_position] = input;
+	m_history[m_position + OVERSAMPLER_TAPS] = input;
+	const float* history = m_history + m_position;
+
+	// the output j is calculated with the inputs and every factor-th
+	// coefficient, starting with j, and multiplied by the factor, because
+	// the other samples of the upsampled signal are 0
+	for (int j = 0; j < m_factor; j++) {
+		const float* phase = m_phases[j];
+		float sum = 0.0f;
+		for (int k = 0; k < OVERSAMPLER_TAPS; k++) sum += phase[k] * history[k];
+		output[j] = sum * m_factor;
+	}
+}
+
+void Decimator::reset()
+{
+	memset(m_history, 0, sizeof(m_history));
+	m_position = 0;
+}
+
+float Decimator::process(const float* input)
+{
+	// the phase j filters the input factor - 1 - j of the last inputs
+	if (--m_position < 0) m_position = OVERSAMPLER_TAPS - 1;
+	float sum = 0.0f;
+	for (int j = 0; j < m_factor; j++) {
+		float* history = m_history[j];
+		float value = input[m_factor - 1 - j];
+		history[m_position] = value;
+		history[m_position + OVERSAMPLER_TAPS] = value;
+		history += m_position;
+		const float* phase = m_phases[j];
+		for (int k = 0; k < OVERSAMPLER_TAPS; k++) sum += phase[k] * history[k];
+	}
+	return sum;
+}
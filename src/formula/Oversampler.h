@@ -0,0 +1,85 @@
+/**
+ *
+ * Copyright (c) 2001, Frank Bu
+ *
+ * project: Formula
+ * version: $Revision: 1.3 $ $Name:  $
+ *
+ * Polyphase FIR upsampler and decimator, for evaluating a formula at a
+ * multiple of the sample rate.
+ */
+
+#ifndef OVERSAMPLER_H
+#define OVERSAMPLER_H
+
+using namespace std;
+
+// the supported oversampling factors are 1, 2, 4 and 8
+#define MAX_OVERSAMPLING 8
+
+// The lowpass filter has OVERSAMPLER_TAPS taps per phase, the latency of
+// upsampling and decimating is about OVERSAMPLER_TAPS samples at the original
+// rate. The filters don't allocate memory, so they can be used by the audio
+// thread.
+#define OVERSAMPLER_TAPS 16
+
+// the lowpass filter, with the coefficients of every phase in a row
+class OversamplingFilter
+{
+public:
+	OversamplingFilter() : m_factor(1) {
+		setFactor(1);
+	}
+	void setFactor(int factor);
+	int getFactor() const {
+		return m_factor;
+	}
+
+protected:
+	int m_factor;
+	float m_phases[MAX_OVERSAMPLING][OVERSAMPLER_TAPS];
+};
+
+class Upsampler : public OversamplingFilter
+{
+public:
+	Upsampler() {
+		reset();
+	}
+	void setFactor(int factor) {
+		OversamplingFilter::setFactor(factor);
+		reset();
+	}
+	void reset();
+	// writes getFactor() samples to output for one input sample
+	void process(float input, float* output);
+
+private:
+	// the last inputs, twice, so that the newest OVERSAMPLER_TAPS inputs
+	// always start at m_position
+	float m_history[2 * OVERSAMPLER_TAPS];
+	int m_position;
+};
+
+class Decimator : public OversamplingFilter
+{
+public:
+	Decimator() {
+		reset();
+	}
+	void setFactor(int factor) {
+		OversamplingFilter::setFactor(factor);
+		reset();
+	}
+	void reset();
+	// returns one sample for getFactor() input samples
+	float process(const float* input);
+
+private:
+	// the last inputs of every phase, twice like in the Upsampler
+	float m_history[MAX_OVERSAMPLING][2 * OVERSAMPLER_TAPS];
+	int m_position;
+};
+
+
+#endif
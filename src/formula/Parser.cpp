@@ -10,8 +10,15 @@
 
 #include "Token.h"
 #include "Parser.h"
+#include "ProgramCache.h"
+#include "Optimizer.h"
 
+#include <algorithm>
+#include <ctype.h>
 #include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
 #include <iostream>
 #include <time.h>
 
@@ -31,30 +38,32 @@ float ParserTime()
 	return time(NULL);
 }
 
-Parser::Parser(string expression)
-{
-	setFunction("acos", acosf);
-	setFunction("asin", asinf);
-	setFunction("atan", atanf);
-	setFunction("atan2", atan2f);
-	setFunction("cos", cosf);
-	setFunction("cosh", coshf);
-	setFunction("exp", expf);
-	setFunction("abs", fabsf);
-	setFunction("mod", fmodf);
-	setFunction("log", logf);
-	setFunction("log2", log2f);
-	setFunction("log10", log10f);
-	setFunction("pow", powf);
-	setFunction("sin", sinf);
-	setFunction("sinh", sinhf);
-	setFunction("tan", tanf);
-	setFunction("tanh", tanhf);
-	setFunction("sqrt", sqrtf);
-	setFunction("ceil", ceilf);
-	setFunction("floor", floorf);
-	setFunction("max", ParserMax);
-	setFunction("min", ParserMin);
+Parser::Parser(string expression) : m_functionTableChanged(true)
+{
+	setFunction("acos", acosf, true);
+	setFunction("asin", asinf, true);
+	setFunction("atan", atanf, true);
+	setFunction("atan2", atan2f, true);
+	setFunction("abs", fabsf, true);
+	setFunction("mod", fmodf, true);
+	setFunction("sqrt", sqrtf, true);
+	setFunction("ceil", ceilf, true);
+	setFunction("floor", floorf, true);
+	setFunction("max", ParserMax, true);
+	setFunction("min", ParserMin, true);
+
+	m_mathFunctions["cos"] = CosMathFunction;
+	m_mathFunctions["cosh"] = CoshMathFunction;
+	m_mathFunctions["exp"] = ExpMathFunction;
+	m_mathFunctions["log"] = LogMathFunction;
+	m_mathFunctions["log2"] = Log2MathFunction;
+	m_mathFunctions["log10"] = Log10MathFunction;
+	m_mathFunctions["pow"] = PowMathFunction;
+	m_mathFunctions["sin"] = SinMathFunction;
+	m_mathFunctions["sinh"] = SinhMathFunction;
+	m_mathFunctions["tan"] = TanMathFunction;
+	m_mathFunctions["tanh"] = TanhMathFunction;
+	setMathAccuracy(ExactMathAccuracy);
 
 	setExpression(expression);
 }
@@ -62,248 +71,1054 @@ Parser::Parser(string expression)
 
 Parser::~Parser()
 {
-	deleteTokens();
 }
 
 
-char Parser::peekChar()
-{
-	if (m_currentIndex < (int) m_expression.size()) return m_expression[m_currentIndex];
-	return 0;
-}
+// The character classes of the lexer. The characters of the operators,
+// brackets, commas and semicolons are their token type.
+enum CharacterClasses {
+	InvalidCharacter = TokenTypeCount,
+	SpaceCharacter,
+	DigitCharacter,
+	PointCharacter,
+	LetterCharacter
+};
 
-
-void Parser::skipChar()
+struct CharacterTable
 {
-	m_currentIndex++;
-}
-
+	CharacterTable() {
+		for (int i = 0; i < 256; i++) classes[i] = InvalidCharacter;
+		for (int c = '0'; c <= '9'; c++) classes[c] = DigitCharacter;
+		for (int c = 'a'; c <= 'z'; c++) classes[c] = LetterCharacter;
+		for (int c = 'A'; c <= 'Z'; c++) classes[c] = LetterCharacter;
+		classes['_'] = LetterCharacter;
+		classes['.'] = PointCharacter;
+		classes[9] = classes[10] = classes[13] = classes[32] = SpaceCharacter;
+		classes['&'] = AndToken;
+		classes['|'] = OrToken;
+		classes['='] = EqualToken;
+		classes['!'] = NotToken;
+		classes['<'] = LessToken;
+		classes['>'] = GreaterToken;
+		classes['+'] = AddToken;
+		classes['-'] = SubToken;
+		classes['*'] = MulToken;
+		classes['/'] = DivToken;
+		classes['^'] = PowerToken;
+		classes['?'] = QuestionToken;
+		classes[':'] = ColonToken;
+		classes['('] = OpenBracketToken;
+		classes[')'] = CloseBracketToken;
+		classes[','] = CommaToken;
+		classes[';'] = SemicolonToken;
+		classes['['] = OpenIndexToken;
+		classes[']'] = CloseIndexToken;
+	}
+	unsigned char classes[256];
+};
 
-char Parser::skipAndPeekChar()
+// the static is initialized on the first call, also from multiple threads
+static const unsigned char* getCharacterClasses()
 {
-	skipChar();
-	return peekChar();
+	static CharacterTable table;
+	return table.classes;
 }
 
-
-Token* Parser::peekToken()
+static bool isDigit(char c)
 {
-	if (m_currentTokenIndex < (int) m_tokens.size()) return m_tokens[m_currentTokenIndex];
-	return NULL;
+	return c >= '0' && c <= '9';
 }
 
 
-Token* Parser::peekLastToken()
+// Lexes only the lines which are different from the last parsed expression,
+// the other tokens are moved. A token ends before a new line, so the lexer can
+// start at every line.
+bool Parser::tokenize()
 {
-	Token* lastToken = NULL;
-	if (m_currentTokenIndex > 0) lastToken = m_tokens[m_currentTokenIndex - 1];
-	return lastToken;
-}
+	if (m_parsedExpression.size() == 0) {
+		m_tokens.clear();
+		return lex(0, m_expression.size());
+	}
 
+	// the first and the last changed character
+	const string& parsed = m_parsedExpression;
+	int size = m_expression.size();
+	int common = min(size, (int) parsed.size());
+	int prefix = 0;
+	while (prefix < common && m_expression[prefix] == parsed[prefix]) prefix++;
+	int suffix = 0;
+	while (suffix < common - prefix && m_expression[size - 1 - suffix] == parsed[parsed.size() - 1 - suffix]) suffix++;
+	size_t newLine = prefix > 0 ? m_expression.rfind('\n', prefix - 1) : string::npos;
+	int start = newLine == string::npos ? 0 : newLine + 1;
+	newLine = m_expression.find('\n', size - suffix);
+	int end = newLine == string::npos ? size : newLine;
+	int offset = size - parsed.size();
 
-Token* Parser::peekNextToken()
-{
-	Token* nextToken = NULL;
-	if (m_currentTokenIndex + 1 < (int) m_tokens.size()) nextToken = m_tokens[m_currentTokenIndex + 1];
-	return nextToken;
+	swap(m_tokens, m_parsedTokens);
+	m_tokens.clear();
+	int index = 0;
+	while (index < (int) m_parsedTokens.size() && m_parsedTokens[index].start < start) {
+		m_tokens.push_back(m_parsedTokens[index++]);
+	}
+	m_changeStart = index;
+	if (!lex(start, end)) return false;
+	m_changeEnd = m_tokens.size();
+	while (index < (int) m_parsedTokens.size() && m_parsedTokens[index].start < end - offset) index++;
+	m_parsedChangeEnd = index;
+	for (; index < (int) m_parsedTokens.size(); index++) {
+		Token token = m_parsedTokens[index];
+		token.start += offset;
+		m_tokens.push_back(token);
+	}
+	return true;
 }
 
 
-void Parser::skipToken()
+bool Parser::lex(int start, int end)
 {
-	m_currentTokenIndex++;
+	const unsigned char* classes = getCharacterClasses();
+	const char* expression = m_expression.c_str();
+	int index = start;
+	while (index < end) {
+		int start = index;
+		int type = classes[(unsigned char) expression[index]];
+		switch (type) {
+		case SpaceCharacter:
+			index++;
+			continue;
+		case DigitCharacter:
+		case PointCharacter:
+			if (!scanNumber(index)) return false;
+			type = NumberToken;
+			break;
+		case LetterCharacter:
+			index++;
+			while (index < end && (classes[(unsigned char) expression[index]] == LetterCharacter
+			                        || classes[(unsigned char) expression[index]] == DigitCharacter)) {
+				index++;
+			}
+			type = IdentifierToken;
+			break;
+		case InvalidCharacter:
+			return setError(SyntaxParserError, string("Invalid character: ") + expression[index], start);
+		default:
+			index++;
+			// "!=", "<=" and ">=" are one token
+			if (expression[index] == '=' && (type == NotToken || type == LessToken || type == GreaterToken)) {
+				type = type == NotToken ? NotEqualToken : type == LessToken ? LessEqualToken : GreaterEqualToken;
+				index++;
+			}
+		}
+		Token token = {type, start, index - start};
+		m_tokens.push_back(token);
+	}
+	return true;
 }
 
 
-string Parser::parseNumber(char c)
+// digits, an optional fraction and an optional exponent
+bool Parser::scanNumber(int& index)
 {
-	string number;
-	if (c != '.')
-	{
-		// parse before '.'
-		while (c != 0 && c >= '0' && c <= '9' && c != '.' && c != 'e' && c != 'E') {
-			number += c;
-			c = skipAndPeekChar();
-		}
-	}
-	if (c == '.')
-	{
-		// parse after '.'
-		number += c;
-		c = skipAndPeekChar();
-		if (c != 0 && c >= '0' && c <= '9') {
-			while (c != 0 && c >= '0' && c <= '9' && c != 'e' && c != 'E') {
-				number += c;
-				c = skipAndPeekChar();
-			}
-		} else {
-			throw SyntaxError("Expected digit after '.', number: " + number);
+	const char* expression = m_expression.c_str();
+	int start = index;
+	while (isDigit(expression[index])) index++;
+	if (expression[index] == '.') {
+		index++;
+		if (!isDigit(expression[index])) {
+			return setError(SyntaxParserError, "Expected digit after '.', number: " + m_expression.substr(start, index - start), index);
 		}
+		while (isDigit(expression[index])) index++;
 	}
-	if (c == 'e' || c == 'E')
-	{
-		// parse after 'e' or 'E'
-		number += c;
-		c = skipAndPeekChar();
-		if (c == '+' || c == '-') {
-			number += c;
-			c = skipAndPeekChar();
-		}
-		while (c != 0 && c >= '0' && c <= '9') {
-			number += c;
-			c = skipAndPeekChar();
-		}
+	if (expression[index] == 'e' || expression[index] == 'E') {
+		index++;
+		if (expression[index] == '+' || expression[index] == '-') index++;
+		while (isDigit(expression[index])) index++;
 	}
-	return number;
+	return true;
 }
 
 
-string Parser::parseIdentifier(char c)
+bool Parser::setExpression(string expression, ParserError& error)
 {
-	string identifier;
-	identifier += c;
-	c = skipAndPeekChar();
-	while (c != 0 && ((c >= 'a' && c <= 'z')
-	                  || (c >= 'A' && c <= 'Z')
-	                  || (c >= '0' && c <= '9')
-	                  || c == '_'))
-	{
-		identifier += c;
-		c = skipAndPeekChar();
-	}
-	return identifier;
+	m_error = ParserError();
+	if (compile(expression)) return true;
+	error = m_error;
+	return false;
 }
 
 
-void Parser::deleteTokens()
+void Parser::setExpression(string expression)
 {
-	for (int i = 0; i < (int) m_tokens.size(); i++) delete m_tokens[i];
-	m_tokens.clear();
+	ParserError error;
+	if (!setExpression(expression, error)) throwParserError(error);
 }
 
 
-void Parser::setExpression(string expression)
+bool Parser::compile(string expression)
 {
 	m_expression = string("(") + expression + ")";
 
+	// the program of an expression which was compiled before with the same
+	// functions and constants is shared, only the variables are linked again
+	string functionTableKey = getFunctionTableKey();
+	string key = normalizeExpression(expression) + "\n" + functionTableKey;
+	shared_ptr<const Program> program = findCachedProgram(key);
+	if (program) {
+		m_postfix = program->postfix;
+		m_evaluator.setProgram(program);
+		return link();
+	}
+
 	m_postfix = "";
-	m_evaluator.removeAllActions();
-	m_functionArgumentCountStack = stack<int>();
-	m_operators = stack<Token*>();
-	deleteTokens();
-
-	m_currentIndex = 0;
-	char c;
-	Token* token;
-	while ((c = peekChar())) {
-		token = NULL;
-		switch (c) {
-		case '&':
-			token = new AndToken();
-			skipChar();
-			break;
-		case '|':
-			token = new OrToken();
-			skipChar();
-			break;
-		case '=':
-			token = new EqualToken();
-			skipChar();
-			break;
-		case '!':
-			skipChar();
-			if (peekChar() == '=') {
-				skipChar();
-				token = new NotEqualToken();
-			} else {
-				token = new NotToken();
+	// every token adds at most its text and a space
+	m_postfix.reserve(2 * m_expression.size());
+	m_evaluator.removeAllInstructions();
+	// the constants and functions are part of the instructions
+	if (functionTableKey != m_parsedFunctionTableKey) m_parsedExpression = "";
+	if (!tokenize() || !parse()) {
+		m_parsedExpression = "";
+		return false;
+	}
+	m_parsedExpression = m_expression;
+	m_parsedPostfix = m_postfix;
+	m_parsedProgram = m_evaluator.getProgram();
+	m_parsedFunctionTableKey = functionTableKey;
+	if (m_postfix.size() > 0) m_postfix.erase(0, 1);
+
+	m_evaluator.optimize();
+	m_evaluator.setPostfix(m_postfix);
+	if (!link()) return false;
+	cacheProgram(key, m_evaluator.getProgram());
+	return true;
+}
+
+
+// Converts the infix tokens to postfix instructions with the shunting-yard
+// algorithm. The syntax is checked by the set of types which may follow a token.
+bool Parser::parse()
+{
+	m_operators.clear();
+	m_functionArgumentCounts.clear();
+	m_jumps.clear();
+	swap(m_locals, m_parsedLocals);
+	m_locals.clear();
+	m_statement = 1;
+	m_assignment = -1;
+	m_lastSemicolon = -1;
+	for (int i = m_tokens.size() - 1; i >= 0 && m_lastSemicolon < 0; i--) {
+		if (m_tokens[i].type == SemicolonToken) m_lastSemicolon = i;
+	}
+	swap(m_checkpoints, m_parsedCheckpoints);
+	swap(m_checkpointStacks, m_parsedCheckpointStacks);
+	m_checkpoints.clear();
+	m_checkpointStacks.clear();
+	m_nextParsedCheckpoint = 0;
+	// every token adds at most one instruction
+	m_evaluator.reserveInstructions(m_tokens.size());
+	int index = 0;
+
+	bool incremental = m_parsedExpression.size() > 0;
+	if (incremental) {
+		// the last line before the change, the tokens before a line look at
+		// most at its first two tokens
+		int last = -1;
+		while (last + 1 < (int) m_parsedCheckpoints.size() && m_parsedCheckpoints[last + 1].token + 2 <= m_changeStart) last++;
+		// the change can add or remove the last ';', which makes a started statement an assignment
+		while (last >= 0 && m_parsedCheckpoints[last].statement < m_parsedCheckpoints[last].token
+		        && (m_parsedCheckpoints[last].assignment >= 0) != startsAssignment(m_parsedCheckpoints[last].statement)) {
+			last--;
+		}
+		if (last >= 0) {
+			const ParserCheckpoint& checkpoint = m_parsedCheckpoints[last];
+			m_checkpoints.assign(m_parsedCheckpoints.begin(), m_parsedCheckpoints.begin() + last);
+			m_checkpointStacks.assign(m_parsedCheckpointStacks.begin(), m_parsedCheckpointStacks.begin() + checkpoint.stackStart);
+			const int* stack = &m_parsedCheckpointStacks[checkpoint.stackStart];
+			m_operators.assign(stack, stack + checkpoint.operatorCount);
+			stack += checkpoint.operatorCount;
+			m_functionArgumentCounts.assign(stack, stack + checkpoint.functionCount);
+			stack += checkpoint.functionCount;
+			m_jumps.assign(stack, stack + checkpoint.jumpCount);
+			m_locals.assign(m_parsedLocals.begin(), m_parsedLocals.begin() + checkpoint.localCount);
+			m_statement = checkpoint.statement;
+			m_assignment = checkpoint.assignment;
+			m_evaluator.addInstructions(*m_parsedProgram, 0, checkpoint.instructionCount, checkpoint.variableCount);
+			m_postfix.append(m_parsedPostfix, 0, checkpoint.postfixSize);
+			index = checkpoint.token;
+		}
+	}
+
+	while (index < (int) m_tokens.size()) {
+		if (index > 0 && startsLine(index)) {
+			if (incremental && index > m_changeEnd && continueParsed(index)) return true;
+			addCheckpoint(index);
+		}
+		Token& token = m_tokens[index];
+		int lastTokenSet = index > 0 ? TOKEN_SET(m_tokens[index - 1].type) : 0;
+		switch (token.type) {
+		case NumberToken:
+			if (getNextTokenSet(index) & (TOKEN_SET(NumberToken) | TOKEN_SET(IdentifierToken))) {
+				return setError(SyntaxParserError, "One after another number is not allowed.", getNextTokenStart(index));
 			}
-			break;
-		case '<':
-			skipChar();
-			if (peekChar() == '=') {
-				skipChar();
-				token = new LessEqualToken();
-			} else {
-				token = new LessToken();
+			if (getNextTokenSet(index) & TOKEN_SET(OpenBracketToken)) {
+				return setError(SyntaxParserError, "Expected ')', ',', ';' or operator after a number.", getNextTokenStart(index));
 			}
+			addPostfix(token);
+			m_evaluator.addNumber(getNumber(token));
+			index++;
 			break;
-		case '>':
-			skipChar();
-			if (peekChar() == '=') {
-				skipChar();
-				token = new GreaterEqualToken();
-			} else {
-				token = new GreaterToken();
+		case IdentifierToken:
+			if (index == m_statement && startsAssignment(index)) {
+				if (!parseAssignment(index)) return false;
+			} else if (!parseIdentifier(index)) {
+				return false;
 			}
 			break;
-		case '+':
-			token = new AddToken();
-			skipChar();
-			break;
-		case '-':
-			token = new SubToken();
-			skipChar();
-			break;
-		case '*':
-			token = new MulToken();
-			skipChar();
+		case OpenBracketToken:
+			// only the brackets around an empty expression can be empty
+			if (index == 0 && !(getNextTokenSet(index) & (OPERAND_START_TOKENS | TOKEN_SET(CloseBracketToken)))) {
+				return setError(SyntaxParserError, "Expecting a variable, function, '(', ')', number, not or negate operator.",
+				                getNextTokenStart(index));
+			}
+			if (index > 0 && index + 2 == (int) m_tokens.size()) {
+				return setError(SyntaxParserError, "Missing ')'.", m_expression.size() - 1);
+			}
+			if (index > 0 && !(getNextTokenSet(index) & OPERAND_START_TOKENS)) {
+				return setError(SyntaxParserError, "Expecting a variable, function, '(', number, not or negate operator.",
+				                getNextTokenStart(index));
+			}
+			m_operators.push_back(index);
+			index++;
 			break;
-		case '/':
-			token = new DivToken();
-			skipChar();
+		case CloseBracketToken:
+			if (!parseCloseBracket(index)) return false;
+			index++;
 			break;
-		case '^':
-			token = new PowerToken();
-			skipChar();
+		case CommaToken:
+			if (!(getNextTokenSet(index) & OPERAND_START_TOKENS)) {
+				return setError(SyntaxParserError, "Expecting a variable, function, '(', number, not or negate operator.",
+				                getNextTokenStart(index));
+			}
+			while (m_operators.size() > 0 && (TOKEN_SET(m_tokens[m_operators.back()].type) & OPERATOR_TOKENS)) {
+				if (!popOperator()) return false;
+			}
+			if (m_operators.size() == 0 || m_tokens[m_operators.back()].type != IdentifierToken) {
+				return setError(SyntaxParserError, "',' is allowed within functions only.", token.start);
+			}
+			if (getText(m_tokens[m_operators.back()]) == "if" && !addIfJump(m_operators.back())) return false;
+			m_functionArgumentCounts.back()++;
+			index++;
 			break;
-		case '(':
-			token = new OpenBracketToken();
-			skipChar();
+		case SemicolonToken:
+			if (!parseSemicolon(index)) return false;
+			index++;
 			break;
-		case ')':
-			token = new CloseBracketToken();
-			skipChar();
+		case OpenIndexToken:
+			return setError(SyntaxParserError, "'[' is allowed after a variable only.", token.start);
+		case CloseIndexToken:
+			return setError(SyntaxParserError, "']' found but there is no matching '['.", token.start);
+		case AddToken:
+			if (lastTokenSet & OPERAND_END_TOKENS) {
+				if (!parseOperator(index)) return false;
+			} else if (!(getNextTokenSet(index) & OPERAND_START_TOKENS)) {
+				// a unary '+' is skipped, but it needs an operand like a negate operator
+				return setError(SyntaxParserError, "Expecting a variable, function, '(', number, not or negate operator.",
+				                getNextTokenStart(index));
+			}
+			index++;
 			break;
-		case ',':
-			token = new CommaToken();
-			skipChar();
+		case SubToken:
+		case NegToken:
+			token.type = (lastTokenSet & OPERAND_END_TOKENS) ? SubToken : NegToken;
+			if (!parseOperator(index)) return false;
+			index++;
 			break;
 		default:
-			if ((c >= '0' && c <= '9') || c == '.') {
-				token = new NumberToken(parseNumber(c));
-			} else if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_') {
-				token = new IdentifierToken(parseIdentifier(c));
-			} else if (c == 9 || c == 10 || c == 13 || c == 32) {
-				skipChar();
-				continue;
-			} else {
-				skipChar();
-				throw SyntaxError(string("Invalid character: ") + c);
+			if (!parseOperator(index)) return false;
+			index++;
+		}
+	}
+	if (m_operators.size() > 0) return setError(SyntaxParserError, "Missing ')'.", m_expression.size() - 1);
+	return true;
+}
+
+
+bool Parser::startsLine(int index)
+{
+	const Token& last = m_tokens[index - 1];
+	int end = last.start + last.length;
+	return memchr(m_expression.data() + end, '\n', m_tokens[index].start - end) != NULL;
+}
+
+
+void Parser::addCheckpoint(int index)
+{
+	const Program& program = m_evaluator.peekProgram();
+	ParserCheckpoint checkpoint;
+	checkpoint.token = index;
+	checkpoint.instructionCount = program.instructions.size();
+	checkpoint.variableCount = program.variableNames.size();
+	checkpoint.postfixSize = m_postfix.size();
+	checkpoint.stackStart = m_checkpointStacks.size();
+	checkpoint.operatorCount = m_operators.size();
+	checkpoint.functionCount = m_functionArgumentCounts.size();
+	checkpoint.jumpCount = m_jumps.size();
+	checkpoint.localCount = m_locals.size();
+	checkpoint.statement = m_statement;
+	checkpoint.assignment = m_assignment;
+	m_checkpointStacks.insert(m_checkpointStacks.end(), m_operators.begin(), m_operators.end());
+	m_checkpointStacks.insert(m_checkpointStacks.end(), m_functionArgumentCounts.begin(), m_functionArgumentCounts.end());
+	m_checkpointStacks.insert(m_checkpointStacks.end(), m_jumps.begin(), m_jumps.end());
+	m_checkpoints.push_back(checkpoint);
+}
+
+
+// Adds the rest of the last parsed program, if the parser had the same state
+// at the same token. The tokens after the change are the same, so the
+// instructions are the same, too.
+bool Parser::continueParsed(int index)
+{
+	int parsedIndex = getParsedIndex(index);
+	while (m_nextParsedCheckpoint < (int) m_parsedCheckpoints.size()
+	        && m_parsedCheckpoints[m_nextParsedCheckpoint].token < parsedIndex) {
+		m_nextParsedCheckpoint++;
+	}
+	if (m_nextParsedCheckpoint == (int) m_parsedCheckpoints.size()) return false;
+	const ParserCheckpoint& checkpoint = m_parsedCheckpoints[m_nextParsedCheckpoint];
+	if (checkpoint.token != parsedIndex) return false;
+
+	// a '-' is a different operator after a different token, also on the stack
+	if (m_tokens[index - 1].type != m_parsedTokens[parsedIndex - 1].type) return false;
+	if (checkpoint.operatorCount != (int) m_operators.size()) return false;
+	if (checkpoint.functionCount != (int) m_functionArgumentCounts.size()) return false;
+	// the targets of open jumps are in the rest, they are set while parsing it
+	if (checkpoint.jumpCount > 0 || m_jumps.size() > 0) return false;
+	const int* stack = &m_parsedCheckpointStacks[checkpoint.stackStart];
+	for (int i = 0; i < checkpoint.operatorCount; i++) {
+		if (getParsedIndex(m_operators[i]) != stack[i]) return false;
+		if (m_tokens[m_operators[i]].type != m_parsedTokens[stack[i]].type) return false;
+	}
+	for (int i = 0; i < checkpoint.functionCount; i++) {
+		if (m_functionArgumentCounts[i] != stack[checkpoint.operatorCount + i]) return false;
+	}
+	// the local variables must have the same temporaries
+	if (checkpoint.localCount != (int) m_locals.size()) return false;
+	for (int i = 0; i < checkpoint.localCount; i++) {
+		if (m_locals[i] != m_parsedLocals[i]) return false;
+	}
+	if (getParsedIndex(m_statement) != checkpoint.statement || (m_assignment >= 0) != (checkpoint.assignment >= 0)) return false;
+	// the variables of the instructions must have the same index
+	const Program& program = m_evaluator.peekProgram();
+	if ((int) program.variableNames.size() != checkpoint.variableCount) return false;
+	for (int i = 0; i < checkpoint.variableCount; i++) {
+		if (program.variableNames[i] != m_parsedProgram->variableNames[i]) return false;
+	}
+
+	int instructionOffset = program.instructions.size() - checkpoint.instructionCount;
+	int postfixOffset = m_postfix.size() - checkpoint.postfixSize;
+	m_evaluator.addInstructions(*m_parsedProgram, checkpoint.instructionCount, m_parsedProgram->instructions.size(),
+	                            m_parsedProgram->variableNames.size());
+	m_postfix.append(m_parsedPostfix, checkpoint.postfixSize, string::npos);
+	m_locals = m_parsedLocals;
+
+	// the checkpoints of the rest, for the next change
+	for (int i = m_nextParsedCheckpoint; i < (int) m_parsedCheckpoints.size(); i++) {
+		ParserCheckpoint next = m_parsedCheckpoints[i];
+		const int* nextStack = &m_parsedCheckpointStacks[next.stackStart];
+		next.token = getIndex(next.token);
+		next.instructionCount += instructionOffset;
+		next.postfixSize += postfixOffset;
+		next.stackStart = m_checkpointStacks.size();
+		next.statement = getIndex(next.statement);
+		if (next.assignment >= 0) next.assignment = next.statement;
+		for (int j = 0; j < next.operatorCount; j++) m_checkpointStacks.push_back(getIndex(nextStack[j]));
+		nextStack += next.operatorCount;
+		m_checkpointStacks.insert(m_checkpointStacks.end(), nextStack, nextStack + next.functionCount);
+		nextStack += next.functionCount;
+		for (int j = 0; j < next.jumpCount; j++) m_checkpointStacks.push_back(nextStack[j] + instructionOffset);
+		m_checkpoints.push_back(next);
+	}
+	return true;
+}
+
+
+// the index of a token in the last parsed tokens, -1 for a changed token
+int Parser::getParsedIndex(int index)
+{
+	if (index < m_changeStart) return index;
+	if (index >= m_changeEnd) return index - m_changeEnd + m_parsedChangeEnd;
+	return -1;
+}
+
+
+// the index of an unchanged token of the last parsed tokens
+int Parser::getIndex(int parsedIndex)
+{
+	if (parsedIndex < m_changeStart) return parsedIndex;
+	return parsedIndex - m_parsedChangeEnd + m_changeEnd;
+}
+
+
+// A statement is an assignment, if it starts with "name =" and a ';' follows.
+bool Parser::startsAssignment(int index)
+{
+	return index + 1 < m_lastSemicolon && m_tokens[index].type == IdentifierToken && m_tokens[index + 1].type == EqualToken;
+}
+
+
+// the "name =" of an assignment, the value is stored at the ';'
+bool Parser::parseAssignment(int& index)
+{
+	if (!(getNextTokenSet(index + 1) & OPERAND_START_TOKENS)) {
+		return setError(SyntaxParserError, "Expecting a variable, function, '(', number, not or negate operator.",
+		                getNextTokenStart(index + 1));
+	}
+	m_assignment = index;
+	index += 2;
+	return true;
+}
+
+
+// The value of the assignment is stored in the temporary of a new local
+// variable and removed from the stack, the next statement starts.
+bool Parser::parseSemicolon(int index)
+{
+	if (!(getNextTokenSet(index) & OPERAND_START_TOKENS)) {
+		return setError(SyntaxParserError, "Expecting a variable, function, '(', number, not or negate operator.",
+		                getNextTokenStart(index));
+	}
+	while (m_operators.size() > 0 && (TOKEN_SET(m_tokens[m_operators.back()].type) & OPERATOR_TOKENS)) {
+		if (!popOperator()) return false;
+	}
+	// only the '(' of the expression is open
+	if (m_operators.size() != 1 || m_operators[0] != 0) {
+		return setError(SyntaxParserError, "';' is allowed between statements only.", m_tokens[index].start);
+	}
+	if (m_assignment < 0) {
+		return setError(SyntaxParserError, "Expecting an assignment like 'a = 1' before ';'.", m_tokens[m_statement].start);
+	}
+	string name = getText(m_tokens[m_assignment]);
+	m_postfix += " =" + name;
+	m_evaluator.addTemporary(StoreOpcode, m_locals.size());
+	m_evaluator.addInstruction(PopOpcode);
+	m_locals.push_back(name);
+	m_statement = index + 1;
+	m_assignment = -1;
+	return true;
+}
+
+
+bool Parser::parseIdentifier(int& index)
+{
+	int identifier = index;
+	const Token& token = m_tokens[identifier];
+	if (getNextTokenSet(index) & (TOKEN_SET(NumberToken) | TOKEN_SET(IdentifierToken))) {
+		return setError(SyntaxParserError, "One after another number is not allowed.", getNextTokenStart(index));
+	}
+	index++;
+
+	string name = getText(token);
+	if (index < (int) m_tokens.size() && m_tokens[index].type == OpenBracketToken) {
+		// function, the '(' is skipped and the name is pushed instead; it is used at ')'
+		if (!(getNextTokenSet(index) & (OPERAND_START_TOKENS | TOKEN_SET(CloseBracketToken) | TOKEN_SET(AddToken)))) {
+			return setError(SyntaxParserError, "Expecting a variable, function, '(', ')', number, not or negate operator.",
+			                getNextTokenStart(index));
+		}
+		index++;
+		if (index < (int) m_tokens.size() && m_tokens[index].type == CloseBracketToken) {
+			// function without an argument
+			if (index + 1 < (int) m_tokens.size() && !(getNextTokenSet(index) & OPERAND_FOLLOW_TOKENS)) {
+				return setError(SyntaxParserError, "Expected ')', ',', ';' or operator after ')'.", getNextTokenStart(index));
 			}
+			if (!addFunction(name, 0, token.start)) return false;
+			index++;
+		} else {
+			m_operators.push_back(identifier);
+			m_functionArgumentCounts.push_back(1);
 		}
-		if (token) m_tokens.push_back(token);
+	} else if (index < (int) m_tokens.size() && m_tokens[index].type == OpenIndexToken) {
+		if (!parseIndex(identifier, index)) return false;
+	} else {
+		addValue(token);
 	}
+	return true;
+}
+
 
-	m_currentTokenIndex = 0;
-	while ((token = peekToken())) token->eval(*this);
-	if (m_operators.size() > 0) throw SyntaxError("Missing ')'.");
-	if (m_postfix.size() > 0) m_postfix = m_postfix.substr(1);
+// pushes the value of a local variable, variable or constant
+void Parser::addValue(const Token& token)
+{
+	string name = getText(token);
+	addPostfix(token);
+	int local = m_locals.size() - 1;
+	while (local >= 0 && m_locals[local] != name) local--;
+	auto constant = m_constants.find(name);
+	if (local >= 0) {
+		m_evaluator.addTemporary(LoadOpcode, local);
+	} else if (constant != m_constants.end()) {
+		m_evaluator.addNumber(constant->second);
+	} else {
+		m_evaluator.addVariable(name);
+	}
 }
 
-void Parser::setFunction(string name, float(*function)())
+
+// "name[n]" is the value of the name n samples before, like delay(name, n);
+// "out[n]" is the result of the expression n samples before. The index is the
+// '[' and is set after the ']'.
+bool Parser::parseIndex(int identifier, int& index)
+{
+	const Token& token = m_tokens[identifier];
+	bool output = getText(token) == "out";
+	if (index + 2 >= (int) m_tokens.size() || m_tokens[index + 1].type != NumberToken
+	        || m_tokens[index + 2].type != CloseIndexToken) {
+		return setError(SyntaxParserError, "Expecting a number and ']' after '['.", getNextTokenStart(index));
+	}
+	const Token& number = m_tokens[index + 1];
+	float delay = getNumber(number);
+	if (delay != floorf(delay) || delay < (output ? 1 : 0) || delay > MAX_DELAY) {
+		char message[80];
+		snprintf(message, sizeof(message), "Expecting a whole number of samples from %d to %d in '[]'.", output ? 1 : 0,
+		         MAX_DELAY);
+		return setError(SyntaxParserError, message, number.start);
+	}
+	index += 2;
+	if (index + 1 < (int) m_tokens.size() && !(getNextTokenSet(index) & OPERAND_FOLLOW_TOKENS)) {
+		return setError(SyntaxParserError, "Expected ')', ',', ';' or operator after ']'.", getNextTokenStart(index));
+	}
+	index++;
+	if (output) {
+		m_postfix += " out[" + getText(number) + "]";
+		m_evaluator.addOutput((int) delay);
+	} else {
+		addValue(token);
+		addPostfix(number);
+		m_postfix += " delay";
+		m_evaluator.addNumber(delay);
+		m_evaluator.addDelay((int) delay + 1);
+	}
+	return true;
+}
+
+
+bool Parser::parseCloseBracket(int index)
+{
+	if (index + 1 < (int) m_tokens.size() && !(getNextTokenSet(index) & OPERAND_FOLLOW_TOKENS)) {
+		return setError(SyntaxParserError, "Expected ')', ',', ';' or operator after ')'.", getNextTokenStart(index));
+	}
+
+	while (m_operators.size() > 0 && (TOKEN_SET(m_tokens[m_operators.back()].type) & OPERATOR_TOKENS)) {
+		if (!popOperator()) return false;
+	}
+	if (m_operators.size() == 0) {
+		return setError(SyntaxParserError, "')' found but there is no matching '('.", m_tokens[index].start);
+	}
+	const Token& bracket = m_tokens[m_operators.back()];
+	if (bracket.type == IdentifierToken) {
+		int argumentCount = m_functionArgumentCounts.back();
+		m_functionArgumentCounts.pop_back();
+		addPostfix(bracket);
+		string name = getText(bracket);
+		if (name == "if") {
+			if (argumentCount != 3) return setError(SyntaxParserError, "Expecting 3 arguments for if.", bracket.start);
+			addJoin();
+		} else if (!addFunction(name, argumentCount, bracket.start)) {
+			return false;
+		}
+	}
+	m_operators.pop_back();
+	return true;
+}
+
+
+bool Parser::parseOperator(int index)
 {
+	if (!(getNextTokenSet(index) & OPERAND_START_TOKENS)) {
+		return setError(SyntaxParserError, "Expecting a variable, function, '(', number, not or negate operator.",
+		                getNextTokenStart(index));
+	}
+
+	// a prefix operator has no left operand, so it can't complete any pending operator
+	const Token& token = m_tokens[index];
+	const TokenInfo& info = tokenInfos[token.type];
+	if (info.prefix && index > 0 && (TOKEN_SET(m_tokens[index - 1].type) & OPERAND_END_TOKENS)) {
+		return setError(SyntaxParserError, "Expecting an operator before '!'.", token.start);
+	}
+	if (!info.prefix) {
+		while (m_operators.size() > 0) {
+			int type = m_tokens[m_operators.back()].type;
+			int precedence = tokenInfos[type].precedence;
+			if (precedence < info.precedence) break;
+			// the conditional is right associative, only a ':' completes the
+			// conditional of the ':' before it
+			if (precedence == ConditionalPrecedence && !(token.type == ColonToken && type == ColonToken)) break;
+			if (!popOperator()) return false;
+		}
+	}
+
+	// the jumps are added before the branches, the targets when the next branch starts
+	switch (token.type) {
+	case QuestionToken:
+		addCondition();
+		break;
+	case ColonToken: {
+		if (m_operators.size() == 0 || m_tokens[m_operators.back()].type != QuestionToken) {
+			return setError(SyntaxParserError, "':' found but there is no matching '?'.", token.start);
+		}
+		addElse();
+		m_operators.pop_back();
+		break;
+	}
+	case OrToken:
+		// a|b = !a ? b != 0 : 1
+		m_evaluator.addInstruction(NotOpcode);
+		addCondition();
+		break;
+	case AndToken:
+		// a&b = a ? b != 0 : 0
+		addCondition();
+		break;
+	}
+	m_operators.push_back(index);
+	return true;
+}
+
+
+// moves the operator on the top of the stack to the program, for a
+// conditional and the operators '&' and '|' the last branch is completed
+bool Parser::popOperator()
+{
+	const Token& token = m_tokens[m_operators.back()];
+	switch (token.type) {
+	case QuestionToken:
+		return setError(SyntaxParserError, "Expecting ':' for '?'.", token.start);
+	case ColonToken:
+		m_postfix += " ?:";
+		addJoin();
+		break;
+	case AndToken:
+	case OrToken: {
+		addPostfix(token);
+		m_evaluator.addNumber(0);
+		m_evaluator.addInstruction(NotEqualOpcode);
+		addElse();
+		m_evaluator.addNumber(token.type == AndToken ? 0 : 1);
+		addJoin();
+		break;
+	}
+	default:
+		addPostfix(token);
+		m_evaluator.addInstruction(tokenInfos[token.type].opcode);
+	}
+	m_operators.pop_back();
+	return true;
+}
+
+
+// The condition is on the stack, the then branch follows. The target of the
+// jump is set by addElse().
+void Parser::addCondition()
+{
+	m_jumps.push_back(m_evaluator.getInstructionCount());
+	m_evaluator.addInstruction(JumpIfFalseOpcode);
+}
+
+
+// the then branch jumps over the else branch, which follows
+void Parser::addElse()
+{
+	int jump = m_evaluator.getInstructionCount();
+	m_evaluator.addInstruction(JumpOpcode);
+	m_evaluator.setJumpTarget(m_jumps.back(), jump + 1);
+	m_jumps.back() = jump;
+}
+
+
+// completes the conditional of the last jump
+void Parser::addJoin()
+{
+	m_evaluator.addInstruction(JoinOpcode);
+	m_evaluator.setJumpTarget(m_jumps.back(), m_evaluator.getInstructionCount());
+	m_jumps.pop_back();
+}
+
+
+// if(c, a, b) is c ? a : b, the jumps are added at the commas
+bool Parser::addIfJump(int identifier)
+{
+	switch (m_functionArgumentCounts.back()) {
+	case 1:
+		addCondition();
+		return true;
+	case 2:
+		addElse();
+		return true;
+	}
+	return setError(TooManyArgumentsParserError, TooManyArgumentsError("if").getMessage(), m_tokens[identifier].start, "if");
+}
+
+
+bool Parser::addFunction(string name, int argumentCount, int start)
+{
+	switch (argumentCount) {
+	case 0: {
+		auto function = m_noArgumentFunctions.find(name);
+		if (function == m_noArgumentFunctions.end() || !function->second) break;
+		m_evaluator.addFunction(function->second, isPureFunction(name, 0));
+		return true;
+	}
+	case 1: {
+		auto function = m_oneArgumentFunctions.find(name);
+		if (function == m_oneArgumentFunctions.end() || !function->second) break;
+		m_evaluator.addFunction(function->second, getMathFunction(name, 1), isPureFunction(name, 1));
+		return true;
+	}
+	case 2: {
+		auto function = m_twoArgumentsFunctions.find(name);
+		if (function == m_twoArgumentsFunctions.end() || !function->second) break;
+		m_evaluator.addFunction(function->second, getMathFunction(name, 2), isPureFunction(name, 2));
+		return true;
+	}
+	}
+	// the built-in functions with a state, after the functions of the user
+	if (name == "delay" && argumentCount == 2) {
+		m_evaluator.addDelay();
+		return checkState(name, start);
+	}
+	const StatefulFunction* statefulFunction = findStatefulFunction(name, argumentCount);
+	if (statefulFunction) {
+		m_evaluator.addFunction(statefulFunction);
+		return checkState(name, start);
+	}
+	if (argumentCount > 2) {
+		return setError(TooManyArgumentsParserError, TooManyArgumentsError(name).getMessage(), start, name);
+	}
+	return setError(FunctionNotFoundParserError, FunctionNotFound(name).getMessage(), start, name);
+}
+
+
+// A delay or a stateful function in a branch of a conditional, '&' or '|' is
+// moved before the conditional with its arguments by the optimizer, so that
+// its state is updated for every sample. An argument with a conditional or an
+// impure function can't be moved.
+bool Parser::checkState(string name, int start)
+{
+	if (m_jumps.empty()) return true;
+	const vector<Instruction>& instructions = m_evaluator.peekProgram().instructions;
+	if (Optimizer::findMovableOperands(instructions, instructions.size() - 1) >= 0) return true;
+	return setError(SyntaxParserError, "The arguments of " + name + " in a conditional can't have a conditional or "
+	                "an impure function, calculate them in a statement before.", start);
+}
+
+
+// unknown variables are reported here and not when evaluating
+bool Parser::link()
+{
+	try {
+		m_evaluator.link();
+	} catch (VariableNotFound& e) {
+		return setError(VariableNotFoundParserError, e.getMessage(), findVariable(e.getVariableName()), e.getVariableName());
+	} catch (StackUnderflow& e) {
+		return setError(StackUnderflowParserError, e.getMessage(), -1);
+	}
+	return true;
+}
+
+
+// atof() would read on after the token, like the 'x' of "0x10"
+float Parser::getNumber(const Token& token)
+{
+	char number[64];
+	if (token.length >= (int) sizeof(number)) return atof(getText(token).c_str());
+	memcpy(number, m_expression.data() + token.start, token.length);
+	number[token.length] = 0;
+	return atof(number);
+}
+
+
+void Parser::addPostfix(const Token& token)
+{
+	m_postfix += ' ';
+	if (token.type == NegToken) {
+		m_postfix += "neg";
+	} else {
+		m_postfix.append(m_expression, token.start, token.length);
+	}
+}
+
+
+// the type of the next token as TOKEN_SET, 0 after the last token
+int Parser::getNextTokenSet(int index)
+{
+	if (index + 1 < (int) m_tokens.size()) return TOKEN_SET(m_tokens[index + 1].type);
+	return 0;
+}
+
+
+int Parser::getNextTokenStart(int index)
+{
+	if (index + 1 < (int) m_tokens.size()) return m_tokens[index + 1].start;
+	return m_expression.size() - 1;
+}
+
+
+// the start of the first use of a variable, -1 if there is none
+int Parser::findVariable(string name)
+{
+	// the tokens of a cached program are not available
+	m_parsedExpression = "";
+	if (!tokenize()) return -1;
+	for (int i = 0; i < (int) m_tokens.size(); i++) {
+		const Token& token = m_tokens[i];
+		if (token.type == IdentifierToken && getText(token) == name
+		        && (i + 1 == (int) m_tokens.size() || m_tokens[i + 1].type != OpenBracketToken)) {
+			return token.start;
+		}
+	}
+	return -1;
+}
+
+
+// the start is the index in m_expression, the position of the error is the
+// index in the expression without the brackets
+bool Parser::setError(int type, string message, int start, string name)
+{
+	m_error.type = type;
+	m_error.message = message;
+	m_error.position = -1;
+	if (start >= 0) m_error.position = start > 0 ? start - 1 : 0;
+	m_error.name = name;
+	return false;
+}
+
+// the characters which are a token without the next or the last character
+static bool isSeparator(char c)
+{
+	return c == '(' || c == ')' || c == '[' || c == ']' || c == ',' || c == ';';
+}
+
+// Removes the white space, which doesn't change the program. A space is kept
+// between all other characters than brackets, commas and semicolons, which are
+// always single tokens: "a b" is a syntax error, but "ab" is not, and "< ="
+// is a syntax error, but "<=" is not.
+string Parser::normalizeExpression(string expression)
+{
+	string normalized;
+	bool space = false;
+	for (int i = 0; i < (int) expression.size(); i++) {
+		char c = expression[i];
+		if (c == 9 || c == 10 || c == 13 || c == 32) {
+			space = true;
+			continue;
+		}
+		if (space && normalized.size() > 0 && !isSeparator(c) && !isSeparator(normalized[normalized.size() - 1])) {
+			normalized += ' ';
+		}
+		normalized += c;
+		space = false;
+	}
+	return normalized;
+}
+
+// The function pointers are compared, so the key is only the same for the
+// parsers of one process, like the cache.
+string Parser::getFunctionTableKey()
+{
+	if (!m_functionTableChanged) return m_functionTableKey;
+	string key;
+	char entry[64];
+	for (auto it = m_constants.begin(); it != m_constants.end(); it++) {
+		uint32_t bits;
+		memcpy(&bits, &it->second, sizeof(bits));
+		snprintf(entry, sizeof(entry), "=%08x;", bits);
+		key += it->first + entry;
+	}
+	// pure functions are merged by the optimizer
+	for (auto it = m_noArgumentFunctions.begin(); it != m_noArgumentFunctions.end(); it++) {
+		snprintf(entry, sizeof(entry), "()%p%s;", (void*) it->second, isPureFunction(it->first, 0) ? " pure" : "");
+		key += it->first + entry;
+	}
+	for (auto it = m_oneArgumentFunctions.begin(); it != m_oneArgumentFunctions.end(); it++) {
+		snprintf(entry, sizeof(entry), "(x)%p%s;", (void*) it->second, isPureFunction(it->first, 1) ? " pure" : "");
+		key += it->first + entry;
+	}
+	for (auto it = m_twoArgumentsFunctions.begin(); it != m_twoArgumentsFunctions.end(); it++) {
+		snprintf(entry, sizeof(entry), "(x,y)%p%s;", (void*) it->second, isPureFunction(it->first, 2) ? " pure" : "");
+		key += it->first + entry;
+	}
+	// the built-in functions are calculated with SIMD instructions by evalBlock()
+	for (auto it = m_mathFunctions.begin(); it != m_mathFunctions.end(); it++) {
+		snprintf(entry, sizeof(entry), "#%d;", it->second);
+		key += it->first + entry;
+	}
+	snprintf(entry, sizeof(entry), "accuracy %d", m_mathAccuracy);
+	key += entry;
+	if (m_wavetableVariable.size() > 0) key += ";wavetable " + m_wavetableVariable;
+	for (auto it = m_controlVariables.begin(); it != m_controlVariables.end(); it++) key += ";control " + *it;
+	m_functionTableKey = key;
+	m_functionTableChanged = false;
+	return key;
+}
+
+void Parser::setFunction(string name, float(*function)(), bool pure)
+{
+	m_functionTableChanged = true;
 	m_noArgumentFunctions[name] = function;
+	setPureFunction(name, 0, pure);
 }
 
-void Parser::setFunction(string name, float(*function)(float))
+void Parser::setFunction(string name, float(*function)(float), bool pure)
 {
+	m_functionTableChanged = true;
+	// a user function replaces a built-in math function
+	if (getMathFunction(name, 1) != NoMathFunction) m_mathFunctions.erase(name);
 	m_oneArgumentFunctions[name] = function;
+	setPureFunction(name, 1, pure);
 }
 
-void Parser::setFunction(string name, float(*function)(float, float))
+void Parser::setFunction(string name, float(*function)(float, float), bool pure)
 {
+	m_functionTableChanged = true;
+	if (getMathFunction(name, 2) != NoMathFunction) m_mathFunctions.erase(name);
 	m_twoArgumentsFunctions[name] = function;
+	setPureFunction(name, 2, pure);
+}
+
+void Parser::setPureFunction(string name, int argumentCount, bool pure)
+{
+	if (pure) {
+		m_pureFunctions.insert(make_pair(name, argumentCount));
+	} else {
+		m_pureFunctions.erase(make_pair(name, argumentCount));
+	}
+}
+
+bool Parser::isPureFunction(string name, int argumentCount)
+{
+	// the built-in math functions are pure for all accuracies
+	if (getMathFunction(name, argumentCount) != NoMathFunction) return true;
+	return m_pureFunctions.count(make_pair(name, argumentCount)) > 0;
+}
+
+void Parser::setMathAccuracy(int mathAccuracy)
+{
+	for (auto it = m_mathFunctions.begin(); it != m_mathFunctions.end(); it++) {
+		if (it->second == PowMathFunction) {
+			m_twoArgumentsFunctions[it->first] = getTwoArgumentsMathFunction(it->second, mathAccuracy);
+		} else {
+			m_oneArgumentFunctions[it->first] = getOneArgumentMathFunction(it->second, mathAccuracy);
+		}
+	}
+	m_evaluator.setMathAccuracy(mathAccuracy);
+	m_mathAccuracy = mathAccuracy;
+	m_functionTableChanged = true;
+}
+
+int Parser::getMathFunction(string name, int argumentCount)
+{
+	auto it = m_mathFunctions.find(name);
+	if (it == m_mathFunctions.end()) return NoMathFunction;
+	if ((it->second == PowMathFunction) != (argumentCount == 2)) return NoMathFunction;
+	return it->second;
 }
 
 NoArgumentFunction Parser::getNoArgumentFunction(string name)
@@ -335,3 +1150,105 @@ TwoArgumentsFunction Parser::getTwoArgumentsFunction(string name)
 		throw FunctionNotFound(name);
 	}
 }
+
+// the text as a JSON string, with quotes
+static string toJsonString(const string& text)
+{
+	string json = "\"";
+	for (int i = 0; i < (int) text.size(); i++) {
+		unsigned char c = text[i];
+		if (c == '"' || c == '\\') {
+			json += '\\';
+			json += c;
+		} else if (c < 32) {
+			char escape[8];
+			snprintf(escape, sizeof(escape), "\\u%04x", c);
+			json += escape;
+		} else {
+			json += c;
+		}
+	}
+	return json + "\"";
+}
+
+// the name of the function called by the instruction, or "" if unknown
+string Parser::getFunctionName(const Instruction& instruction)
+{
+	if (instruction.mathFunction != NoMathFunction) {
+		for (auto it = m_mathFunctions.begin(); it != m_mathFunctions.end(); it++) {
+			if (it->second == instruction.mathFunction) return it->first;
+		}
+	}
+	switch (instruction.opcode) {
+	case NoArgumentFunctionOpcode:
+		for (auto it = m_noArgumentFunctions.begin(); it != m_noArgumentFunctions.end(); it++) {
+			if (it->second == instruction.noArgumentFunction) return it->first;
+		}
+		break;
+	case OneArgumentFunctionOpcode:
+		for (auto it = m_oneArgumentFunctions.begin(); it != m_oneArgumentFunctions.end(); it++) {
+			if (it->second == instruction.oneArgumentFunction) return it->first;
+		}
+		break;
+	case TwoArgumentsFunctionOpcode:
+		for (auto it = m_twoArgumentsFunctions.begin(); it != m_twoArgumentsFunctions.end(); it++) {
+			if (it->second == instruction.twoArgumentsFunction) return it->first;
+		}
+		break;
+	case StatefulFunctionOpcode:
+		return instruction.statefulFunction->name;
+	}
+	return "";
+}
+
+// The instructions are summed up by opcode and by the name of the function.
+// The ticks of all instructions are less than the ticks of the calls, which
+// have the ticks of the control values, the skipped evaluations etc. as well.
+string Parser::getProfileJson()
+{
+	const Profile& profile = m_evaluator.getProfile();
+	const vector<Instruction>& instructions = m_evaluator.peekProgram().instructions;
+	map<string, InstructionProfile> opcodes;
+	map<string, InstructionProfile> functions;
+	if (instructions.size() == profile.instructions.size()) {
+		for (int i = 0; i < (int) instructions.size(); i++) {
+			const InstructionProfile& entry = profile.instructions[i];
+			if (entry.count == 0) continue;
+			InstructionProfile& opcode = opcodes[Evaluator::getOpcodeName(instructions[i].opcode)];
+			opcode.count += entry.count;
+			opcode.ticks += entry.ticks;
+			if ((instructions[i].opcode >= NoArgumentFunctionOpcode && instructions[i].opcode <= TwoArgumentsFunctionOpcode)
+			        || instructions[i].opcode == StatefulFunctionOpcode) {
+				string name = getFunctionName(instructions[i]);
+				InstructionProfile& function = functions[name.size() > 0 ? name : "?"];
+				function.count += entry.count;
+				function.ticks += entry.ticks;
+			}
+		}
+	}
+
+	char line[256];
+	string json = "{\n";
+	json += "\t\"expression\": " + toJsonString(m_expression) + ",\n";
+	snprintf(line, sizeof(line),
+	         "\t\"jit\": %s,\n\t\"evaluations\": %lld,\n\t\"blocks\": %lld,\n\t\"samples\": %lld,\n"
+	         "\t\"skippedSamples\": %lld,\n\t\"mathErrors\": %lld,\n\t\"ticks\": %lld,\n",
+	         m_evaluator.isJitEnabled() ? "true" : "false", (long long) profile.evalCount, (long long) profile.blockCount,
+	         (long long) profile.sampleCount, (long long) profile.skippedSampleCount,
+	         (long long) profile.mathErrorCount, (long long) profile.ticks);
+	json += line;
+	const map<string, InstructionProfile>* groups[] = {&opcodes, &functions};
+	const char* groupNames[] = {"opcodes", "functions"};
+	for (int i = 0; i < 2; i++) {
+		json += string("\t\"") + groupNames[i] + "\": {";
+		for (auto it = groups[i]->begin(); it != groups[i]->end(); it++) {
+			json += string(it == groups[i]->begin() ? "" : ",") + "\n\t\t" + toJsonString(it->first);
+			snprintf(line, sizeof(line), ": {\"count\": %lld, \"ticks\": %lld}", (long long) it->second.count,
+			         (long long) it->second.ticks);
+			json += line;
+		}
+		json += groups[i]->empty() ? "}" : "\n\t}";
+		json += i == 0 ? ",\n" : "\n";
+	}
+	return json + "}";
+}
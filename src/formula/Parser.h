@@ -12,41 +12,99 @@
 #define PARSER_H
 
 #include "Evaluator.h"
+#include "Token.h"
 #include <string>
 #include <vector>
-#include <stack>
+#include <set>
 
 using namespace std;
 
-class Token;
+// The state of the parser before the first token of a line. The next
+// expression is parsed from the last line before its first change, and the
+// instructions of the last expression are used again after the last change,
+// from the line where the parser has the same state.
+struct ParserCheckpoint
+{
+	int token;
+	int instructionCount;
+	int variableCount;
+	int postfixSize;
+	// the stacks of operators, function argument counts and jumps are in m_checkpointStacks
+	int stackStart;
+	int operatorCount;
+	int functionCount;
+	int jumpCount;
+	// the local variables before the line, the first token of its statement
+	// and the assigned identifier, -1 if the statement is not an assignment
+	int localCount;
+	int statement;
+	int assignment;
+};
 
 class Parser
 {
-	friend class OperatorToken;
-	friend class AddToken;
-	friend class SubToken;
-	friend class NumberToken;
-	friend class OpenBracketToken;
-	friend class CloseBracketToken;
-	friend class IdentifierToken;
-	friend class CommaToken;
-
 public:
 	Parser(string expression);
 	~Parser();
 	void setExpression(string expression);
+	// returns false and sets the error instead of throwing a ParserException
+	bool setExpression(string expression, ParserError& error);
 	void setVariable(string name, float value) {
 		m_evaluator.setVariable(name, value);
 	}
 	float* getVariableAddress(string name) {
 		return m_evaluator.getVariableAddress(name);
 	}
-	void setFunction(string name, NoArgumentFunction function);
-	void setFunction(string name, OneArgumentFunction function);
-	void setFunction(string name, TwoArgumentsFunction function);
+	int getVariableIndex(string name) {
+		return m_evaluator.getVariableIndex(name);
+	}
+	void setVariables(const float* values, int count) {
+		m_evaluator.setVariables(values, count);
+	}
+	void setVariableBuffer(string name, const float* values) {
+		m_evaluator.setVariableBuffer(name, values);
+	}
+	void setVariableBuffers(const float* const* buffers, int count) {
+		m_evaluator.setVariableBuffers(buffers, count);
+	}
+	void setConstant(string name, float value) {
+		m_constants[name] = value;
+		m_functionTableChanged = true;
+	}
+	// a pure function has no side effects and returns the same value for the
+	// same arguments, so it is called once for equal subexpressions
+	void setFunction(string name, NoArgumentFunction function, bool pure = false);
+	void setFunction(string name, OneArgumentFunction function, bool pure = false);
+	void setFunction(string name, TwoArgumentsFunction function, bool pure = false);
+	bool isPureFunction(string name, int argumentCount);
 	NoArgumentFunction getNoArgumentFunction(string name);
 	OneArgumentFunction getOneArgumentFunction(string name);
 	TwoArgumentsFunction getTwoArgumentsFunction(string name);
+	// rebinds the built-in math functions, used for the next expression
+	void setMathAccuracy(int mathAccuracy);
+	int getMathAccuracy() {
+		return m_mathAccuracy;
+	}
+	// subexpressions of this variable are replaced by wavetables, used for the
+	// next expression; an empty name disables the wavetables
+	void setWavetableVariable(string name) {
+		m_evaluator.setWavetableVariable(name);
+		m_wavetableVariable = name;
+		m_functionTableChanged = true;
+	}
+	string getWavetableVariable() {
+		return m_wavetableVariable;
+	}
+	// see Evaluator::setControlVariable(), used for the next expression
+	void setControlVariable(string name, bool control = true) {
+		m_evaluator.setControlVariable(name, control);
+		if (control) {
+			m_controlVariables.insert(name);
+		} else {
+			m_controlVariables.erase(name);
+		}
+		m_functionTableChanged = true;
+	}
 	
 	string getPostfix() {
 		return m_postfix;
@@ -54,31 +112,156 @@ public:
 	float eval() {
 		return m_evaluator.eval();
 	}
+	int evalBlock(float* output, int count) {
+		return m_evaluator.evalBlock(output, count);
+	}
+	int getErrors() {
+		return m_evaluator.getErrors();
+	}
+	void clearErrors() {
+		m_evaluator.clearErrors();
+	}
+	void resetState() {
+		m_evaluator.resetState();
+	}
+	void setSkipUnchanged(bool skip) {
+		m_evaluator.setSkipUnchanged(skip);
+	}
+	int64_t getSampleCount() {
+		return m_evaluator.getSampleCount();
+	}
+	int64_t getSkippedSampleCount() {
+		return m_evaluator.getSkippedSampleCount();
+	}
+	void clearSampleCounts() {
+		m_evaluator.clearSampleCounts();
+	}
+	void setProfilingEnabled(bool enabled) {
+		m_evaluator.setProfilingEnabled(enabled);
+	}
+	bool isProfilingEnabled() {
+		return m_evaluator.isProfilingEnabled();
+	}
+	const Profile& getProfile() {
+		return m_evaluator.getProfile();
+	}
+	void clearProfile() {
+		m_evaluator.clearProfile();
+	}
+	string getProfileJson();
+	bool setInstructionSet(int instructionSet) {
+		return m_evaluator.setInstructionSet(instructionSet);
+	}
+	int getInstructionSet() {
+		return m_evaluator.getInstructionSet();
+	}
+	bool setJitEnabled(bool enabled) {
+		return m_evaluator.setJitEnabled(enabled);
+	}
+	bool isJitEnabled() {
+		return m_evaluator.isJitEnabled();
+	}
 
 
 private:
-	void deleteTokens();
-	string parseNumber(char c);
-	string parseIdentifier(char c);
-	char peekChar();
-	void skipChar();
-	char skipAndPeekChar();
-	Token* peekToken();
-	Token* peekNextToken();
-	Token* peekLastToken();
-	void skipToken();
+	bool compile(string expression);
+	bool tokenize();
+	bool lex(int start, int end);
+	bool scanNumber(int& index);
+	bool parse();
+	bool startsLine(int index);
+	void addCheckpoint(int index);
+	bool continueParsed(int index);
+	int getParsedIndex(int index);
+	int getIndex(int parsedIndex);
+	bool startsAssignment(int index);
+	bool parseAssignment(int& index);
+	bool parseSemicolon(int index);
+	bool parseIdentifier(int& index);
+	void addValue(const Token& token);
+	bool parseIndex(int identifier, int& index);
+	bool parseCloseBracket(int index);
+	bool parseOperator(int index);
+	bool popOperator();
+	void addCondition();
+	void addElse();
+	void addJoin();
+	bool addIfJump(int identifier);
+	bool addFunction(string name, int argumentCount, int start);
+	bool checkState(string name, int start);
+	bool link();
+	float getNumber(const Token& token);
+	string getText(const Token& token) {
+		return m_expression.substr(token.start, token.length);
+	}
+	void addPostfix(const Token& token);
+	int getNextTokenSet(int index);
+	int getNextTokenStart(int index);
+	int findVariable(string name);
+	bool setError(int type, string message, int start, string name = "");
+	int getMathFunction(string name, int argumentCount);
+	string getFunctionName(const Instruction& instruction);
+	void setPureFunction(string name, int argumentCount, bool pure);
+	static string normalizeExpression(string expression);
+	string getFunctionTableKey();
 
+	// the expression in brackets, the tokens are positions in it
 	string m_expression;
-	int m_currentIndex;
-	int m_currentTokenIndex;
 	string m_postfix;
 	Evaluator m_evaluator;
-	stack<Token*> m_operators;
-	vector<Token*> m_tokens;
-	stack<int> m_functionArgumentCountStack;
+	// the vectors keep their memory for the next expression
+	vector<Token> m_tokens;
+	// the indices of the operators, '(' and function names in m_tokens
+	vector<int> m_operators;
+	vector<int> m_functionArgumentCounts;
+	// the instruction indices of the jumps of the open conditionals, their
+	// targets are set when the next branch starts
+	vector<int> m_jumps;
+	// The local variables of the statements before, in the order of the
+	// assignments; the temporary of a variable is its index. A variable which
+	// is assigned again is a new one, the last one with the name is used.
+	vector<string> m_locals;
+	// the first token of the current statement and its assigned identifier, -1 if none
+	int m_statement;
+	int m_assignment;
+	// the last ';', only a statement before it can be an assignment, so "a=1"
+	// without a ';' is still a comparison
+	int m_lastSemicolon;
+	ParserError m_error;
+
+	// the last parsed expression, for parsing only the changed lines of the next one
+	string m_parsedExpression;
+	string m_parsedPostfix;
+	string m_parsedFunctionTableKey;
+	// the program before optimize()
+	shared_ptr<const Program> m_parsedProgram;
+	vector<Token> m_parsedTokens;
+	vector<ParserCheckpoint> m_checkpoints;
+	vector<ParserCheckpoint> m_parsedCheckpoints;
+	vector<int> m_checkpointStacks;
+	vector<int> m_parsedCheckpointStacks;
+	vector<string> m_parsedLocals;
+	int m_nextParsedCheckpoint;
+	// The tokens before m_changeStart are the same as the parsed tokens, the
+	// tokens from m_changeEnd on are the parsed tokens from m_parsedChangeEnd on.
+	int m_changeStart;
+	int m_changeEnd;
+	int m_parsedChangeEnd;
+	map<string, float> m_constants;
 	map<string, NoArgumentFunction> m_noArgumentFunctions;
 	map<string, OneArgumentFunction> m_oneArgumentFunctions;
 	map<string, TwoArgumentsFunction> m_twoArgumentsFunctions;
+	// the name and the argument count of the pure functions
+	set<pair<string, int> > m_pureFunctions;
+	// the MathFunctions value of the built-in functions which are not replaced
+	map<string, int> m_mathFunctions;
+	int m_mathAccuracy;
+	string m_wavetableVariable;
+	set<string> m_controlVariables;
+	// the constants, functions, the accuracy, the wavetable and the control
+	// variables as text, for the program cache
+	string m_functionTableKey;
+	bool m_functionTableChanged;
 };
 
 
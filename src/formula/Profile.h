@@ -0,0 +1,78 @@
+/**
+ *
+ * Copyright (c) 2001, Frank Bu
+ *
+ * project: Formula
+ * version: $Revision: 1.3 $ $Name:  $
+ *
+ * Profile of the evaluations of an expression, collected by the Evaluator
+ * while profiling is enabled.
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+using namespace std;
+
+// The time stamp counter of the CPU on x86, otherwise the nanoseconds of a
+// monotonic clock. Only the differences are used, as the ticks of a profile.
+inline int64_t readProfileTicks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+// the runs of one instruction and the ticks of them, one run of evalBlock()
+// calculates up to EVALUATOR_BLOCK_SIZE samples
+struct InstructionProfile
+{
+	int64_t count;
+	int64_t ticks;
+};
+
+struct Profile
+{
+	// the calls of eval() and evalBlock() and the ticks of them
+	int64_t evalCount;
+	int64_t blockCount;
+	int64_t ticks;
+	// the samples of the calls, one per eval(), the skipped of them, see
+	// Evaluator::setSkipUnchanged(), and the samples with a math error
+	int64_t sampleCount;
+	int64_t skippedSampleCount;
+	int64_t mathErrorCount;
+	// By the index of the instruction in the program. The machine code of the
+	// JIT compiler isn't profiled per instruction.
+	vector<InstructionProfile> instructions;
+
+	Profile() {
+		clear();
+	}
+	void clear() {
+		evalCount = 0;
+		blockCount = 0;
+		ticks = 0;
+		sampleCount = 0;
+		skippedSampleCount = 0;
+		mathErrorCount = 0;
+		for (int i = 0; i < (int) instructions.size(); i++) {
+			instructions[i].count = 0;
+			instructions[i].ticks = 0;
+		}
+	}
+};
+
+
+#endif
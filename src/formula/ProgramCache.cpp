@@ -0,0 +1,63 @@
+/**
+ *
+ * Copyright (c) 2001, Frank Bu
+ *
+ * project: Formula
+ * version: $Revision: 1.3 $ $Name:  $
+ *
+ * Process-wide cache of the compiled programs.
+ */
+
+#include "ProgramCache.h"
+
+#include <mutex>
+
+using namespace std;
+
+
+// the statics are initialized on the first call, also from multiple threads
+static mutex& getCacheMutex()
+{
+	static mutex cacheMutex;
+	return cacheMutex;
+}
+
+static map<string, weak_ptr<const Program> >& getCache()
+{
+	static map<string, weak_ptr<const Program> > cache;
+	return cache;
+}
+
+shared_ptr<const Program> findCachedProgram(const string& key)
+{
+	lock_guard<mutex> lock(getCacheMutex());
+	auto it = getCache().find(key);
+	if (it == getCache().end()) return shared_ptr<const Program>();
+	return it->second.lock();
+}
+
+void cacheProgram(const string& key, shared_ptr<const Program> program)
+{
+	lock_guard<mutex> lock(getCacheMutex());
+	map<string, weak_ptr<const Program> >& cache = getCache();
+
+	// the programs which are not used anymore are removed here
+	for (auto it = cache.begin(); it != cache.end();) {
+		if (it->second.expired()) {
+			it = cache.erase(it);
+		} else {
+			it++;
+		}
+	}
+	cache[key] = program;
+}
+
+int getCachedProgramCount()
+{
+	lock_guard<mutex> lock(getCacheMutex());
+	int count = 0;
+	for (auto it = getCache().begin(); it != getCache().end(); it++) {
+		if (!it->second.expired()) count++;
+	}
+	return count;
+}
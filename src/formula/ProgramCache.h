@@ -0,0 +1,30 @@
+/**
+ *
+ * Copyright (c) 2001, Frank Bu
+ *
+ * project: Formula
+ * version: $Revision: 1.3 $ $Name:  $
+ *
+ * Process-wide cache of the compiled programs.
+ */
+
+#ifndef PROGRAMCACHE_H
+#define PROGRAMCACHE_H
+
+#include "Evaluator.h"
+
+using namespace std;
+
+// The key is the normalized expression and everything else which changes the
+// program, see Parser::setExpression(). The cache doesn't own the programs, a
+// program is removed when the last evaluator doesn't use it anymore. The
+// functions can be called by multiple threads.
+
+// returns NULL if the program is not in the cache
+shared_ptr<const Program> findCachedProgram(const string& key);
+void cacheProgram(const string& key, shared_ptr<const Program> program);
+// the number of programs in the cache, for statistics
+int getCachedProgramCount();
+
+
+#endif
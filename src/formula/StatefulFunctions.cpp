@@ -0,0 +1,151 @@
+/**
+ *
+ * Copyright (c) 2001, Frank Bu
+ *
+ * project: Formula
+ * version: $Revision: 1.3 $ $Name:  $
+ *
+ * Built-in functions with a state, like filters, and the delay lines.
+ */
+
+#include "StatefulFunctions.h"
+
+#include <math.h>
+#include <stddef.h>
+
+
+// a non-finite result would stay in the state forever, so the state starts
+// again with 0 after a math error
+static float checkState(float* state, int size, float result)
+{
+	if (!isfinite(result)) {
+		for (int i = 0; i < size; i++) state[i] = 0;
+	}
+	return result;
+}
+
+// the cutoff frequency is limited to the Nyquist frequency, a negative or
+// non-finite frequency is 0
+static float limitFrequency(float frequency, float maximum)
+{
+	if (!(frequency >= 0)) return 0;
+	return frequency < maximum ? frequency : maximum;
+}
+
+
+// One-pole filter with the output, the last cutoff frequency and its
+// coefficient as the state; the coefficient of the frequency 0 is 0, so the
+// state is valid at the start.
+static float lowpass(float* state, const float* arguments)
+{
+	if (arguments[1] != state[1]) {
+		state[1] = arguments[1];
+		state[2] = 1.0f - expf(-2.0f * (float) M_PI * limitFrequency(arguments[1], 0.5f));
+	}
+	state[0] += state[2] * (arguments[0] - state[0]);
+	return checkState(state, 1, state[0]);
+}
+
+static float highpass(float* state, const float* arguments)
+{
+	return arguments[0] - lowpass(state, arguments);
+}
+
+
+// Biquad filters of the Audio EQ Cookbook, in transposed direct form II. The
+// state has the two delayed values, a flag whether the coefficients are set,
+// the last frequency and resonance and the coefficients b0, b1, b2, a1, a2.
+enum BiquadTypes {
+	LowpassBiquad,
+	HighpassBiquad,
+	BandpassBiquad
+};
+
+static void setBiquad(float* state, int type, float frequency, float resonance)
+{
+	state[2] = 1;
+	state[3] = frequency;
+	state[4] = resonance;
+	float omega = 2.0f * (float) M_PI * limitFrequency(frequency, 0.49f);
+	float cosine = cosf(omega);
+	float alpha = sinf(omega) / (2.0f * (resonance >= 0.01f ? resonance : 0.01f));
+	float a0 = 1.0f + alpha;
+	switch (type) {
+	case LowpassBiquad:
+		state[5] = state[7] = (1.0f - cosine) / 2.0f / a0;
+		state[6] = (1.0f - cosine) / a0;
+		break;
+	case HighpassBiquad:
+		state[5] = state[7] = (1.0f + cosine) / 2.0f / a0;
+		state[6] = -(1.0f + cosine) / a0;
+		break;
+	default:
+		// the peak gain is 0 dB
+		state[5] = alpha / a0;
+		state[6] = 0;
+		state[7] = -alpha / a0;
+	}
+	state[8] = -2.0f * cosine / a0;
+	state[9] = (1.0f - alpha) / a0;
+}
+
+template<int type>
+static float biquad(float* state, const float* arguments)
+{
+	if (state[2] == 0 || arguments[1] != state[3] || arguments[2] != state[4]) {
+		setBiquad(state, type, arguments[1], arguments[2]);
+	}
+	float x = arguments[0];
+	float y = state[5] * x + state[0];
+	state[0] = state[6] * x - state[8] * y + state[1];
+	state[1] = state[7] * x - state[9] * y;
+	return checkState(state, 2, y);
+}
+
+
+// the change per sample is limited to the rate
+static float slew(float* state, const float* arguments)
+{
+	float rate = fabsf(arguments[1]);
+	float change = arguments[0] - state[0];
+	if (change > rate) change = rate;
+	if (change < -rate) change = -rate;
+	state[0] += change;
+	return checkState(state, 1, state[0]);
+}
+
+// the sum of all samples
+static float integrate(float* state, const float* arguments)
+{
+	state[0] += arguments[0];
+	return checkState(state, 1, state[0]);
+}
+
+// 1 at the samples where the argument becomes positive, otherwise 0
+static float rise(float* state, const float* arguments)
+{
+	float result = arguments[0] > 0 && !(state[0] > 0);
+	state[0] = arguments[0];
+	return result;
+}
+
+
+static const StatefulFunction statefulFunctions[] = {
+	{"lowpass", 2, 3, lowpass},
+	{"highpass", 2, 3, highpass},
+	{"lowpass2", 3, 10, biquad<LowpassBiquad>},
+	{"highpass2", 3, 10, biquad<HighpassBiquad>},
+	{"bandpass2", 3, 10, biquad<BandpassBiquad>},
+	{"slew", 2, 1, slew},
+	{"integrate", 1, 1, integrate},
+	{"rise", 1, 1, rise}
+};
+
+const StatefulFunction* findStatefulFunction(string name, int argumentCount)
+{
+	for (int i = 0; i < (int) (sizeof(statefulFunctions) / sizeof(statefulFunctions[0])); i++) {
+		const StatefulFunction& function = statefulFunctions[i];
+		if (name == function.name && argumentCount == function.argumentCount) return &function;
+	}
+	return NULL;
+}
@@ -0,0 +1,71 @@
+/**
+ *
+ * Copyright (c) 2001, Frank Bu
+ *
+ * project: Formula
+ * version: $Revision: 1.3 $ $Name:  $
+ *
+ * Built-in functions with a state, like filters, and the delay lines.
+ */
+
+#ifndef STATEFULFUNCTIONS_H
+#define STATEFULFUNCTIONS_H
+
+#include <string>
+
+using namespace std;
+
+// The longest delay of delay(x, n) and x[n] in samples. The ring buffer of a
+// delay which is not a constant has this length, 256 KB per delay and module.
+#define MAX_DELAY 65535
+
+// A function which is called once per sample with its arguments and its part
+// of the state block of the evaluator, which is 0 at the start. It runs in the
+// audio thread, so it must not allocate memory. The frequencies of the filters
+// are relative to the sample rate of the evaluation.
+struct StatefulFunction
+{
+	const char* name;
+	int argumentCount;
+	// the number of floats of the state
+	int stateSize;
+	float (*function)(float* state, const float* arguments);
+};
+
+// the most arguments of a stateful function
+#define STATEFUL_MAX_ARGUMENTS 3
+
+// returns NULL if there is no built-in function with the name and the argument count
+const StatefulFunction* findStatefulFunction(string name, int argumentCount);
+
+// The ring buffer of a delay line has the position of the next sample as the
+// first float, followed by length samples. The delay is rounded and limited to
+// the length - 1, a non-finite delay is 0.
+inline int getDelaySamples(float delay, int length)
+{
+	if (delay >= 0) return delay < length - 1 ? (int) (delay + 0.5f) : length - 1;
+	return 0;
+}
+
+// writes the sample to the ring buffer and returns the sample delay samples before it
+inline float delaySample(float* ring, int length, float value, float delay)
+{
+	int position = ring[0];
+	ring[1 + position] = value;
+	int index = position - getDelaySamples(delay, length);
+	if (index < 0) index += length;
+	ring[0] = position + 1 < length ? position + 1 : 0;
+	return ring[1 + index];
+}
+
+// returns the sample delay samples before the sample which will be written at
+// the next position + offset, the offset must be less than the delay
+inline float readDelayed(const float* ring, int length, int delay, int offset)
+{
+	int index = (int) ring[0] - delay + offset;
+	if (index < 0) index += length;
+	return ring[1 + index];
+}
+
+
+#endif
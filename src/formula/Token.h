@@ -5,14 +5,17 @@
  * project: Formula
  * version: $Revision: 1.3 $ $Name:  $
  *
- * All token classes, used by the Parser class.
+ * All token types, used by the Parser class.
  */
 
-#include "Parser.h"
+#ifndef TOKEN_H
+#define TOKEN_H
+
 #include "Evaluator.h"
 
 enum Precedences {
 	LowestPrecedence,
+	ConditionalPrecedence,
 	OrPrecedence,
 	AndPrecedence,
 	EqualPrecedence,
@@ -24,247 +27,72 @@ enum Precedences {
 	PowerPrecedence
 };
 
-class Token
-{
-public:
-	Token(string value) : m_value(value) {}
-	virtual ~Token() {}
-	virtual void eval(Parser& parser) = 0;
-	string getValue() {
-		return m_value;
-	}
-	virtual int getPrecedence() {
-		return LowestPrecedence;
-	}
-protected:
-	string m_value;
-};
-
-class OperatorToken : public Token
-{
-public:
-	OperatorToken(string value) : Token(value) {}
-	virtual void eval(Parser& parser) override;
-	virtual Action* getAction() {
-		return NULL;
-	}
-};
-
-class AddToken : public OperatorToken
-{
-public:
-	AddToken() : OperatorToken("+") {}
-	virtual void eval(Parser& parser) override;
-	virtual Action* getAction() override {
-		return new AddAction();
-	}
-	virtual int getPrecedence() override {
-		return AddSubPrecedence;
-	}
-};
-
-class SubToken : public OperatorToken
-{
-public:
-	SubToken() : OperatorToken("-") {}
-	virtual void eval(Parser& parser) override;
-	virtual Action* getAction() override {
-		return m_action;
-	}
-	virtual int getPrecedence() override {
-		return m_precedence;
-	}
-private:
-	Action* m_action;
-	int m_precedence;
-};
-
-class MulToken : public OperatorToken
-{
-public:
-	MulToken() : OperatorToken("*") {}
-	virtual Action* getAction() override {
-		return new MulAction();
-	}
-	virtual int getPrecedence() override {
-		return MulDivPrecedence;
-	}
-};
-
-class DivToken : public OperatorToken
-{
-public:
-	DivToken() : OperatorToken("/") {}
-	virtual Action* getAction() override {
-		return new DivAction();
-	}
-	virtual int getPrecedence() override {
-		return MulDivPrecedence;
-	}
-};
-
-class PowerToken : public OperatorToken
-{
-public:
-	PowerToken() : OperatorToken("^") {}
-	virtual Action* getAction() override {
-		return new PowerAction();
-	}
-	virtual int getPrecedence() override {
-		return PowerPrecedence;
-	}
-};
-
-
-class LessToken : public OperatorToken
-{
-public:
-	LessToken() : OperatorToken("<") {}
-	virtual Action* getAction() override {
-		return new LessAction();
-	}
-	virtual int getPrecedence() override {
-		return RelationalPrecedence;
-	}
-};
-
-
-class GreaterToken : public OperatorToken
-{
-public:
-	GreaterToken() : OperatorToken(">") {}
-	virtual Action* getAction() override {
-		return new GreaterAction();
-	}
-	virtual int getPrecedence() override {
-		return RelationalPrecedence;
-	}
-};
-
-
-class LessEqualToken : public OperatorToken
-{
-public:
-	LessEqualToken() : OperatorToken("<=") {}
-	virtual Action* getAction() override {
-		return new LessEqualAction();
-	}
-	virtual int getPrecedence() override {
-		return RelationalPrecedence;
-	}
-};
-
-
-class GreaterEqualToken : public OperatorToken
-{
-public:
-	GreaterEqualToken() : OperatorToken(">=") {}
-	virtual Action* getAction() override {
-		return new GreaterEqualAction();
-	}
-	virtual int getPrecedence() override {
-		return RelationalPrecedence;
-	}
-};
-
-
-class EqualToken : public OperatorToken
-{
-public:
-	EqualToken() : OperatorToken("=") {}
-	virtual Action* getAction() override {
-		return new EqualAction();
-	}
-	virtual int getPrecedence() override {
-		return EqualPrecedence;
-	}
-};
-
-
-class NotEqualToken : public OperatorToken
-{
-public:
-	NotEqualToken() : OperatorToken("!=") {}
-	virtual Action* getAction() override {
-		return new NotEqualAction();
-	}
-	virtual int getPrecedence() override {
-		return EqualPrecedence;
-	}
-};
-
-
-class AndToken : public OperatorToken
-{
-public:
-	AndToken() : OperatorToken("&") {}
-	virtual Action* getAction() override {
-		return new AndAction();
-	}
-	virtual int getPrecedence() override {
-		return AndPrecedence;
-	}
-};
-
-
-class OrToken : public OperatorToken
-{
-public:
-	OrToken() : OperatorToken("|") {}
-	virtual Action* getAction() override {
-		return new OrAction();
-	}
-	virtual int getPrecedence() override {
-		return OrPrecedence;
-	}
-};
-
-
-class NotToken : public OperatorToken
-{
-public:
-	NotToken() : OperatorToken("!") {}
-	virtual Action* getAction() override {
-		return new NotAction();
-	}
-	virtual int getPrecedence() override {
-		return NotPrecedence;
-	}
-};
-
-
-class NumberToken : public Token
-{
-public:
-	NumberToken(string value) : Token(value) {}
-	void eval(Parser& parser) override;
-};
-
-class CommaToken : public Token
-{
-public:
-	CommaToken() : Token(",") {}
-	virtual void eval(Parser& parser) override;
-};
-
-class OpenBracketToken : public Token
-{
-public:
-	OpenBracketToken() : Token("(") {}
-	void eval(Parser& parser) override;
-};
-
-class IdentifierToken : public Token
-{
-public:
-	IdentifierToken(string value) : Token(value) {}
-	void eval(Parser& parser) override;
-};
-
-
-class CloseBracketToken : public Token
-{
-public:
-	CloseBracketToken() : Token(")") {}
-	void eval(Parser& parser) override;
-};
+enum TokenTypes {
+	NumberToken,
+	IdentifierToken,
+	OpenBracketToken,
+	CloseBracketToken,
+	CommaToken,
+	// ends a statement, which assigns a local variable
+	SemicolonToken,
+	// the brackets of a delay like x[1]
+	OpenIndexToken,
+	CloseIndexToken,
+	// the operators, a '-' becomes a NegToken when it has no left operand
+	AddToken,
+	SubToken,
+	NegToken,
+	MulToken,
+	DivToken,
+	PowerToken,
+	LessToken,
+	GreaterToken,
+	LessEqualToken,
+	GreaterEqualToken,
+	EqualToken,
+	NotEqualToken,
+	AndToken,
+	OrToken,
+	NotToken,
+	// '?' and ':' of a conditional
+	QuestionToken,
+	ColonToken,
+	TokenTypeCount
+};
+
+// sets of token types as bit masks, for the syntax checks of the parser
+#define TOKEN_SET(type) (1 << (type))
+#define OPERATOR_TOKENS (((1 << TokenTypeCount) - 1) & ~((1 << AddToken) - 1))
+// the tokens which can be first of an operand; a '-' of an incremental parse
+// can be a NegToken of the last parse
+#define OPERAND_START_TOKENS (TOKEN_SET(IdentifierToken) | TOKEN_SET(OpenBracketToken) | TOKEN_SET(NumberToken) \
+                              | TOKEN_SET(NotToken) | TOKEN_SET(SubToken) | TOKEN_SET(NegToken))
+// the tokens which can be last of an operand
+#define OPERAND_END_TOKENS (TOKEN_SET(NumberToken) | TOKEN_SET(IdentifierToken) | TOKEN_SET(CloseBracketToken) \
+                            | TOKEN_SET(CloseIndexToken))
+// the tokens which can follow an operand
+#define OPERAND_FOLLOW_TOKENS (TOKEN_SET(CloseBracketToken) | OPERATOR_TOKENS | TOKEN_SET(CommaToken) \
+                               | TOKEN_SET(SemicolonToken))
+
+// A token is the type and the position of its characters in the expression,
+// the text is not copied.
+struct Token
+{
+	int type;
+	int start;
+	int length;
+};
+
+struct TokenInfo
+{
+	int precedence;
+	Opcode opcode;
+	// a prefix operator has no left operand
+	bool prefix;
+};
+
+// indexed by the token type, the precedence of the other tokens is the lowest
+extern const TokenInfo tokenInfos[TokenTypeCount];
+
+
+#endif
@@ -0,0 +1,61 @@
+/**
+ *
+ * Copyright (c) 2001, Frank Bu
+ *
+ * project: Formula
+ * version: $Revision: 1.3 $ $Name:  $
+ *
+ * Wavetable of a subexpression which depends only on the phase, rendered by
+ * the Optimizer.
+ */
+
+#ifndef WAVETABLE_H
+#define WAVETABLE_H
+
+#include <math.h>
+
+using namespace std;
+
+// the samples of one period
+#define WAVETABLE_SIZE 2048
+
+// A subexpression is only replaced by a wavetable if the interpolated values
+// between the samples differ by less than this from the calculated values,
+// relative to the peak value, but at least 1.
+#define WAVETABLE_TOLERANCE 1e-5f
+
+// One period of a function of the phase, with a period of 1. The sample i is
+// the value for the phase i / WAVETABLE_SIZE. The first and the last two
+// samples of the period are repeated, so that the interpolation doesn't wrap.
+struct Wavetable
+{
+	float samples[WAVETABLE_SIZE + 3];
+
+	// cubic Lagrange interpolation of the samples around the phase, a
+	// non-finite phase gives NaN
+	float read(float phase) const {
+		// floorf() is a function call without SSE4.1, so it is only called
+		// for a phase outside of 0 to 1
+		if (!(phase >= 0.0f && phase < 1.0f)) {
+			phase -= floorf(phase);
+			if (!(phase >= 0.0f)) return NAN;
+		}
+		float x = phase * WAVETABLE_SIZE;
+		int i = (int) x;
+		float t = x - i;
+		// a phase a bit less than 0 is rounded to 1
+		if (i >= WAVETABLE_SIZE) {
+			i = 0;
+			t = 0.0f;
+		}
+		const float* s = samples + i;
+		float tm1 = t - 1.0f;
+		float tm2 = t - 2.0f;
+		float tp1 = t + 1.0f;
+		return (s[3] * tp1 * t * tm1 - s[0] * t * tm1 * tm2) * (1.0f / 6.0f)
+		       + (s[1] * tp1 * tm1 * tm2 - s[2] * tp1 * t * tm2) * 0.5f;
+	}
+};
+
+
+#endif